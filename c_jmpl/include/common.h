@@ -15,16 +15,25 @@
 #define DEBUG_PRINT_TOKENS
 // #define DEBUG_STRESS_GC
 // #define DEBUG_LOG_GC
+// #define DEBUG_GC_STATS
+// #define DEBUG_GLOBAL_STATS
+// #define DEBUG_QUICKEN_STATS
 
 // Args
 
 #define JMPL_NAN_BOXING
-// #define JMPL_COMPUTED_GOTOS
+// JMPL_COMPUTED_GOTOS is defined by CMake when the compiler supports computed gotos
 
 // Misc
 
 #define UINT8_COUNT (UINT8_MAX + 1)
 
+#ifdef _MSC_VER
+    #define THREAD_LOCAL __declspec(thread)
+#else
+    #define THREAD_LOCAL _Thread_local
+#endif
+
 // ANSI Colours
 
 #define ANSI_RESET "\e[0m"
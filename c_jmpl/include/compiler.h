@@ -4,7 +4,7 @@
 #include "vm.h"
 #include "gc.h"
 
-ObjFunction* compile(GC* gc, const unsigned char* source);
-void markCompilerRoots();
+ObjFunction* compile(VM* vm, const unsigned char* source);
+void markCompilerRoots(GC* gc);
 
 #endif
\ No newline at end of file
@@ -9,8 +9,8 @@
 
 const unsigned char* getTokenName(TokenKind type);
 
-void disassembleChunk(Chunk* chunk, const char* name);
+void disassembleChunk(VM* vm, Chunk* chunk, const char* name);
 void printStack(Value* stack, Value* stackTop);
-int disassembleInstruction(Chunk* chunk, int offset);
+int disassembleInstruction(VM* vm, Chunk* chunk, int offset);
 
 #endif
\ No newline at end of file
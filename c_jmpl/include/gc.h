@@ -3,29 +3,80 @@
 #define c_jmpl_gc_h
 
 #include "value.h"
+#include "page.h"
 
 typedef struct Obj Obj;
 
 #define INTIAL_GC 1024 * 1024
 // #define INTIAL_GC 1024
 #define GC_HEAP_GROW_FACTOR 2
+#define NURSERY_SIZE (4 * 1024 * 1024) // Bytes allocated between collections
+#define PROMOTION_AGE 2                 // Every how many minor collections the young objects that survive are promoted
+#define MARK_STEP_SIZE (256 * 1024)     // Bytes allocated between steps of incremental marking
+#define GC_PAUSE_DEFAULT 1.0            // Milliseconds a step of incremental marking aims to take
+#define GC_PAUSE_BUCKETS 11             // No. lengths of pause that are counted, see printGCStats
 
+/**
+ * @brief A generational heap, where objects start young and are promoted to old once they have survived long enough.
+ *
+ * A minor collection only frees young objects, tracing from the roots and from the remembered set of old objects
+ * that have been changed since the young objects were last promoted. The survivors are promoted all at once, so an
+ * old object only references a young one through a store to it. A major collection frees both generations.
+ *
+ * A major collection marks incrementally, in steps between which the program runs. Objects changed after they are
+ * marked are remembered and traced again, and the roots are marked again before the unmarked objects are freed.
+ *
+ * Objects are kept in pages, whose bitmaps say which of them are marked and young. The pages of small objects are
+ * swept lazily after a major collection, as objects of their size are allocated, and the rest are swept before the
+ * next collection.
+ */
 typedef struct GC {
-    Obj* objects;
+    VM* vm; // The VM whose roots are marked, and whose strings are interned, when collecting
+    SizeClass classes[SIZE_CLASS_COUNT];
+    PageList largePages;
+    bool isSweeping; // If there are pages that haven't been swept since the last major collection
+
+    int youngPageCount;
+    int youngPageCapacity;
+    Page** youngPages; // Pages holding objects that haven't been promoted
     size_t bytesAllocated;
-    size_t nextGC;
+    size_t youngBytes; // Bytes allocated since the last collection
+    size_t stepAt;     // Young bytes at which the GC next runs
+    int youngAge;      // No. minor collections since the young objects were last promoted
+    size_t nextGC;     // Bytes surviving the nursery at which the next collection is major
+    size_t budget;     // Bytes a worker can allocate before it gives up, as it never collects
+
+    bool isMarking;     // If a major collection is marking in steps
+    size_t markStart;   // Young bytes when marking started
+    double pauseTarget; // Milliseconds a step of marking aims to take, or 0 to mark all at once
 
     int greyCount;
     int greyCapacity;
     Obj** greyStack;
 
+    int rememberedCount;
+    int rememberedCapacity;
+    Obj** remembered;
+
+    uint64_t minorCount;
+    uint64_t majorCount;
+    uint64_t stepCount;
+    double minorSeconds;
+    double majorSeconds;
+    double longestPause;
+    uint64_t pauses[GC_PAUSE_BUCKETS]; // No. pauses of each length, see printGCStats
+#ifdef DEBUG_GC_STATS
+    uint64_t promotedCount;
+#endif
+
     int tempCount;
     int tempCapacity;
     Value* tempStack;
 } GC;
 
-void initGC(GC* gc);
+void initGC(GC* gc, VM* vm);
 void freeGC(GC* gc);
+void moveObjects(GC* gc, GC* from);
 
 void pushTemp(GC* gc, Value value);
 Value popTemp(GC* gc);
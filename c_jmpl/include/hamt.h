@@ -0,0 +1,51 @@
+#ifndef c_jmpl_hamt_h
+#define c_jmpl_hamt_h
+
+#include "object.h"
+#include "set.h"
+
+#define HAMT_BITS  5
+#define HAMT_WIDTH (1 << HAMT_BITS)
+
+/**
+ * @brief A slot of a trie node, which is either an element or a child node.
+ */
+typedef union {
+    SetEntry entry;
+    ObjSetNode* node;
+} SetSlot;
+
+/**
+ * @brief A node of a hash array mapped trie, the representation of a persistent set.
+ *
+ * Each level of the trie branches on the next 5 bits of the mixed hash of an element. A node stores
+ * the elements of its occupied branches, in branch order, followed by its children. Nodes are never
+ * changed once built, so tries share all but the path to a change.
+ *
+ * A node with neither map set holds elements whose hashes are all equal.
+ */
+struct ObjSetNode {
+    Obj obj;
+    uint32_t dataMap; // Branches holding an element
+    uint32_t nodeMap; // Branches holding a child node
+    uint32_t size;    // No. slots
+    size_t count;     // No. elements in the node and its children
+    SetSlot slots[];
+};
+
+static inline bool isCollisionNode(ObjSetNode* node) {
+    return node->dataMap == 0 && node->nodeMap == 0;
+}
+
+uint32_t hamtDataCount(ObjSetNode* node);
+
+ObjSetNode* hamtBuild(GC* gc, ObjSet* set);
+ObjSetNode* hamtInsert(GC* gc, ObjSetNode* root, SetEntry entry, bool* added);
+ObjSetNode* hamtRemove(GC* gc, ObjSetNode* root, Value key, hash_t hash, bool* removed);
+
+SetEntry* hamtFind(ObjSetNode* root, Value key, hash_t hash);
+SetEntry* hamtEntryAt(ObjSetNode* root, size_t index);
+
+void markSetNode(GC* gc, ObjSetNode* node);
+
+#endif
\ No newline at end of file
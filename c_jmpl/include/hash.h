@@ -11,6 +11,7 @@
 
 typedef uint64_t hash_t;
 
+hash_t hashAvalanche(hash_t hash);
 hash_t hashString(hash_t hash, const unsigned char* key, int length);
 hash_t hashValue(Value value);
 
@@ -4,21 +4,18 @@
 #include "object.h"
 
 /**
- * @brief Object to iterate through another object.
+ * @brief Iteration through an object by a generator loop.
+ * 
+ * There is no iterator object: a loop keeps the target and the index of its next value in two
+ * locals, so iterating never allocates and the target stays reachable from the stack.
  * 
  * Iterable objects:
  * - Set
  * - Tuple
  * - String
+ * - Range
  */
-typedef struct {
-    Obj obj;
-    Obj* target;        // Object to iterate through
-    int currentIndex;   // Index of the current value
-} ObjIterator;
-
-ObjIterator* newIterator(GC* gc, Obj* target);
-void freeIterator(GC* gc, ObjIterator* iterator);
-bool iterateObj(ObjIterator* iterator, Value* value);
+bool iterateObj(Obj* target, size_t* index, Value* value);
+size_t iterationEnd(Obj* target);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,93 @@
+#ifndef c_jmpl_jmpl_h
+#define c_jmpl_jmpl_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief The C API of libjmpl, for running JMPL inside another program.
+ *
+ * Values are passed to and from a VM through its slots, which are numbered from 0 and are kept alive by the VM.
+ * A value that must outlive the slots, e.g. a compiled function that is called many times, is held by a handle.
+ * A VM must only be used by one thread at a time, but VMs on different threads are independent.
+ */
+
+typedef struct VM JmplVM;
+typedef struct Handle JmplHandle;
+
+typedef enum {
+    JMPL_OK,
+    JMPL_COMPILE_ERROR,
+    JMPL_RUNTIME_ERROR
+} JmplResult;
+
+typedef enum {
+    JMPL_TYPE_NULL,
+    JMPL_TYPE_BOOL,
+    JMPL_TYPE_NUMBER,
+    JMPL_TYPE_CHAR,
+    JMPL_TYPE_STRING,
+    JMPL_TYPE_SET,
+    JMPL_TYPE_TUPLE,
+    JMPL_TYPE_FUNCTION,
+    JMPL_TYPE_OTHER
+} JmplType;
+
+// --- VMs ---
+
+void jmplInitThreads(int count);
+void jmplFreeThreads(void);
+
+JmplVM* jmplNewVM(void);
+void jmplFreeVM(JmplVM* vm);
+void jmplSetMaxFrames(JmplVM* vm, int frameLimit);
+void jmplSetGCPause(JmplVM* vm, double milliseconds);
+
+JmplResult jmplInterpret(JmplVM* vm, const char* source);
+
+// --- Functions ---
+
+JmplHandle* jmplCompile(JmplVM* vm, const char* source);
+bool jmplGetGlobal(JmplVM* vm, const char* name, int slot);
+JmplResult jmplCall(JmplVM* vm, JmplHandle* function, int argCount);
+
+// --- Handles ---
+
+JmplHandle* jmplGetHandle(JmplVM* vm, int slot);
+void jmplSetHandle(JmplVM* vm, int slot, JmplHandle* handle);
+void jmplReleaseHandle(JmplVM* vm, JmplHandle* handle);
+
+// --- Slots ---
+
+void jmplEnsureSlots(JmplVM* vm, int count);
+int jmplSlotCount(JmplVM* vm);
+JmplType jmplGetType(JmplVM* vm, int slot);
+
+void jmplSetNull(JmplVM* vm, int slot);
+void jmplSetBool(JmplVM* vm, int slot, bool value);
+void jmplSetNumber(JmplVM* vm, int slot, double value);
+void jmplSetChar(JmplVM* vm, int slot, uint32_t codePoint);
+void jmplSetString(JmplVM* vm, int slot, const char* utf8, size_t length);
+void jmplSetTuple(JmplVM* vm, int slot, int first, int count);
+void jmplSetSet(JmplVM* vm, int slot, int first, int count);
+void jmplSetNumberTuple(JmplVM* vm, int slot, const double* numbers, size_t count);
+void jmplSetNumberSet(JmplVM* vm, int slot, const double* numbers, size_t count);
+
+bool jmplGetBool(JmplVM* vm, int slot);
+double jmplGetNumber(JmplVM* vm, int slot);
+uint32_t jmplGetChar(JmplVM* vm, int slot);
+const char* jmplGetString(JmplVM* vm, int slot, size_t* length);
+size_t jmplGetSize(JmplVM* vm, int slot);
+bool jmplIterate(JmplVM* vm, int slot, size_t* index, int elementSlot);
+bool jmplGetNumbers(JmplVM* vm, int slot, double* numbers);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
@@ -1,14 +1,14 @@
 #ifndef c_jmpl_memory_h
 #define c_jmpl_memory_h
 
+#include <stdio.h>
+
+#include "gc.h"
 #include "object.h"
 
 #define ALLOCATE(gc, type, count) \
     (type*)reallocate(gc, NULL, 0, sizeof(type) * (count))
 
-#define FREE(gc, type, pointer) \
-    reallocate(gc, pointer, sizeof(type), 0)
-
 #define GROW_CAPACITY(capacity) \
     ((capacity) < 8 ? 8 : (capacity) * 2)
 
@@ -19,9 +19,27 @@
     reallocate(gc, pointer, sizeof(type) * (oldCount), 0)
 
 void* reallocate(GC* gc, void* pointer, size_t oldSize, size_t newSize);
+void addAllocated(GC* gc, size_t size);
 void markObject(GC* gc, Obj* object);
 void markValue(GC* gc, Value value);
+void rememberObject(GC* gc, Obj* object);
+void sweepPage(GC* gc, Page* page);
 void collectGarbage(GC* gc);
 void freeObjects(GC* gc);
 
+void printGCStats(GC* gc, FILE* file);
+
+static inline bool isMarked(Obj* object) {
+    return testBit(PAGE_MARKED(pageOf(object)), granuleOf(object));
+}
+
+/**
+ * @brief Note that a reference has been stored in an object, which is remembered if it is old or already marked.
+ *
+ * Not needed for objects that C code is building while they are held as temps, which stay remembered.
+ */
+static inline void writeBarrier(GC* gc, Obj* object) {
+    if (isMarked(object) && !object->isRemembered) rememberObject(gc, object);
+}
+
 #endif
\ No newline at end of file
@@ -5,7 +5,7 @@
 
 #define DEF_NATIVE(name) Value name##Native(VM* vm, int argCount, Value* args)
 
-void loadModule(ObjModule* module);
+void loadModule(VM* vm, ObjModule* module);
 
 // ==============================================================
 // ===================== Core              =====================
@@ -30,7 +30,7 @@ DEF_NATIVE(num);
 DEF_NATIVE(str);
 DEF_NATIVE(char);
 
-ObjModule* defineCoreLibrary();
+ObjModule* defineCoreLibrary(VM* vm);
 
 // ==============================================================
 // ===================== Maths              =====================
@@ -59,7 +59,7 @@ DEF_NATIVE(floor);
 DEF_NATIVE(ceil);
 DEF_NATIVE(round);
 
-ObjModule* defineMathLibrary();
+ObjModule* defineMathLibrary(VM* vm);
 
 // ==============================================================
 // ===================== Random             =====================
@@ -70,6 +70,6 @@ DEF_NATIVE(random);
 DEF_NATIVE(randrange);
 DEF_NATIVE(randint);
 
-ObjModule* defineRandomLibrary();
+ObjModule* defineRandomLibrary(VM* vm);
 
 #endif
\ No newline at end of file
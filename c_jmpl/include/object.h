@@ -21,8 +21,8 @@
 #define IS_MODULE(value)   isObjType(value, OBJ_MODULE)
 #define IS_STRING(value)   isObjType(value, OBJ_STRING)
 #define IS_SET(value)      isObjType(value, OBJ_SET)
-#define IS_ITERATOR(value) isObjType(value, OBJ_ITERATOR)
 #define IS_TUPLE(value)    isObjType(value, OBJ_TUPLE)
+#define IS_RANGE(value)    isObjType(value, OBJ_RANGE)
 
 // JMPL Object to C object
 
@@ -33,8 +33,8 @@
 #define AS_MODULE(value)   ((ObjModule*)AS_OBJ(value))
 #define AS_CSTRING(value)  (((ObjString*)AS_OBJ(value))->utf8)
 #define AS_SET(value)      (((ObjSet*)AS_OBJ(value)))
-#define AS_ITERATOR(value) (((ObjIterator*)AS_OBJ(value)))
 #define AS_TUPLE(value)    (((ObjTuple*)AS_OBJ(value)))
+#define AS_RANGE(value)    (((ObjRange*)AS_OBJ(value)))
 
 /**
  * @brief The type of an Object.
@@ -47,15 +47,20 @@ typedef enum {
     OBJ_STRING,
     OBJ_UPVALUE,
     OBJ_SET,
-    OBJ_ITERATOR,
-    OBJ_TUPLE
+    OBJ_SET_NODE,
+    OBJ_TUPLE,
+    OBJ_RANGE
 } ObjType;
 
+/**
+ * @brief The header of every object.
+ *
+ * Whether an object is marked or young is kept in the bitmaps of the page it is in, see page.h.
+ */
 struct Obj {
     ObjType type;
-    bool isMarked;
     bool isIterable;
-    struct Obj* next;
+    bool isRemembered; // If an old object is in the remembered set, as it may reference young objects
 };
 
 // --- Object Types --- 
@@ -66,6 +71,8 @@ typedef struct {
     int upvalueCount;
     Chunk chunk;
     ObjString* name;
+    bool isPure;  // If the function can't change anything but its own locals, so it can run in a worker
+    int maxStack; // Most values its frame holds at once, which a call makes room for
 } ObjFunction;
 
 typedef Value (*NativeFn)(VM* vm, int argCount, Value* args);
@@ -73,6 +80,7 @@ typedef Value (*NativeFn)(VM* vm, int argCount, Value* args);
 typedef struct {
     Obj obj;
     int arity;
+    bool isPure; // If the function has no side effects and makes no strings, so it can run in a worker
     NativeFn function;
 } ObjNative;
 
@@ -102,7 +110,7 @@ Obj* allocateObject(GC* gc, size_t size, ObjType type, bool isIterable);
 
 ObjClosure* newClosure(GC* gc, ObjFunction* function);
 ObjFunction* newFunction(GC* gc);
-ObjNative* newNative(GC* gc, NativeFn function, int arity);
+ObjNative* newNative(GC* gc, NativeFn function, int arity, bool isPure);
 ObjUpvalue* newUpvalue(GC* gc, Value* slot);
 ObjModule* newModule(GC* gc, ObjString* name);
 
@@ -3,6 +3,7 @@
 //
 // A 'b' tag means the opcode takes a byte as a parameter.
 // A 'c' tag means the opcode takes a constant (short) as a parameter.
+// An 's' tag means the opcode takes a jump offset (short) as a parameter.
 // c
 OPCODE(CONSTANT)
 OPCODE(NULL)
@@ -40,6 +41,8 @@ OPCODE(JUMP_IF_FALSE_2)
 OPCODE(LOOP)
 // b
 OPCODE(CALL)
+// b
+OPCODE(TAIL_CALL)
 OPCODE(CLOSURE)
 OPCODE(CLOSE_UPVALUE)
 // b
@@ -63,8 +66,35 @@ OPCODE(CREATE_TUPLE)
 OPCODE(TUPLE_OMISSION)
 // b
 OPCODE(SUBSCRIPT)
-OPCODE(CREATE_ITERATOR)
-OPCODE(ITERATE)
+// b b
+OPCODE(RANGE_INIT)
+// b b s
+OPCODE(FOR_RANGE)
+OPCODE(ITER_INIT)
+// b b s
+OPCODE(FOR_ITER)
 OPCODE(ARB)
 // c
-OPCODE(IMPORT_LIB)
\ No newline at end of file
+OPCODE(IMPORT_LIB)
+// Specialised opcodes, which the VM rewrites generic opcodes into once they see number operands
+OPCODE(ADD_NUM)
+OPCODE(SUBTRACT_NUM)
+OPCODE(MULTIPLY_NUM)
+OPCODE(DIVIDE_NUM)
+OPCODE(EQUAL_NUM)
+OPCODE(NOT_EQUAL_NUM)
+OPCODE(GREATER_NUM)
+OPCODE(GREATER_EQUAL_NUM)
+OPCODE(LESS_NUM)
+OPCODE(LESS_EQUAL_NUM)
+// Rewritten by the compiler from the reads of a local and its union and difference assignments, when the local
+// is never captured, so the set in the local can be changed in place
+// b
+OPCODE(SHARE_LOCAL)
+OPCODE(SET_UNION_IN_PLACE)
+OPCODE(SET_DIFFERENCE_IN_PLACE)
+// Before the first generator's loop of a set-builder, which is split across worker VMs if it is pure. The loop exits
+// to an OP_BUILDER_END, where the workers stop
+// b b
+OPCODE(PARALLEL_BUILDER)
+OPCODE(BUILDER_END)
\ No newline at end of file
@@ -0,0 +1,98 @@
+#ifndef c_jmpl_page_h
+#define c_jmpl_page_h
+
+#include "common.h"
+
+typedef struct Obj Obj;
+typedef struct GC GC;
+
+#define PAGE_SIZE (64 * 1024)                           // Bytes of a page of small objects, which every page is aligned to
+#define GRANULE_SIZE 16                                 // Bytes each bit of a page's bitmaps covers
+#define MAX_SLOT_SIZE 1024                              // Larger objects have a page to themselves
+#define SIZE_CLASS_COUNT (MAX_SLOT_SIZE / GRANULE_SIZE) // Slot sizes are each multiple of a granule up to the largest
+#define PAGE_WORDS (PAGE_SIZE / GRANULE_SIZE / 64)      // Words of each bitmap of a page of small objects
+
+/**
+ * @brief An aligned block of memory holding objects in slots of one size.
+ *
+ * The page an object is in is found by masking its address, and its bit in the bitmaps by the granule it starts in,
+ * so the GC marks and sweeps objects without reading or writing them. An object larger than any slot is put in a
+ * large page of its own, whose bitmaps are one word.
+ */
+typedef struct Page {
+    struct Page* prev;
+    struct Page* next;
+    uint32_t slotSize;  // Bytes of each slot, or of the object in a large page
+    uint32_t slotCount;
+    uint32_t liveCount; // No. slots that are allocated
+    uint32_t words;     // Words of each bitmap
+    bool isYoung;       // If it is in the GC's young pages
+    uint64_t bits[];    // The allocated, marked and young bitmaps, one after another
+} Page;
+
+typedef struct {
+    Page* first;
+    Page* last;
+} PageList;
+
+/**
+ * @brief A free slot, which links to the next one of its size class.
+ */
+typedef struct FreeSlot {
+    struct FreeSlot* next;
+} FreeSlot;
+
+/**
+ * @brief The pages of one slot size, and a pool of their free slots.
+ *
+ * Allocating pops a slot from the free list and freeing pushes it back. Once the list runs out, it is refilled with
+ * the free slots of the next page that has any, or if the page is empty its slots are handed out in order without
+ * being linked. Each GC is only used by one thread, so neither needs a lock.
+ */
+typedef struct {
+    FreeSlot* free;   // Free slots of the pages that are allocated from
+    char* bump;       // Next slot of an empty page, which the slots after are free up to the end of
+    char* bumpEnd;
+    PageList pages;   // Pages that are allocated from
+    PageList unswept; // Pages that haven't been swept since the last major collection
+    Page* current;    // Page the free list was last refilled from, where the ones before it are full
+} SizeClass;
+
+#define PAGE_ALLOCATED(page) ((page)->bits)
+#define PAGE_MARKED(page)    ((page)->bits + (page)->words)
+#define PAGE_YOUNG(page)     ((page)->bits + 2 * (page)->words)
+
+static inline Page* pageOf(Obj* object) {
+    return (Page*)((uintptr_t)object & ~(uintptr_t)(PAGE_SIZE - 1));
+}
+
+static inline uint32_t granuleOf(Obj* object) {
+    return (uint32_t)(((uintptr_t)object & (PAGE_SIZE - 1)) / GRANULE_SIZE);
+}
+
+static inline Obj* objectAt(Page* page, uint32_t granule) {
+    return (Obj*)((char*)page + (size_t)granule * GRANULE_SIZE);
+}
+
+static inline bool testBit(const uint64_t* bitmap, uint32_t bit) {
+    return (bitmap[bit / 64] >> (bit % 64)) & 1;
+}
+
+static inline void setBit(uint64_t* bitmap, uint32_t bit) {
+    bitmap[bit / 64] |= (uint64_t)1 << (bit % 64);
+}
+
+static inline void clearBit(uint64_t* bitmap, uint32_t bit) {
+    bitmap[bit / 64] &= ~((uint64_t)1 << (bit % 64));
+}
+
+void initPages(GC* gc);
+void freePage(Page* page);
+void appendPage(PageList* list, Page* page);
+void unlinkPage(PageList* list, Page* page);
+void movePages(GC* gc, GC* from);
+
+Obj* allocateSlot(GC* gc, size_t size, bool isOld);
+void releaseSlot(GC* gc, Obj* object);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,37 @@
+#ifndef c_jmpl_parallel_h
+#define c_jmpl_parallel_h
+
+#include "common.h"
+
+#define MAX_WORKERS 64                    // Most threads work can be split across, including the main thread
+#define PARALLEL_THRESHOLD_DEFAULT 100000 // Fewest elements worth splitting a set operation across the workers for
+#define BUILDER_THRESHOLD_DEFAULT 1000    // Fewest generated values worth splitting a set-builder across the workers for
+
+/**
+ * @brief A part of some work, which handles the indices from start up to end.
+ *
+ * Tasks run at the same time on other threads, so they mustn't allocate (which may collect garbage)
+ * or write to anything shared with other parts.
+ */
+typedef void (*ParallelTask)(void* context, int part, size_t start, size_t end);
+
+/**
+ * @brief A chunk of some work, which handles the indices from start up to end.
+ *
+ * @return If the chunk succeeded, otherwise no more chunks are started
+ */
+typedef bool (*ChunkTask)(void* context, int part, size_t start, size_t end);
+
+int defaultWorkerCount();
+
+void initWorkers(int count, size_t threshold, size_t builderThreshold);
+void freeWorkers();
+
+bool isParallel(size_t count);
+bool isParallelBuilder(size_t count);
+int workerCount();
+bool inParallelTask();
+int runParallel(ParallelTask task, void* context, size_t count);
+bool runChunks(ChunkTask task, void* context, size_t count, size_t chunkSize);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,33 @@
+#ifndef c_jmpl_range_h
+#define c_jmpl_range_h
+
+#include "object.h"
+#include "set.h"
+
+/**
+ * @brief A lazy omission set, e.g. {f ... l} or {f, n ... l}.
+ *
+ * Elements are never stored; they are computed as first + i * step for 0 <= i < count.
+ * A range is converted to an ObjSet only when a set operation needs one.
+ */
+typedef struct {
+    Obj obj;
+    bool isChar;  // If the elements are characters rather than integers
+    int first;    // Smallest element
+    int step;     // Gap between elements (always positive)
+    size_t count; // No. elements
+} ObjRange;
+
+ObjRange* newRange(GC* gc, int first, int step, size_t count, bool isChar);
+
+Value getRangeValue(ObjRange* range, size_t index);
+bool rangeContains(ObjRange* range, Value value);
+bool rangesEqual(ObjRange* a, ObjRange* b);
+bool rangeEqualsSet(ObjRange* range, ObjSet* set);
+
+ObjSet* rangeToSet(GC* gc, ObjRange* range);
+Value getRangeArb(ObjRange* range, pcg32_random_t* rng);
+
+unsigned char* rangeToString(ObjRange* range);
+
+#endif
\ No newline at end of file
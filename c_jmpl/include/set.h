@@ -3,43 +3,85 @@
 
 #include "object.h"
 #include "hash.h"
+#include "../lib/pcg/pcg_basic.h"
+
+#define SET_TRIE_DEPTH 14   // Enough levels to branch on every bit of a hash
+#define SET_CTRL_EMPTY 0x80 // Control byte of an empty slot, which no tag can equal
 
 typedef struct {
     Value key;
     hash_t hash;
 } SetEntry;
 
+typedef struct ObjSetNode ObjSetNode;
+
 /**
  * @brief The JMPL representation of a Set.
+ *
+ * A set is either a flat hash table, a bitset if bits isn't NULL, or a persistent trie that can
+ * share nodes with other sets if root isn't NULL.
  */
 typedef struct ObjSet {
     Obj obj;
-    SetEntry* entries;
+    SetEntry* entries;  // Elements in insertion order
+    uint8_t* control;   // Hash tag of each slot of the table, or SET_CTRL_EMPTY
+    uint32_t* indices;  // Index into entries of each full slot
     size_t count;
-    size_t capacity;
+    size_t capacity;    // No. slots in the table
+    ObjSetNode* root;   // Root of the trie of a persistent set
+    uint64_t* bits;     // Words of a set of small non-negative integers
+    size_t bitCapacity; // No. words in bits
+    hash_t hash;   // Cached hash of the elements
+    bool isHashed; // If the cached hash is up to date
+    bool isOwned;  // If only one local references the set, so it can be changed in place
 } ObjSet;
 
+/**
+ * @brief A cursor over the elements of a set of any representation.
+ */
+typedef struct {
+    ObjSet* set;
+    size_t index;
+    int depth;
+    ObjSetNode* nodes[SET_TRIE_DEPTH];
+    uint32_t positions[SET_TRIE_DEPTH];
+    SetEntry current; // Entry of the last element of a bitset
+} SetIterator;
+
+/**
+ * @brief Get the element at an index of the entries of a flat set.
+ *
+ * @param index An index less than the set's count
+ */
 static inline Value getSetValue(ObjSet* set, size_t index) {
     return set->entries[index].key;
 }
 
+void initSetIterator(SetIterator* iterator, ObjSet* set);
+SetEntry* nextSetEntry(SetIterator* iterator);
+bool nextSetBit(ObjSet* set, size_t from, size_t* bit);
+
 // --- ObjSet ---
 
 ObjSet* newSet(GC* gc);
+ObjSet* newTableSet(GC* gc, size_t count);
 void freeSet(GC* gc, ObjSet* set);
 
 bool setInsert(GC* gc, ObjSet* set, Value value);
+void setInsertEntries(GC* gc, ObjSet* set, ObjSet* table, size_t start, size_t end);
 bool setContains(ObjSet* set, Value value);
 bool setsEqual(ObjSet* a, ObjSet* b);
 
 ObjSet* setIntersect(GC* gc, ObjSet* a, ObjSet* b);
 ObjSet* setUnion(GC* gc, ObjSet* a, ObjSet* b);
 ObjSet* setDifference(GC* gc, ObjSet* a, ObjSet* b);
+void setUnionInPlace(GC* gc, ObjSet* a, ObjSet* b);
+void setDifferenceInPlace(GC* gc, ObjSet* a, ObjSet* b);
 
 bool isSubset(ObjSet* a, ObjSet* b);
 bool isProperSubset(ObjSet* a, ObjSet* b);
 
-Value getArb(ObjSet* set);
+Value getArb(ObjSet* set, pcg32_random_t* rng);
 
 void printSet(ObjSet* set);
 unsigned char* setToString(ObjSet* set);
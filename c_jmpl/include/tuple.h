@@ -2,14 +2,17 @@
 #define c_jmpl_tuple_h
 
 #include "value.h"
+#include "hash.h"
 
 /**
- * @brief The JMPL representation of a Tuple.
+ * @brief The JMPL representation of a Tuple, whose elements are stored inline after it.
  */
 typedef struct {
     Obj obj;
-    size_t size;
-    Value* elements;
+    hash_t hash;       // Cached hash of the elements
+    uint32_t size;
+    bool isHashed;     // If the cached hash has been computed
+    Value elements[];
 } ObjTuple;
 
 ObjTuple* newTuple(GC* gc, size_t size);
@@ -53,6 +53,31 @@ int8_t unicodeToUtf8(uint32_t codePoint, unsigned char* output);
 int8_t getCharByteCount(unsigned char byte);
 int8_t getCodePointByteCount(uint32_t codePoint);
 
+// Bits
+
+static inline int popCount(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(bits);
+#else
+    int count = 0;
+    for (; bits != 0; bits &= bits - 1) count++;
+    return count;
+#endif
+}
+
+/**
+ * @brief Get the index of the lowest set bit of a non-zero word.
+ */
+static inline int countTrailingZeros(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(bits);
+#else
+    int count = 0;
+    for (; (bits & 1) == 0; bits >>= 1) count++;
+    return count;
+#endif
+}
+
 // Misc.
 
 int validateIndex(int index, size_t length);
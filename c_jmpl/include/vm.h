@@ -1,13 +1,17 @@
 #ifndef c_jmpl_vm_h
 #define c_jmpl_vm_h
 
+#include <setjmp.h>
+
 #include "object.h"
 #include "table.h"
 #include "value.h"
 #include "gc.h"
+#include "../lib/pcg/pcg_basic.h"
 
-#define FRAMES_MAX 64
-#define STACK_MAX (FRAMES_MAX * UINT8_COUNT)
+#define FRAMES_INITIAL 64
+#define STACK_INITIAL (FRAMES_INITIAL * UINT8_COUNT)
+#define FRAMES_LIMIT_DEFAULT 10000
 
 typedef struct {
     ObjClosure* closure;
@@ -15,13 +19,43 @@ typedef struct {
     Value* slots;
 } CallFrame;
 
+/**
+ * @brief A global variable's slot.
+ *
+ * Globals are resolved to a slot index at compile time, so they are accessed without hashing.
+ */
+typedef struct {
+    ObjString* name;
+    Value value;
+    bool isDefined;
+#ifdef DEBUG_GLOBAL_STATS
+    uint64_t reads;
+    uint64_t writes;
+#endif
+} Global;
+
+/**
+ * @brief A value held by C code through the API, which is kept alive until it is released.
+ */
+typedef struct Handle {
+    Value value;
+    struct Handle* prev;
+    struct Handle* next;
+} Handle;
+
 typedef struct VM {
-    CallFrame frames[FRAMES_MAX];
+    CallFrame* frames;
     int frameCount;
+    int frameCapacity;
+    int frameLimit; // Max no. frames before a stack overflow error
 
-    Value stack[STACK_MAX];
+    Value* stack;
     Value* stackTop;
-    Table globals;
+    size_t stackCapacity;
+    Global* globals;
+    int globalCount;
+    int globalCapacity;
+    Table globalSlots; // Table for resolving global names to their slot index
     Table strings; // Table for string interning
     Table modules; // Table for resolving modules
     ObjUpvalue* openUpvalues;
@@ -29,6 +63,20 @@ typedef struct VM {
     GC gc;
 
     Value impReturnStash; // Register for storing implicit return value
+
+    bool isWorker;       // If the VM runs part of a set-builder for another, sharing its globals and code
+    uint8_t* builderEnd; // The OP_BUILDER_END a worker stops at
+    jmp_buf* overBudget; // Where a worker gives up on its chunk once it allocates past its budget
+
+    pcg32_random_t rng; // State of the random module and arb
+
+    ValueArray slots; // Values passed to and from C code through the API
+    Handle* handles;  // Values held by C code through the API
+
+#ifdef DEBUG_QUICKEN_STATS
+    uint64_t quickenHits[UINT8_COUNT];   // Per specialised opcode, how often its operands matched
+    uint64_t quickenMisses[UINT8_COUNT]; // Per specialised opcode, how often it reverted to the generic opcode
+#endif
 } VM;
 
 typedef enum {
@@ -37,11 +85,13 @@ typedef enum {
     INTERPRET_RUNTIME_ERROR
 } InterpretResult;
 
-extern VM vm;
+void initVM(VM* vm);
+void freeVM(VM* vm);
 
-void initVM();
-void freeVM();
+int resolveGlobal(VM* vm, ObjString* name);
+void defineGlobal(VM* vm, ObjString* name, Value value);
 
-InterpretResult interpret(const unsigned char* source);
+InterpretResult callFunction(VM* vm, Value callee, Value* args, int argCount, Value* result);
+InterpretResult interpret(VM* vm, const unsigned char* source);
 
 #endif
\ No newline at end of file
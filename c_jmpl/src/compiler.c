@@ -12,11 +12,14 @@
 #include "gc.h"
 #include "debug.h"
 #include "utils.h"
+#include "vm.h"
 
 typedef struct {
     Token name;
     int depth;
     bool isCaptured;
+    uint8_t slot; // Stack slot in the frame, which is above any temporaries for set-builder and quantifier locals
+    int start;    // Offset of the first instruction in the local's scope
 } Local;
 
 typedef struct {
@@ -24,6 +27,14 @@ typedef struct {
     bool isLocal;
 } Upvalue;
 
+/**
+ * @brief An assignment of the form 'x := x ∪ e' or 'x := x \ e' to a local.
+ */
+typedef struct {
+    int read;      // Offset of the read of the local as the left operand
+    int operation; // Offset of the union or difference
+} InPlaceAssign;
+
 typedef enum {
     TYPE_FUNCTION,
     TYPE_SCRIPT
@@ -40,10 +51,22 @@ typedef struct Compiler {
     int scopeDepth;
 
     bool implicitReturn;
+    int lastCall;      // Offset of the most recently emitted OP_CALL
+    int implicitCall;  // Offset of an OP_CALL whose result was stashed as the implicit return value
+
+    int statementStart;  // Offset of the first instruction of the current statement
+    int statementHeight; // No. values on the stack at the start of the current statement
+    int slotOffset;      // Difference between the slot and the index of new locals
+
+    int assignStart;      // Offset of the value of the assignment being compiled
+    int inPlaceOperation; // Offset of a union or difference whose left operand is the first thing in that value
+    InPlaceAssign inPlaceAssigns[UINT8_COUNT];
+    int inPlaceCount;
 } Compiler;
 
 typedef struct {
     Scanner scanner;
+    VM* vm; // The VM the code is compiled for, whose globals are resolved at compile time
     GC* gc;
 
     Token current;
@@ -92,7 +115,8 @@ typedef struct {
     Precedence precedence;
 } ParseRule;
 
-Compiler* current = NULL;
+// Each thread compiles for one VM at a time
+static THREAD_LOCAL Compiler* current = NULL;
 
 static Chunk* currentChunk(Parser* parser) {
     return &current->function->chunk;
@@ -273,6 +297,7 @@ static uint16_t makeConstant(Parser* parser, Value value) {
     int constant = findConstant(currentChunk(parser), value);
     if (constant == -1) {
         constant = addConstant(parser->gc, currentChunk(parser), value);
+        writeBarrier(parser->gc, (Obj*)current->function);
     }
 
     if (constant > UINT16_MAX) {
@@ -306,6 +331,14 @@ static void initCompiler(Parser* parser, Compiler* compiler, FunctionType type)
     compiler->localCount = 0;
     compiler->scopeDepth = 0;
     compiler->implicitReturn = false;
+    compiler->lastCall = -1;
+    compiler->implicitCall = -1;
+    compiler->statementStart = 0;
+    compiler->statementHeight = 1;
+    compiler->slotOffset = 0;
+    compiler->assignStart = -1;
+    compiler->inPlaceOperation = -1;
+    compiler->inPlaceCount = 0;
     compiler->function = newFunction(parser->gc);
 
     current = compiler;
@@ -317,17 +350,49 @@ static void initCompiler(Parser* parser, Compiler* compiler, FunctionType type)
     Local* local = &current->locals[current->localCount++];
     local->depth = 0;
     local->isCaptured = false;
+    local->slot = 0;
+    local->start = 0;
     local->name.start = "";
     local->name.length = 0;
 }
 
+/**
+ * @brief Turn an emitted call into a tail call, which reuses the current frame.
+ *
+ * The bytes after the call are kept, as jumps over the call (e.g. from 'and') still land on them.
+ */
+static void patchTailCall(Parser* parser, int callOffset) {
+    currentChunk(parser)->code[callOffset] = OP_TAIL_CALL;
+}
+
+static void endLocal(Parser* parser, Local* local);
+static bool isPureCode(Parser* parser, int start, int end, int firstSlot);
+static int maxStackHeight(Parser* parser);
+
 static ObjFunction* endCompiler(Parser* parser) {
+    for (int i = current->localCount - 1; i > 0; i--) {
+        endLocal(parser, &current->locals[i]);
+    }
+
+    // A call stashed by the final statement is the function's result, even once the body's locals are popped after it
+    if (current->implicitCall != -1) {
+        Chunk* chunk = currentChunk(parser);
+        int offset = current->implicitCall + 3;
+        while (offset < chunk->count && (chunk->code[offset] == OP_POP || chunk->code[offset] == OP_CLOSE_UPVALUE)) {
+            offset++;
+        }
+
+        if (offset == chunk->count) patchTailCall(parser, current->implicitCall);
+    }
+
     emitReturn(parser);
     ObjFunction* function = current->function;
+    function->isPure = !parser->hadError && isPureCode(parser, 0, currentChunk(parser)->count, 0);
+    function->maxStack = parser->hadError ? 0 : maxStackHeight(parser);
 
 #ifdef DEBUG_PRINT_CODE
     if (!parser->hadError) {
-        disassembleChunk(currentChunk(parser), function->name != NULL ? (const char*)function->name->utf8 : "<script>");
+        disassembleChunk(parser->vm, currentChunk(parser), function->name != NULL ? (const char*)function->name->utf8 : "<script>");
     }
 #endif
 
@@ -343,6 +408,8 @@ static void endScope(Parser* parser) {
     current->scopeDepth--;
 
     while (current->localCount > 0 && current->locals[current->localCount - 1].depth > current->scopeDepth) {
+        endLocal(parser, &current->locals[current->localCount - 1]);
+
         if (current->locals[current->localCount - 1].isCaptured) {
             emitByte(parser, OP_CLOSE_UPVALUE);
         } else {
@@ -352,7 +419,318 @@ static void endScope(Parser* parser) {
     }
 }
 
-// Function declarations 
+/**
+ * @brief Pop locals off the stack down to a given local, closing any that were captured.
+ */
+static void discardLocals(Parser* parser, int firstLocal) {
+    while (current->localCount > firstLocal) {
+        endLocal(parser, &current->locals[current->localCount - 1]);
+        emitByte(parser, current->locals[current->localCount - 1].isCaptured ? OP_CLOSE_UPVALUE : OP_POP);
+        current->localCount--;
+    }
+}
+
+/**
+ * @brief Mark the start of a statement, where only locals are on the stack.
+ */
+static void beginStatement(Parser* parser) {
+    current->statementStart = currentChunk(parser)->count;
+    current->statementHeight = current->localCount;
+}
+
+/**
+ * @brief Get the change in stack height when an instruction falls through to the next.
+ *
+ * @param offset The offset of the instruction, which is moved to the next instruction
+ */
+static int stackEffect(Parser* parser, int* offset) {
+    Chunk* chunk = currentChunk(parser);
+    OpCode instruction = chunk->code[*offset];
+    uint8_t operand = *offset + 1 < chunk->count ? chunk->code[*offset + 1] : 0;
+
+    switch (instruction) {
+        case OP_NULL:
+        case OP_TRUE:
+        case OP_FALSE:
+        case OP_SET_CREATE:
+        case OP_ITER_INIT:
+            *offset += 1;
+            return 1;
+        case OP_NOT:
+        case OP_NEGATE:
+        case OP_SIZE:
+        case OP_ARB:
+        case OP_BUILDER_END:
+            *offset += 1;
+            return 0;
+        case OP_POP:
+        case OP_CLOSE_UPVALUE:
+        case OP_STASH:
+        case OP_EQUAL: case OP_NOT_EQUAL: case OP_GREATER: case OP_GREATER_EQUAL: case OP_LESS: case OP_LESS_EQUAL:
+        case OP_ADD: case OP_SUBTRACT: case OP_MULTIPLY: case OP_MOD: case OP_DIVIDE: case OP_EXPONENT:
+        case OP_SET_IN: case OP_SET_INTERSECT: case OP_SET_UNION: case OP_SET_DIFFERENCE: case OP_SUBSET: case OP_SUBSETEQ:
+        case OP_SET_UNION_IN_PLACE: case OP_SET_DIFFERENCE_IN_PLACE:
+        case OP_ADD_NUM: case OP_SUBTRACT_NUM: case OP_MULTIPLY_NUM: case OP_DIVIDE_NUM:
+        case OP_EQUAL_NUM: case OP_NOT_EQUAL_NUM: case OP_GREATER_NUM: case OP_GREATER_EQUAL_NUM: case OP_LESS_NUM: case OP_LESS_EQUAL_NUM:
+            *offset += 1;
+            return -1;
+        case OP_GET_LOCAL:
+        case OP_SHARE_LOCAL:
+        case OP_GET_UPVALUE:
+            *offset += 2;
+            return 1;
+        case OP_SET_LOCAL:
+        case OP_SET_UPVALUE:
+        case OP_RETURN:
+            *offset += 2;
+            return 0;
+        case OP_CALL:
+        case OP_TAIL_CALL:
+        case OP_SET_INSERT:
+            *offset += 2;
+            return -operand;
+        case OP_CREATE_TUPLE:
+            *offset += 2;
+            return 1 - operand;
+        case OP_SET_OMISSION:
+        case OP_TUPLE_OMISSION:
+            *offset += 2;
+            return -1 - operand;
+        case OP_SUBSCRIPT:
+            *offset += 2;
+            return operand ? -2 : -1;
+        case OP_CONSTANT:
+        case OP_GET_GLOBAL:
+            *offset += 3;
+            return 1;
+        case OP_DEFINE_GLOBAL:
+            *offset += 3;
+            return -1;
+        case OP_SET_GLOBAL:
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_FALSE_2: // Only pops when it jumps
+        case OP_LOOP:
+        case OP_IMPORT_LIB:
+            *offset += 3;
+            return 0;
+        case OP_RANGE_INIT:
+            *offset += 3;
+            return 1 - operand;
+        case OP_PARALLEL_BUILDER:
+            *offset += 3;
+            return 0;
+        case OP_FOR_RANGE:
+        case OP_FOR_ITER:
+            *offset += 5;
+            return 0;
+        case OP_CLOSURE: {
+            uint16_t constant = (uint16_t)((operand << 8) | chunk->code[*offset + 2]);
+            ObjFunction* function = AS_FUNCTION(chunk->constants.values[constant]);
+            *offset += 3 + 2 * function->upvalueCount;
+            return 1;
+        }
+    }
+
+    error(parser, "(Internal) Unknown instruction");
+    *offset = chunk->count;
+    return 0;
+}
+
+/**
+ * @brief Get the no. values on the stack at the current point in the code.
+ *
+ * This is more than the no. locals when an expression has pushed temporaries, e.g. the callee and
+ * arguments before a set-builder argument. It is found by replaying the current statement's code.
+ */
+static int stackHeight(Parser* parser) {
+    int height = current->statementHeight;
+    int offset = current->statementStart;
+
+    while (offset < currentChunk(parser)->count) {
+        height += stackEffect(parser, &offset);
+    }
+
+    return height;
+}
+
+/**
+ * @brief Get the most values the current function can have on the stack at once, counting its callee and arguments.
+ *
+ * Code after a jump starts at the height it was jumped to with, so e.g. the branches of an if aren't added together.
+ */
+static int maxStackHeight(Parser* parser) {
+    Chunk* chunk = currentChunk(parser);
+    int* jumpHeights = malloc(sizeof(int) * (chunk->count + 1));
+    if (jumpHeights == NULL) exit(INTERNAL_SOFTWARE_ERROR);
+    for (int i = 0; i <= chunk->count; i++) {
+        jumpHeights[i] = -1;
+    }
+
+    int height = current->function->arity + 1;
+    int maxHeight = height;
+    bool isReachable = true;
+
+    for (int offset = 0; offset < chunk->count; ) {
+        if (jumpHeights[offset] != -1) {
+            height = isReachable && height > jumpHeights[offset] ? height : jumpHeights[offset];
+            isReachable = true;
+        }
+
+        int instruction = offset;
+        height += stackEffect(parser, &offset);
+        if (height > maxHeight) maxHeight = height;
+
+        switch (chunk->code[instruction]) {
+            case OP_JUMP:
+            case OP_JUMP_IF_FALSE:
+            case OP_JUMP_IF_FALSE_2:
+            case OP_FOR_RANGE:
+            case OP_FOR_ITER: {
+                // The jump's offset is the instruction's last operand
+                int target = offset + (uint16_t)((chunk->code[offset - 2] << 8) | chunk->code[offset - 1]);
+                int jumpHeight = chunk->code[instruction] == OP_JUMP_IF_FALSE_2 ? height - 1 : height;
+                if (target <= chunk->count && jumpHeight > jumpHeights[target]) jumpHeights[target] = jumpHeight;
+
+                if (chunk->code[instruction] == OP_JUMP) isReachable = false;
+                break;
+            }
+            case OP_LOOP:
+            case OP_RETURN:
+                isReachable = false;
+                break;
+            default:
+                break;
+        }
+    }
+
+    free(jumpHeights);
+    return maxHeight;
+}
+
+/**
+ * @brief Checks if code only writes to the locals it owns, so that it can run at the same time as other code.
+ *
+ * Calls are checked when they are made, as the callee isn't known until then.
+ *
+ * @param firstSlot The first slot of the locals the code owns
+ */
+static bool isPureCode(Parser* parser, int start, int end, int firstSlot) {
+    Chunk* chunk = currentChunk(parser);
+
+    for (int offset = start; offset < end; ) {
+        int instruction = offset;
+        stackEffect(parser, &offset);
+
+        switch (chunk->code[instruction]) {
+            case OP_SET_LOCAL:
+                if (chunk->code[instruction + 1] < firstSlot) return false;
+                break;
+            case OP_DEFINE_GLOBAL:
+            case OP_SET_GLOBAL:
+            case OP_SET_UPVALUE:
+            case OP_CLOSURE:    // Captures locals, which could then be changed
+            case OP_ARB:        // Changes the state of the random number generator
+            case OP_IMPORT_LIB:
+                return false;
+            default:
+                break;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Note an assignment to a local whose value is 'x ∪ e' or 'x \ e', where x is the local.
+ *
+ * @param start Offset of the assigned value
+ */
+static void noteInPlaceAssign(Parser* parser, int start, uint8_t slot) {
+    Chunk* chunk = currentChunk(parser);
+
+    if (current->inPlaceOperation != chunk->count - 1 || current->inPlaceCount == UINT8_COUNT) return;
+    if (chunk->code[start] != OP_GET_LOCAL || chunk->code[start + 1] != slot) return;
+
+    current->inPlaceAssigns[current->inPlaceCount++] = (InPlaceAssign){.read = start, .operation = chunk->count - 1};
+}
+
+/**
+ * @brief Let the union and difference assignments to a local that is going out of scope change its set in place.
+ *
+ * Only assignments whose result is discarded or stashed after being stored count, and the local must never have been
+ * captured. Every other read of the local gives up ownership of its set, as the value may be kept elsewhere.
+ */
+static void endLocal(Parser* parser, Local* local) {
+    Chunk* chunk = currentChunk(parser);
+    InPlaceAssign assigns[UINT8_COUNT];
+    int assignCount = 0;
+
+    // Take the local's assignments out of the list
+    int count = 0;
+    for (int i = 0; i < current->inPlaceCount; i++) {
+        InPlaceAssign assign = current->inPlaceAssigns[i];
+        if (chunk->code[assign.read + 1] != local->slot) {
+            current->inPlaceAssigns[count++] = assign;
+            continue;
+        }
+
+        // The stash is only read once the function returns, which gives up ownership of a set it returns
+        int after = assign.operation + 1;
+        if (assign.read >= local->start && after + 2 < chunk->count && chunk->code[after] == OP_SET_LOCAL &&
+            chunk->code[after + 1] == local->slot &&
+            (chunk->code[after + 2] == OP_POP || chunk->code[after + 2] == OP_STASH)) {
+            assigns[assignCount++] = assign;
+        }
+    }
+    current->inPlaceCount = count;
+
+    if (assignCount == 0 || local->isCaptured || parser->hadError) return;
+
+    for (int offset = local->start; offset < chunk->count; ) {
+        int instruction = offset;
+        stackEffect(parser, &offset);
+
+        if (chunk->code[instruction] != OP_GET_LOCAL || chunk->code[instruction + 1] != local->slot) continue;
+
+        bool isAssignRead = false;
+        for (int i = 0; i < assignCount; i++) {
+            if (assigns[i].read == instruction) isAssignRead = true;
+        }
+        if (!isAssignRead) chunk->code[instruction] = OP_SHARE_LOCAL;
+    }
+
+    for (int i = 0; i < assignCount; i++) {
+        uint8_t* operation = &chunk->code[assigns[i].operation];
+        *operation = *operation == OP_SET_UNION ? OP_SET_UNION_IN_PLACE : OP_SET_DIFFERENCE_IN_PLACE;
+    }
+}
+
+/**
+ * @brief Open the scope of an expression compiled into the current function (a set-builder or quantifier).
+ *
+ * @return The slot offset to restore when the scope ends
+ */
+static int beginInlineScope(Parser* parser) {
+    int previousOffset = current->slotOffset;
+    current->slotOffset = stackHeight(parser) - current->localCount;
+
+    beginScope(parser);
+    return previousOffset;
+}
+
+/**
+ * @brief Close the scope of an inline expression, whose first local is left on the stack as its value.
+ *
+ * The other locals must already have been discarded.
+ */
+static void endInlineScope(Parser* parser, int firstLocal, int previousOffset) {
+    current->scopeDepth--;
+    current->localCount = firstLocal;
+    current->slotOffset = previousOffset;
+}
+
+// Function declarations
 static void expression(Parser* parser, bool ignoreNewlines);
 static void statement(Parser* parser, bool blockAllowed, bool ignoreSeparator);
 static void expressionStatement(Parser* parser);
@@ -360,8 +738,17 @@ static void declaration(Parser* parser);
 static ParseRule* getRule(TokenKind type);
 static void parsePrecedence(Parser* parser, Precedence precendence, bool ignoreNewlines);
 
-static uint16_t identifierConstant(Parser* parser, Token* name) {
-    return makeConstant(parser, OBJ_VAL(copyString(parser->gc, name->start, name->length)));
+/**
+ * @brief Resolve the name of a global variable to its slot index.
+ */
+static uint16_t globalSlot(Parser* parser, Token* name) {
+    int slot = resolveGlobal(parser->vm, copyString(parser->gc, name->start, name->length));
+    if (slot > UINT16_MAX) {
+        error(parser, "(Internal) Too many global variables");
+        return 0;
+    }
+
+    return (uint16_t)slot;
 }
 
 static bool identifiersEqual(Token* a, Token* b) {
@@ -412,7 +799,7 @@ static int resolveUpvalue(Parser* parser, Compiler* compiler, Token* name) {
     int local = resolveLocal(parser, compiler->enclosing, name);
     if (local != -1) {
         compiler->enclosing->locals[local].isCaptured = true;
-        return addUpvalue(parser, compiler, (uint8_t)local, true);
+        return addUpvalue(parser, compiler, compiler->enclosing->locals[local].slot, true);
     }
 
     int upvalue = resolveUpvalue(parser, compiler->enclosing, name);
@@ -423,16 +810,23 @@ static int resolveUpvalue(Parser* parser, Compiler* compiler, Token* name) {
     return -1;
 }
 
+static int nextLocalSlot(Parser* parser) {
+    return current->localCount + current->slotOffset;
+}
+
 static void addLocal(Parser* parser, Token name) {
-    if (current->localCount == UINT8_COUNT) {
+    if (current->localCount == UINT8_COUNT || nextLocalSlot(parser) >= UINT8_COUNT) {
         error(parser, "(Internal) Too many local variables in current scope");
         return;
     }
 
-    Local* local = &current->locals[current->localCount++];
+    Local* local = &current->locals[current->localCount];
     local->name = name;
     local->depth = -1;
     local->isCaptured = false;
+    local->slot = (uint8_t)nextLocalSlot(parser);
+    local->start = currentChunk(parser)->count;
+    current->localCount++;
 }
 
 /**
@@ -474,7 +868,7 @@ static uint16_t parseVariable(Parser* parser, const unsigned char* errorMessage)
     declareVariable(parser);
     if (current->scopeDepth > 0) return 0;
 
-    return identifierConstant(parser, &parser->previous);
+    return globalSlot(parser, &parser->previous);
 }
 
 static void markInitialised(Parser* parser) {
@@ -498,6 +892,17 @@ static Token syntheticToken(const char* name) {
   return token;
 }
 
+/**
+ * @brief Declare a synthetic local variable for internal use, already initialised on the stack.
+ */
+static uint8_t addSyntheticLocal(Parser* parser, const char* name) {
+    uint8_t varSlot = (uint8_t)nextLocalSlot(parser);
+    addLocal(parser, syntheticToken(name));
+    markInitialised(parser);
+
+    return varSlot;
+}
+
 /**
  * @brief Create a synthetic local variables from top of stack for internal use.
  * 
@@ -507,24 +912,126 @@ static Token syntheticToken(const char* name) {
 static uint8_t syntheticLocal(Parser* parser, OpCode code, const char* name) {
     emitByte(parser, code);
     
-    uint8_t varSlot = current->localCount;
-    addLocal(parser, syntheticToken(name));
-    markInitialised(parser);
+    uint8_t varSlot = addSyntheticLocal(parser, name);
     emitBytes(parser, OP_SET_LOCAL, varSlot);
 
     return varSlot;
 }
 
+/**
+ * @brief Checks if the current set literal is an omission set ({f ... l} or {f, n ... l}).
+ *
+ * Assumes a left brace has been opened.
+ */
+static bool isOmission(Parser* parser) {
+    Parser initialParser = *parser;
+    // Only an ellipsis directly inside the braces counts, not one in a nested tuple, set, or slice
+    int depth = 0;
+    bool isOmission = false;
+
+    while (!check(parser, TOKEN_EOF)) {
+        TokenKind type = parser->current.type;
+
+        if (type == TOKEN_LEFT_BRACE || type == TOKEN_LEFT_PAREN || type == TOKEN_LEFT_SQUARE) depth++;
+        if (type == TOKEN_RIGHT_BRACE || type == TOKEN_RIGHT_PAREN || type == TOKEN_RIGHT_SQUARE) depth--;
+        if (depth < 0) break;
+
+        if (depth == 0 && type == TOKEN_ELLIPSIS) {
+            isOmission = true;
+            break;
+        }
+
+        advance(parser);
+    }
+
+    *parser = initialParser;
+    return isOmission;
+}
+
+/**
+ * @brief Parses the terms of an omission set.
+ * 
+ * Can parse sets in format: {f ... l},
+ * or:                       {f, n ... l}
+ * 
+ * @param instruction The opcode that consumes the terms, taking whether there is a 'next' as its operand
+ */
+static void omissionTerms(Parser* parser, OpCode instruction) {
+    expression(parser, true);
+
+    if (match(parser, TOKEN_ELLIPSIS)) {
+        // Omission operation without 'next'
+        expression(parser, true);
+        emitBytes(parser, instruction, 0);
+    } else {
+        // Omission operation with 'next'
+        consume(parser, TOKEN_COMMA, "Expected ',' or '...' in omission set");
+        expression(parser, true);
+        consume(parser, TOKEN_ELLIPSIS, "Expected '...' in omission set");
+        expression(parser, true);
+        emitBytes(parser, instruction, 1);
+    }
+}
+
+/**
+ * @brief Checks if a generator's target is just an omission set, e.g. 'x ∈ {1 ... n} do'.
+ * 
+ * Such generators are compiled into a counting loop rather than creating a set and iterating it.
+ */
+static bool isRangeGenerator(Parser* parser) {
+    if (!check(parser, TOKEN_LEFT_BRACE)) return false;
+
+    Parser initialParser = *parser;
+    advance(parser);
+
+    bool isRange = false;
+    if (isOmission(parser)) {
+        // Skip to the closing brace
+        int depth = 0;
+        while (!check(parser, TOKEN_EOF)) {
+            TokenKind type = parser->current.type;
+
+            if (type == TOKEN_LEFT_BRACE || type == TOKEN_LEFT_PAREN || type == TOKEN_LEFT_SQUARE) depth++;
+            if (type == TOKEN_RIGHT_BRACE || type == TOKEN_RIGHT_PAREN || type == TOKEN_RIGHT_SQUARE) depth--;
+            if (depth < 0) break;
+
+            advance(parser);
+        }
+
+        // The omission must be the whole target, not an operand like in '{1 ... n} ∪ S'
+        isRange = match(parser, TOKEN_RIGHT_BRACE) && 
+            (check(parser, TOKEN_DO) || check(parser, TOKEN_PIPE) || 
+             check(parser, TOKEN_COMMA) || check(parser, TOKEN_RIGHT_BRACE));
+    }
+
+    *parser = initialParser;
+    return isRange;
+}
+
+/**
+ * @brief The compiled state of a generator in the form 'x in Obj'.
+ */
+typedef struct {
+    int firstLocal;    // Index of the generator's variable in the compiler's locals
+    uint8_t varSlot;   // Slot of the generator's variable
+    uint8_t stateSlot; // Slot of the target and index, or of the first of a counting loop's three locals
+    bool isRange;      // If the generator counts through an omission instead of iterating an object
+    int loopStart;
+    int exitJump;
+} Generator;
+
 /**
  * @brief Parse a generator in the form 'x in Obj'.
  * 
- * @return The slot of the generator
+ * @return If the generator was parsed (false if its variable is already defined in this scope)
  * 
- * Pushes: a local variable, a null value initialiser, and the target object
+ * Pushes: a local variable with a null value initialiser, then either the target object and the index
+ * of its next value or, if the target is an omission set, a counting loop's current value, step, and count
  */
-static uint8_t parseGenerator(Parser* parser) {
+static bool parseGenerator(Parser* parser, Generator* generator) {
     // Parse the local variable that will be the generator
-    uint8_t localVarSlot = current->localCount;
+    int firstLocal = current->localCount;
+    uint8_t localVarSlot = (uint8_t)nextLocalSlot(parser);
     consume(parser, TOKEN_IDENTIFIER, "Expected identifier");
     
     // === Check if name is already defined ===
@@ -533,12 +1040,13 @@ static uint8_t parseGenerator(Parser* parser) {
     for (int i = current->localCount - 1; i >= 0; i--) {
         Local* local = &current->locals[i];
 
-        if (local->depth != -1 && local->depth < current->scopeDepth) {
+        // A local still being initialised belongs to an enclosing declaration
+        if (local->depth == -1 || local->depth < current->scopeDepth) {
             break;
         }
 
         if (identifiersEqual(name, &local->name)) {
-            return 0;
+            return false;
         }
     }
     // ========================================
@@ -550,10 +1058,51 @@ static uint8_t parseGenerator(Parser* parser) {
 
     consume(parser, TOKEN_IN, "Expected 'in' or '∈' after identifier");
 
-    // Push the object to generate from (to create an iterator)
-    expression(parser, false);
+    generator->firstLocal = firstLocal;
+    generator->varSlot = localVarSlot;
+    generator->isRange = isRangeGenerator(parser);
+
+    if (generator->isRange) {
+        consume(parser, TOKEN_LEFT_BRACE, "Expected '{' before omission");
+        omissionTerms(parser, OP_RANGE_INIT);
+        emitByte(parser, nextLocalSlot(parser));
+        consume(parser, TOKEN_RIGHT_BRACE, "Expected '}' after omission");
+
+        generator->stateSlot = addSyntheticLocal(parser, "@cur");
+        addSyntheticLocal(parser, "@step");
+        addSyntheticLocal(parser, "@count");
+    } else {
+        // Push the object to generate from and the index of its next value
+        expression(parser, false);
+        emitByte(parser, OP_ITER_INIT);
 
-    return localVarSlot;
+        generator->stateSlot = addSyntheticLocal(parser, "@target");
+        addSyntheticLocal(parser, "@index");
+    }
+
+    return true;
+}
+
+/**
+ * @brief Emit the head of a generator's loop, which sets its variable to the next value or exits.
+ */
+static void beginGeneratorLoop(Parser* parser, Generator* generator) {
+    generator->loopStart = currentChunk(parser)->count;
+
+    emitBytes(parser, generator->isRange ? OP_FOR_RANGE : OP_FOR_ITER, generator->stateSlot);
+    emitByte(parser, generator->varSlot);
+
+    // Exit offset, patched when the loop ends
+    emitBytes(parser, 0xFF, 0xFF);
+    generator->exitJump = currentChunk(parser)->count - 2;
+}
+
+/**
+ * @brief Emit the end of a generator's loop.
+ */
+static void endGeneratorLoop(Parser* parser, Generator* generator) {
+    emitLoop(parser, generator->loopStart);
+    patchJump(parser, generator->exitJump);
 }
 
 /**
@@ -603,6 +1152,11 @@ static void binary(Parser* parser, bool canAssign) {
 
     TokenKind operatorType = parser->previous.type;
     ParseRule* rule = getRule(operatorType);
+
+    // The left operand is only the first thing in an assigned value, e.g. 'x := x ∪ e'
+    bool isInPlace = (operatorType == TOKEN_UNION || operatorType == TOKEN_BACK_SLASH) &&
+                     currentChunk(parser)->count == current->assignStart + 2;
+
     parsePrecedence(parser, (Precedence)(rule->precedence + 1), false);
 
     switch (operatorType) {
@@ -626,6 +1180,8 @@ static void binary(Parser* parser, bool canAssign) {
         case TOKEN_SUBSETEQ:      emitByte(parser, OP_SUBSETEQ);       break;
         default: return;
     }
+
+    if (isInPlace) current->inPlaceOperation = currentChunk(parser)->count - 1;
 }
 
 static void call(Parser* parser, bool canAssign) {
@@ -633,6 +1189,7 @@ static void call(Parser* parser, bool canAssign) {
 
     uint8_t argCount = argumentList(parser);
     emitBytes(parser, OP_CALL, argCount);
+    current->lastCall = currentChunk(parser)->count - 2;
 }
 
 static void subscript(Parser* parser, bool canAssign) {
@@ -744,81 +1301,83 @@ static void grouping(Parser* parser, bool canAssign) {
 // =================        Set builder notation        =================
 // ======================================================================
 
-static void growArray(uint8_t** array, size_t currentSize, uint8_t newVal) {
-    uint8_t* newArray = realloc(*array, (currentSize + 1) * sizeof(uint8_t));
-    if (newArray == NULL) {
-        exit(INTERNAL_SOFTWARE_ERROR);
-    }
-
-    newArray[currentSize] = newVal;
-    *array = newArray;
-}
-
-static bool parseSetBuilderGenerator(Parser* parser, int oldCount, uint8_t** generatorSlots, uint8_t** iteratorSlots, uint8_t** loopStarts, uint8_t** exitJumps) {
+/**
+ * @brief Parse a generator of a set-builder if there is one next.
+ *
+ * @param parallelFlag Set to the offset of the purity operand of the OP_PARALLEL_BUILDER before the first generator's loop
+ */
+static bool parseSetBuilderGenerator(Parser* parser, Generator* generators, int* generatorCount, uint8_t setSlot,
+                                     int* parallelFlag) {
     Parser temp = *parser;
     // Check if its a generator 'x ∈'
     bool isGenerator = match(parser, TOKEN_IDENTIFIER) && match(parser, TOKEN_IN);
     *parser = temp;
 
-    if (isGenerator) {
-        uint8_t generatorSlot = parseGenerator(parser);
-        if (generatorSlot == 0) {
-            *parser = temp;
-            return false; // Return false if already defined
-        }
-
-        uint8_t iteratorSlot = syntheticLocal(parser, OP_CREATE_ITERATOR, "@iter");
+    if (!isGenerator) return false;
 
-        growArray(generatorSlots, oldCount, generatorSlot);
-        growArray(iteratorSlots, oldCount, iteratorSlot);
+    if (*generatorCount == UINT8_COUNT) {
+        error(parser, "(Internal) Too many generators in set-builder");
+        return false;
+    }
 
-        // Generate loop
-        int loopStart = currentChunk(parser)->count;
-        emitBytes(parser, OP_GET_LOCAL, iteratorSlot);
-        emitByte(parser, OP_ITERATE);
+    Generator* generator = &generators[*generatorCount];
+    if (!parseGenerator(parser, generator)) {
+        *parser = temp;
+        return false; // Return false if already defined
+    }
 
-        int exitJump = emitJump(parser, OP_JUMP_IF_FALSE);
-        emitByte(parser, OP_POP); // Pop check
+    if (*generatorCount == 0) {
+        // Patched once the set-builder is found to be pure
+        emitBytes(parser, OP_PARALLEL_BUILDER, setSlot);
+        emitByte(parser, false);
+        *parallelFlag = currentChunk(parser)->count - 1;
+    }
 
-        emitBytes(parser, OP_SET_LOCAL, generatorSlot);
-        emitByte(parser, OP_POP);
+    beginGeneratorLoop(parser, generator);
+    (*generatorCount)++;
 
-        growArray(loopStarts, oldCount, loopStart);
-        growArray(exitJumps, oldCount, exitJump);
+    return true;
+}
 
-        return true;
-    }
+/**
+ * @brief Let the first generator's loop of a set-builder be split across worker VMs if the loop is pure.
+ *
+ * Only the set-builder's own locals may be assigned, which come after its set. The loop exits to an OP_BUILDER_END,
+ * where the workers stop.
+ */
+static void endParallelBuilder(Parser* parser, int parallelFlag, uint8_t setSlot) {
+    Chunk* chunk = currentChunk(parser);
+    if (parser->hadError || !isPureCode(parser, parallelFlag + 1, chunk->count, setSlot + 1)) return;
 
-    return false;
+    chunk->code[parallelFlag] = true;
+    emitByte(parser, OP_BUILDER_END);
 }
 
 /**
  * @brief Parse a set builder.
+ *
+ * It is compiled into the enclosing function as nested loops, with the set being built as a local
+ * that is left on the stack as the expression's value.
  */
 static void setBuilder(Parser* parser) {
-    // Set anonymous function name and to implicit return
-    current->function->name = copyString(parser->gc, "@setb", 5);
-    current->implicitReturn = true;
+    int firstLocal = current->localCount;
+    int previousOffset = beginInlineScope(parser);
 
     // Store an opened set as a local
     uint8_t setSlot = syntheticLocal(parser, OP_SET_CREATE, "@set");
 
-    uint8_t* generatorSlots = NULL;
-    uint8_t* iteratorSlots = NULL;
-    uint8_t* loopStarts = NULL;
-    uint8_t* exitJumps = NULL;
+    Generator generators[UINT8_COUNT];
     int generatorCount = 0;
+    int parallelFlag = -1;
 
-    uint8_t* skipJumps = NULL;
+    int skipJumps[UINT8_COUNT];
+    int skipLoops[UINT8_COUNT]; // Index of the generator whose loop each predicate continues, or -1
     int skipCount = 0;
 
     // Check if expression is a generator, otherwise skip to pipe
     Parser initialParser = *parser;
-    bool hasLHSGenerator = false;
-    if (parseSetBuilderGenerator(parser, generatorCount, &generatorSlots, &iteratorSlots, &loopStarts, &exitJumps)) {
-        generatorCount++;
-        hasLHSGenerator = true;
-    } else {
+    bool hasLHSGenerator = parseSetBuilderGenerator(parser, generators, &generatorCount, setSlot, &parallelFlag);
+    if (!hasLHSGenerator) {
         while (!check(parser, TOKEN_PIPE)) advance(parser);
     }
     consume(parser, TOKEN_PIPE, "Expected '|' after expression or generator");
@@ -830,18 +1389,19 @@ static void setBuilder(Parser* parser) {
         hasRHS = true;
 
         // Check if it is a generator
-        if (parseSetBuilderGenerator(parser, generatorCount, &generatorSlots, & iteratorSlots, &loopStarts, &exitJumps)) {
-            generatorCount++;
-            continue;
-        }
+        if (parseSetBuilderGenerator(parser, generators, &generatorCount, setSlot, &parallelFlag)) continue;
 
         // Not a generator, so a predicate
         expression(parser, false);
         int skipJump = emitJump(parser, OP_JUMP_IF_FALSE_2);
         emitByte(parser, OP_POP);
 
-        growArray(&skipJumps, skipCount, skipJump);
-        skipCount++;
+        if (skipCount == UINT8_COUNT) {
+            error(parser, "(Internal) Too many predicates in set-builder");
+            break;
+        }
+        skipJumps[skipCount] = skipJump;
+        skipLoops[skipCount++] = generatorCount - 1;
     } while (match(parser, TOKEN_COMMA));
 
     if (!hasRHS) errorAtCurrent(parser, "Set-builder must have at one qualifier");
@@ -852,34 +1412,32 @@ static void setBuilder(Parser* parser) {
     // Load set and insert expression
     emitBytes(parser, OP_GET_LOCAL, setSlot);
     if (hasLHSGenerator) {
-        emitBytes(parser, OP_GET_LOCAL, generatorSlots[0]);
+        emitBytes(parser, OP_GET_LOCAL, generators[0].varSlot);
     } else {
         expression(parser, false);
     }
     emitBytes(parser, OP_SET_INSERT, 1); // This seems to update without OP_SET_LOCAL - pointer fault?
     emitByte(parser, OP_POP);
 
-    // Patch jumps and emit loops
-    for (int i = skipCount - 1; i >= 0; i--) {
-        patchJump(parser, skipJumps[i]);
-    }
+    // Emit loops, popping each generator's locals once it is exhausted so the stack is the same when it restarts
+    for (int i = generatorCount - 1; i >= -1; i--) {
+        // A false predicate continues the innermost loop before it
+        for (int j = 0; j < skipCount; j++) {
+            if (skipLoops[j] == i) patchJump(parser, skipJumps[j]);
+        }
 
-    for (int i = generatorCount - 1; i >= 0; i--) {
-        emitLoop(parser, loopStarts[i]);
-        patchJump(parser, exitJumps[i]);
-        emitByte(parser, OP_POP);
+        if (i == -1) break;
+
+        endGeneratorLoop(parser, &generators[i]);
+        if (i == 0) endParallelBuilder(parser, parallelFlag, setSlot);
+        discardLocals(parser, generators[i].firstLocal);
     }
     
     *parser = endParser;
     consume(parser, TOKEN_RIGHT_BRACE, "Expected '}' after set-builder");
-    emitBytes(parser, OP_GET_LOCAL, setSlot); // Push the completed set
-    emitByte(parser, OP_STASH);
 
-    free(generatorSlots);
-    free(iteratorSlots);
-    free(loopStarts);
-    free(exitJumps);
-    free(skipJumps);
+    // Leave the completed set on the stack
+    endInlineScope(parser, firstLocal, previousOffset);
 }
 
 /**
@@ -905,9 +1463,7 @@ static bool isSetBuilder(Parser* parser) {
     *parser = initialParser;
     if (!isBuilder) return false;
 
-    // Call set builder and implicitly return its value
-    functionWrapper(parser, TYPE_FUNCTION, setBuilder);
-    emitBytes(parser, OP_CALL, 0);
+    setBuilder(parser);
     return true;
 }
 
@@ -928,39 +1484,31 @@ static void set(Parser* parser, bool canAssign) {
     if (!check(parser, TOKEN_RIGHT_BRACE)) {
         // Check if its a set builder
         if (isSetBuilder(parser)) return;
+
+        if (isOmission(parser)) {
+            omissionTerms(parser, OP_SET_OMISSION);
+            consume(parser, TOKEN_RIGHT_BRACE, "Expected '}' after set literal");
+            return;
+        }
         
         emitByte(parser, OP_SET_CREATE);
         expression(parser, true);
 
-        if (check(parser, TOKEN_ELLIPSIS)) {
-            // Omission operation without 'next'
-            advance(parser);
+        if (match(parser, TOKEN_COMMA)) {
             expression(parser, true);
-            emitBytes(parser, OP_SET_OMISSION, 0);
-        } else {
-            if (match(parser, TOKEN_COMMA)) {
-                expression(parser, true);
 
-                if (check(parser, TOKEN_ELLIPSIS)) {
-                    // Omission operation with 'next'
-                    advance(parser);
-                    expression(parser, true);
-                    emitBytes(parser, OP_SET_OMISSION, 1);
-                } else {
-                    // Normal set construction
-                    emitBytes(parser, OP_SET_INSERT, 2);
-
-                    int count = 0;
-                    while (match(parser, TOKEN_COMMA)) {
-                        expression(parser, true);
-                        count++;
-                    }
-                    if (count > 0) emitBytes(parser, OP_SET_INSERT, count);
-                }
-            } else {
-                // Singleton set
-                emitBytes(parser, OP_SET_INSERT, 1);
+            // Normal set construction
+            emitBytes(parser, OP_SET_INSERT, 2);
+
+            int count = 0;
+            while (match(parser, TOKEN_COMMA)) {
+                expression(parser, true);
+                count++;
             }
+            if (count > 0) emitBytes(parser, OP_SET_INSERT, count);
+        } else {
+            // Singleton set
+            emitBytes(parser, OP_SET_INSERT, 1);
         }
     } else {
         // Empty set
@@ -1099,20 +1647,31 @@ static void namedVariable(Parser* parser, Token name, bool canAssign) {
     int arg = resolveLocal(parser, current, &name);
 
     if (arg != -1) {
+        arg = current->locals[arg].slot;
         getOp = OP_GET_LOCAL;
         setOp = OP_SET_LOCAL;
     } else if ((arg = resolveUpvalue(parser, current, &name)) != -1) {
         getOp = OP_GET_UPVALUE;
         setOp = OP_SET_UPVALUE;
     } else {
-        arg = identifierConstant(parser, &name);
+        arg = globalSlot(parser, &name);
         getOp = OP_GET_GLOBAL;
         setOp = OP_SET_GLOBAL;
     }
 
     if (canAssign && match(parser, TOKEN_ASSIGN)) {
+        int previousStart = current->assignStart;
+        int previousOperation = current->inPlaceOperation;
+        int start = currentChunk(parser)->count;
+        current->assignStart = start;
+        current->inPlaceOperation = -1;
+
         expression(parser, false);
 
+        if (setOp == OP_SET_LOCAL) noteInPlaceAssign(parser, start, (uint8_t)arg);
+        current->assignStart = previousStart;
+        current->inPlaceOperation = previousOperation;
+
         if (setOp == OP_SET_GLOBAL) {
             emitOpShort(parser, setOp, (uint16_t)arg);
         } else {
@@ -1150,32 +1709,30 @@ static void unary(Parser* parser, bool canAssign) {
     } 
 }
 
-static void quantifier(Parser* parser) {
-    // Set anonymous function name and to implicit return
-    current->function->name = copyString(parser->gc, "@quan", 5);
-    current->implicitReturn = true;
+/**
+ * @brief Parse a quantifier.
+ *
+ * It is compiled into the enclosing function as a loop that exits as soon as the result is known.
+ */
+static void quantifier(Parser* parser, bool canAssign) {
+    (void)canAssign;
 
     TokenKind operatorType = parser->previous.type;
 
-    // === FOR LOAN CODE ===
-    uint8_t loopVarSlot = parseGenerator(parser);
-    if (loopVarSlot == 0) error(parser, "Variable with this identifier already defined in this scope");
-    uint8_t iteratorSlot = syntheticLocal(parser, OP_CREATE_ITERATOR, "@iter");
+    // The result if the loop runs to the end, stored as a local
+    int firstLocal = current->localCount;
+    int previousOffset = beginInlineScope(parser);
 
-    int loopStart = currentChunk(parser)->count;
-
-    // Load and iterate the iterator
-    emitBytes(parser, OP_GET_LOCAL, iteratorSlot);
-    emitByte(parser, OP_ITERATE); // Push next value + bool for if there is a current value
-
-    // If no current value -> jump to after-loop
-    int loopEnd = emitJump(parser, OP_JUMP_IF_FALSE);
-    emitByte(parser, OP_POP); // Pop check
+    if (operatorType == TOKEN_SOME) {
+        emitByte(parser, OP_NULL);
+    } else {
+        emitByte(parser, operatorType == TOKEN_FORALL ? OP_TRUE : OP_FALSE);
+    }
+    uint8_t resultSlot = addSyntheticLocal(parser, "@result");
 
-    // If loop is fine, set iterative variable
-    emitBytes(parser, OP_SET_LOCAL, loopVarSlot);
-    emitByte(parser, OP_POP);
-    // =====================
+    Generator generator;
+    if (!parseGenerator(parser, &generator)) error(parser, "Variable with this identifier already defined in this scope");
+    beginGeneratorLoop(parser, &generator);
 
     // Predicate
     consume(parser, TOKEN_PIPE, "Expected pipe after generator of quantifier");
@@ -1189,41 +1746,26 @@ static void quantifier(Parser* parser) {
     int loopEarlyExit = emitJump(parser, OP_JUMP_IF_FALSE_2);
     emitByte(parser, OP_POP);
 
-    emitLoop(parser, loopStart);
+    emitLoop(parser, generator.loopStart);
 
     // Early exit
     patchJump(parser, loopEarlyExit);
 
     if (operatorType == TOKEN_SOME) {
-        emitBytes(parser, OP_GET_LOCAL, loopVarSlot);
+        emitBytes(parser, OP_GET_LOCAL, generator.varSlot);
     } else {
         emitByte(parser, operatorType == TOKEN_FORALL ? OP_FALSE : OP_TRUE);
     }
 
-    emitByte(parser, OP_STASH);
-    emitBytes(parser, OP_RETURN, current->implicitReturn); // Return manually
-
-    // Loop end
-    patchJump(parser, loopEnd);
+    emitBytes(parser, OP_SET_LOCAL, resultSlot);
     emitByte(parser, OP_POP);
 
-    if (operatorType == TOKEN_SOME) {
-        emitByte(parser, OP_NULL);
-    } else {
-        emitByte(parser, operatorType == TOKEN_FORALL ? OP_TRUE : OP_FALSE); 
-    }
-
-    emitByte(parser, OP_STASH);
-}
-
-/**
- * @brief Wrapper for quantifier to call it as an anonymous function.
- */
-static void quantWrap(Parser* parser, bool canAssign) {
-    (void)canAssign;
+    // Loop end
+    patchJump(parser, generator.exitJump);
+    discardLocals(parser, generator.firstLocal);
 
-    functionWrapper(parser, TYPE_FUNCTION, quantifier);
-    emitBytes(parser, OP_CALL, 0);
+    // Leave the result on the stack
+    endInlineScope(parser, firstLocal, previousOffset);
 }
 
 static void anonymousFunction(Parser* parser) {
@@ -1249,6 +1791,7 @@ static void anonymousFunction(Parser* parser) {
     consume(parser, TOKEN_MAPS_TO, "Expected '->' or '→' after anonymous function signature");
 
     // Compile the body as an expression
+    beginStatement(parser);
     expressionStatement(parser);
 }
 
@@ -1289,9 +1832,9 @@ ParseRule rules[] = {
     [TOKEN_UNION]         = {NULL,       binary,    PREC_TERM},
     [TOKEN_SUBSET]        = {NULL,       binary,    PREC_TERM},
     [TOKEN_SUBSETEQ]      = {NULL,       binary,    PREC_TERM},
-    [TOKEN_FORALL]        = {quantWrap,  NULL,      PREC_EQUALITY},
-    [TOKEN_EXISTS]        = {quantWrap,  NULL,      PREC_EQUALITY},
-    [TOKEN_SOME]          = {quantWrap,  NULL,      PREC_EQUALITY},
+    [TOKEN_FORALL]        = {quantifier, NULL,      PREC_EQUALITY},
+    [TOKEN_EXISTS]        = {quantifier, NULL,      PREC_EQUALITY},
+    [TOKEN_SOME]          = {quantifier, NULL,      PREC_EQUALITY},
     [TOKEN_EQUAL]         = {NULL,       NULL,      PREC_NONE},
     [TOKEN_EQUAL_EQUAL]   = {NULL,       binary,    PREC_EQUALITY},
     [TOKEN_ASSIGN]        = {NULL,       NULL,      PREC_NONE},
@@ -1453,6 +1996,10 @@ static void withDeclaration(Parser* parser) {
 
 static void expressionStatement(Parser* parser) {
     expression(parser, false);
+
+    if (current->implicitReturn && current->lastCall == currentChunk(parser)->count - 2) {
+        current->implicitCall = current->lastCall;
+    }
     emitByte(parser, current->implicitReturn ? OP_STASH : OP_POP);
 }
 
@@ -1490,6 +2037,10 @@ static void returnStatement(Parser* parser) {
         emitReturn(parser);
     } else {
         expression(parser, false);
+
+        if (current->lastCall == currentChunk(parser)->count - 2) {
+            patchTailCall(parser, current->lastCall);
+        }
         emitBytes(parser, OP_RETURN, 0);
     }
 }
@@ -1512,23 +2063,9 @@ static void whileStatement(Parser* parser) {
 static void forStatement(Parser* parser) {
     beginScope(parser);
 
-    uint8_t loopVarSlot = parseGenerator(parser);
-    if (loopVarSlot == 0) error(parser, "Variable with this identifier already defined in this scope");
-    uint8_t iteratorSlot = syntheticLocal(parser, OP_CREATE_ITERATOR, "@iter");
-
-    int loopStart = currentChunk(parser)->count;
-
-    // Load and iterate the iterator
-    emitBytes(parser, OP_GET_LOCAL, iteratorSlot);
-    emitByte(parser, OP_ITERATE); // Push next value then the bool for if there is a current value
-
-    // If no current value -> jump to after-loop
-    int exitJump = emitJump(parser, OP_JUMP_IF_FALSE);
-    emitByte(parser, OP_POP); // Pop check
-    
-    // If loop is fine, set iterative variable
-    emitBytes(parser, OP_SET_LOCAL, loopVarSlot);
-    emitByte(parser, OP_POP);
+    Generator generator;
+    if (!parseGenerator(parser, &generator)) error(parser, "Variable with this identifier already defined in this scope");
+    beginGeneratorLoop(parser, &generator);
 
     // Compile optional predicate
     if (match(parser, TOKEN_PIPE)) {
@@ -1551,10 +2088,7 @@ static void forStatement(Parser* parser) {
         statement(parser, true, false);
     }
 
-    emitLoop(parser, loopStart);
-
-    patchJump(parser, exitJump);
-    emitByte(parser, OP_POP);
+    endGeneratorLoop(parser, &generator);
     endScope(parser);
 }
 
@@ -1575,12 +2109,14 @@ static void synchronise(Parser* parser) {
                 return;
             default:; // Do nothing
         }
-    }
 
-    advance(parser);
+        advance(parser);
+    }
 }
 
 static void declaration(Parser* parser) {
+    beginStatement(parser);
+
     if (match(parser, TOKEN_FUNCTION)) {
         functionDeclaration(parser);
     } else if (match(parser, TOKEN_LET)) {
@@ -1598,6 +2134,7 @@ static void declaration(Parser* parser) {
 
 static void statement(Parser* parser, bool blockAllowed, bool ignoreSeparator) {
     if (current->type == TYPE_SCRIPT) current->implicitReturn = false;
+    beginStatement(parser);
     
     if (match(parser, TOKEN_IF)) {
         ifStatement(parser);
@@ -1624,10 +2161,11 @@ static void statement(Parser* parser, bool blockAllowed, bool ignoreSeparator) {
     }
 }
 
-ObjFunction* compile(GC* gc, const unsigned char* source) {
+ObjFunction* compile(VM* vm, const unsigned char* source) {
     Parser parser;
     
-    parser.gc = gc;
+    parser.vm = vm;
+    parser.gc = &vm->gc;
     parser.hadError = false;
     parser.panicMode = false;
 
@@ -1649,11 +2187,11 @@ ObjFunction* compile(GC* gc, const unsigned char* source) {
     return parser.hadError ? NULL : function;
 }
 
-void markCompilerRoots(Parser* parser) {
+void markCompilerRoots(GC* gc) {
     Compiler* compiler = current;
      
     while(compiler != NULL) {
-        markObject(parser->gc, (Obj*)compiler->function);
+        markObject(gc, (Obj*)compiler->function);
         compiler = compiler->enclosing;
     }
 }
\ No newline at end of file
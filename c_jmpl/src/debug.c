@@ -2,7 +2,9 @@
 
 #include "debug.h"
 #include "object.h"
+#include "obj_string.h"
 #include "value.h"
+#include "vm.h"
 
 // --- DEBUG TOKENS ---
 
@@ -91,11 +93,11 @@ const unsigned char* getTokenName(TokenKind type) {
 // --- DEBUG BYTECODE ---
 
 // Disassemble each instruction of bytecode
-void disassembleChunk(Chunk* chunk, const char* name) {
+void disassembleChunk(VM* vm, Chunk* chunk, const char* name) {
     printf("== %s ==\n", name);
 
     for (int offset = 0; offset < chunk->count;) {
-        offset = disassembleInstruction(chunk, offset);
+        offset = disassembleInstruction(vm, chunk, offset);
     }
 
     for (size_t i = 0; i < 6 + strlen(name); i++) {
@@ -113,6 +115,13 @@ static int constantInstruction(const char* name, Chunk* chunk, int offset) {
     return offset + 3;
 }
 
+static int globalInstruction(VM* vm, const char* name, Chunk* chunk, int offset) {
+    uint16_t slot = (uint16_t)(chunk->code[offset + 1] << 8);
+    slot |= chunk->code[offset + 2];
+    printf("%-16s %4d '%s'\n", name, slot, vm->globals[slot].name->utf8);
+    return offset + 3;
+}
+
 static int simpleInstruction(const char* name, int offset) {
     printf("%s\n", name);
     return offset + 1;
@@ -124,6 +133,13 @@ static int byteInstruction(const char* name, Chunk* chunk, int offset) {
     return offset + 2;
 }
 
+static int twoByteInstruction(const char* name, Chunk* chunk, int offset) {
+    uint8_t a = chunk->code[offset + 1];
+    uint8_t b = chunk->code[offset + 2];
+    printf("%-16s %4d %4d\n", name, a, b);
+    return offset + 3;
+}
+
 static int jumpInstruction(const char* name, int sign, Chunk* chunk, int offset) {
     uint16_t jump = (uint16_t)(chunk->code[offset + 1] << 8);
     jump |= chunk->code[offset + 2];
@@ -131,6 +147,15 @@ static int jumpInstruction(const char* name, int sign, Chunk* chunk, int offset)
     return offset + 3;
 }
 
+static int forLoopInstruction(const char* name, Chunk* chunk, int offset) {
+    uint8_t stateSlot = chunk->code[offset + 1];
+    uint8_t varSlot = chunk->code[offset + 2];
+    uint16_t jump = (uint16_t)(chunk->code[offset + 3] << 8);
+    jump |= chunk->code[offset + 4];
+    printf("%-16s %4d %4d %4d -> %d\n", name, stateSlot, varSlot, offset, offset + 5 + jump);
+    return offset + 5;
+}
+
 static int closureInstruction(const char* name, Chunk* chunk, int offset) {
     offset++;
     uint16_t constant = (uint16_t)(chunk->code[offset++] << 8);
@@ -159,7 +184,7 @@ void printStack(Value* stack, Value* stackTop) {
     printf("\n");
 }
 
-int disassembleInstruction(Chunk* chunk, int offset) {
+int disassembleInstruction(VM* vm, Chunk* chunk, int offset) {
     printf("%04d ", offset);
     int line = getLine(chunk, offset);
 
@@ -181,9 +206,9 @@ int disassembleInstruction(Chunk* chunk, int offset) {
         case OP_POP:             return simpleInstruction("OP_POP", offset);
         case OP_GET_LOCAL:       return byteInstruction("OP_GET_LOCAL", chunk, offset);
         case OP_SET_LOCAL:       return byteInstruction("OP_SET_LOCAL", chunk, offset);
-        case OP_GET_GLOBAL:      return constantInstruction("OP_GET_GLOBAL", chunk, offset);
-        case OP_DEFINE_GLOBAL:   return constantInstruction("OP_DEFINE_GLOBAL", chunk, offset);
-        case OP_SET_GLOBAL:      return constantInstruction("OP_SET_GLOBAL", chunk, offset);
+        case OP_GET_GLOBAL:      return globalInstruction(vm, "OP_GET_GLOBAL", chunk, offset);
+        case OP_DEFINE_GLOBAL:   return globalInstruction(vm, "OP_DEFINE_GLOBAL", chunk, offset);
+        case OP_SET_GLOBAL:      return globalInstruction(vm, "OP_SET_GLOBAL", chunk, offset);
         case OP_GET_UPVALUE:     return byteInstruction("OP_GET_UPVALUE", chunk, offset);
         case OP_SET_UPVALUE:     return byteInstruction("OP_SET_UPVALUE", chunk, offset);
         case OP_EQUAL:           return simpleInstruction("OP_EQUAL", offset);
@@ -205,6 +230,7 @@ int disassembleInstruction(Chunk* chunk, int offset) {
         case OP_JUMP_IF_FALSE_2: return jumpInstruction("OP_JUMP_IF_FALSE_2", 1, chunk, offset);
         case OP_LOOP:            return jumpInstruction("OP_LOOP", -1, chunk, offset);
         case OP_CALL:            return byteInstruction("OP_CALL", chunk, offset);
+        case OP_TAIL_CALL:       return byteInstruction("OP_TAIL_CALL", chunk, offset);
         case OP_CLOSURE:         return closureInstruction("OP_CLOSURE", chunk, offset);
         case OP_CLOSE_UPVALUE:   return simpleInstruction("OP_CLOSE_UPVALUE", offset);
         case OP_RETURN:          return byteInstruction("OP_RETURN", chunk, offset);
@@ -222,10 +248,27 @@ int disassembleInstruction(Chunk* chunk, int offset) {
         case OP_CREATE_TUPLE:    return byteInstruction("OP_CREATE_TUPLE", chunk, offset);
         case OP_TUPLE_OMISSION:  return byteInstruction("OP_TUPLE_OMISSION", chunk, offset);
         case OP_SUBSCRIPT:       return byteInstruction("OP_SUBSCRIPT", chunk, offset);
-        case OP_CREATE_ITERATOR: return simpleInstruction("OP_CREATE_ITERATOR", offset);
-        case OP_ITERATE:         return simpleInstruction("OP_ITERATE", offset);
+        case OP_RANGE_INIT:      return twoByteInstruction("OP_RANGE_INIT", chunk, offset);
+        case OP_FOR_RANGE:       return forLoopInstruction("OP_FOR_RANGE", chunk, offset);
+        case OP_ITER_INIT:       return simpleInstruction("OP_ITER_INIT", offset);
+        case OP_FOR_ITER:        return forLoopInstruction("OP_FOR_ITER", chunk, offset);
         case OP_ARB:             return simpleInstruction("OP_ARB", offset);
         case OP_IMPORT_LIB:      return constantInstruction("OP_IMPORT_LIB", chunk, offset);
+        case OP_ADD_NUM:         return simpleInstruction("OP_ADD_NUM", offset);
+        case OP_SUBTRACT_NUM:    return simpleInstruction("OP_SUBTRACT_NUM", offset);
+        case OP_MULTIPLY_NUM:    return simpleInstruction("OP_MULTIPLY_NUM", offset);
+        case OP_DIVIDE_NUM:      return simpleInstruction("OP_DIVIDE_NUM", offset);
+        case OP_EQUAL_NUM:       return simpleInstruction("OP_EQUAL_NUM", offset);
+        case OP_NOT_EQUAL_NUM:   return simpleInstruction("OP_NOT_EQUAL_NUM", offset);
+        case OP_GREATER_NUM:     return simpleInstruction("OP_GREATER_NUM", offset);
+        case OP_GREATER_EQUAL_NUM: return simpleInstruction("OP_GREATER_EQUAL_NUM", offset);
+        case OP_LESS_NUM:        return simpleInstruction("OP_LESS_NUM", offset);
+        case OP_LESS_EQUAL_NUM:  return simpleInstruction("OP_LESS_EQUAL_NUM", offset);
+        case OP_SHARE_LOCAL:     return byteInstruction("OP_SHARE_LOCAL", chunk, offset);
+        case OP_SET_UNION_IN_PLACE: return simpleInstruction("OP_SET_UNION_IN_PLACE", offset);
+        case OP_SET_DIFFERENCE_IN_PLACE: return simpleInstruction("OP_SET_DIFFERENCE_IN_PLACE", offset);
+        case OP_PARALLEL_BUILDER: return twoByteInstruction("OP_PARALLEL_BUILDER", chunk, offset);
+        case OP_BUILDER_END:     return simpleInstruction("OP_BUILDER_END", offset);
         default:
             printf("Unknown opcode %d\n", instruction);
             return offset + 1;
@@ -5,15 +5,41 @@
 #include "value.h"
 #include "memory.h"
 
-void initGC(GC* gc) {
-    gc->objects = NULL;
+void initGC(GC* gc, VM* vm) {
+    gc->vm = vm;
+    initPages(gc);
     gc->bytesAllocated = 0;
+    gc->youngBytes = 0;
+    gc->stepAt = NURSERY_SIZE;
+    gc->youngAge = 0;
     gc->nextGC = INTIAL_GC;
+    gc->budget = SIZE_MAX;
+
+    gc->isMarking = false;
+    gc->markStart = 0;
+    gc->pauseTarget = GC_PAUSE_DEFAULT;
 
     gc->greyCount = 0;
     gc->greyCapacity = 0;
     gc->greyStack = NULL;
 
+    gc->rememberedCount = 0;
+    gc->rememberedCapacity = 0;
+    gc->remembered = NULL;
+
+    gc->minorCount = 0;
+    gc->majorCount = 0;
+    gc->stepCount = 0;
+    gc->minorSeconds = 0;
+    gc->majorSeconds = 0;
+    gc->longestPause = 0;
+    for (int i = 0; i < GC_PAUSE_BUCKETS; i++) {
+        gc->pauses[i] = 0;
+    }
+#ifdef DEBUG_GC_STATS
+    gc->promotedCount = 0;
+#endif
+
     gc->tempCount = 0;
     gc->tempCapacity = 0;
     gc->tempStack = NULL;
@@ -21,10 +47,23 @@ void initGC(GC* gc) {
 
 void freeGC(GC* gc) {
     freeObjects(gc);
-    gc->objects = NULL;
+    free(gc->youngPages);
+    free(gc->remembered);
     free(gc->tempStack);
 }
 
+/**
+ * @brief Move the objects allocated through another GC into this one, which frees them once they are unreachable.
+ */
+void moveObjects(GC* gc, GC* from) {
+    movePages(gc, from);
+    gc->bytesAllocated += from->bytesAllocated;
+    gc->youngBytes += from->youngBytes;
+
+    from->bytesAllocated = 0;
+    from->youngBytes = 0;
+}
+
 void pushTemp(GC* gc, Value value) {
     if (gc->tempCapacity < gc->tempCount + 1) {
         gc->tempCapacity = GROW_CAPACITY(gc->tempCapacity);
@@ -0,0 +1,392 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hamt.h"
+#include "memory.h"
+#include "object.h"
+#include "set.h"
+#include "hash.h"
+#include "gc.h"
+#include "utils.h"
+
+#define HAMT_MASK      (HAMT_WIDTH - 1)
+#define HAMT_HASH_BITS 64
+
+/**
+ * @brief Get the branch of a node that a mixed hash belongs to.
+ */
+static inline uint32_t branchBit(hash_t mixed, int shift) {
+    return 1u << ((mixed >> shift) & HAMT_MASK);
+}
+
+/**
+ * @brief Get the position of a branch among the branches set in a map.
+ */
+static inline uint32_t branchIndex(uint32_t map, uint32_t bit) {
+    return popCount(map & (bit - 1));
+}
+
+/**
+ * @brief Get the no. slots of a node that hold elements.
+ */
+uint32_t hamtDataCount(ObjSetNode* node) {
+    return isCollisionNode(node) ? node->size : popCount(node->dataMap);
+}
+
+static ObjSetNode* newSetNode(GC* gc, uint32_t dataMap, uint32_t nodeMap, uint32_t size, size_t count) {
+    ObjSetNode* node = (ObjSetNode*)allocateObject(gc, sizeof(ObjSetNode) + size * sizeof(SetSlot), OBJ_SET_NODE, false);
+    node->dataMap = dataMap;
+    node->nodeMap = nodeMap;
+    node->size = size;
+    node->count = count;
+    return node;
+}
+
+void markSetNode(GC* gc, ObjSetNode* node) {
+    uint32_t dataCount = hamtDataCount(node);
+
+    for (uint32_t i = 0; i < node->size; i++) {
+        if (i < dataCount) {
+            markValue(gc, node->slots[i].entry.key);
+        } else {
+            markObject(gc, (Obj*)node->slots[i].node);
+        }
+    }
+}
+
+/**
+ * @brief Copy a node with one slot removed and/or one slot inserted.
+ *
+ * @param removeAt The slot to remove, or -1
+ * @param insertAt The index of the inserted slot in the copy, or -1
+ *
+ * An inserted child node must be reachable, e.g. pushed as a temp, as the copy may trigger a collection.
+ */
+static ObjSetNode* spliceNode(GC* gc, ObjSetNode* node, uint32_t dataMap, uint32_t nodeMap, size_t count,
+                              int removeAt, int insertAt, SetSlot slot) {
+    uint32_t size = node->size - (removeAt >= 0) + (insertAt >= 0);
+    ObjSetNode* copy = newSetNode(gc, dataMap, nodeMap, size, count);
+
+    uint32_t to = 0;
+    for (uint32_t from = 0; from < node->size; from++) {
+        if ((int)from == removeAt) continue;
+        if ((int)to == insertAt) copy->slots[to++] = slot;
+        copy->slots[to++] = node->slots[from];
+    }
+    if ((int)to == insertAt) copy->slots[to++] = slot;
+
+    return copy;
+}
+
+/**
+ * @brief Create a node holding two elements whose hashes match up to a shift.
+ */
+static ObjSetNode* mergeEntries(GC* gc, SetEntry a, hash_t mixedA, SetEntry b, hash_t mixedB, int shift) {
+    if (shift >= HAMT_HASH_BITS) {
+        ObjSetNode* node = newSetNode(gc, 0, 0, 2, 2);
+        node->slots[0].entry = a;
+        node->slots[1].entry = b;
+        return node;
+    }
+
+    uint32_t bitA = branchBit(mixedA, shift);
+    uint32_t bitB = branchBit(mixedB, shift);
+
+    if (bitA != bitB) {
+        ObjSetNode* node = newSetNode(gc, bitA | bitB, 0, 2, 2);
+        node->slots[bitA < bitB ? 0 : 1].entry = a;
+        node->slots[bitA < bitB ? 1 : 0].entry = b;
+        return node;
+    }
+
+    ObjSetNode* child = mergeEntries(gc, a, mixedA, b, mixedB, shift + HAMT_BITS);
+    pushTemp(gc, OBJ_VAL(child));
+
+    ObjSetNode* node = newSetNode(gc, 0, bitA, 1, 2);
+    node->slots[0].node = child;
+
+    popTemp(gc);
+    return node;
+}
+
+static ObjSetNode* insertNode(GC* gc, ObjSetNode* node, SetEntry entry, hash_t mixed, int shift, bool* added) {
+    SetSlot slot = {.entry = entry};
+
+    if (isCollisionNode(node)) {
+        for (uint32_t i = 0; i < node->size; i++) {
+            if (valuesEqual(node->slots[i].entry.key, entry.key)) return node;
+        }
+
+        *added = true;
+        return spliceNode(gc, node, 0, 0, node->count + 1, -1, node->size, slot);
+    }
+
+    uint32_t bit = branchBit(mixed, shift);
+
+    if (node->dataMap & bit) {
+        // The branch holds an element, so either it is already in the set or both move into a child
+        int index = branchIndex(node->dataMap, bit);
+        SetEntry existing = node->slots[index].entry;
+        if (existing.hash == entry.hash && valuesEqual(existing.key, entry.key)) return node;
+
+        *added = true;
+        ObjSetNode* child = mergeEntries(gc, existing, hashAvalanche(existing.hash), entry, mixed, shift + HAMT_BITS);
+        pushTemp(gc, OBJ_VAL(child));
+
+        uint32_t dataMap = node->dataMap & ~bit;
+        uint32_t nodeMap = node->nodeMap | bit;
+        int childIndex = popCount(dataMap) + branchIndex(nodeMap, bit);
+
+        ObjSetNode* copy = spliceNode(gc, node, dataMap, nodeMap, node->count + 1, index, childIndex, (SetSlot){.node = child});
+        popTemp(gc);
+        return copy;
+    }
+
+    if (node->nodeMap & bit) {
+        int index = popCount(node->dataMap) + branchIndex(node->nodeMap, bit);
+        ObjSetNode* child = node->slots[index].node;
+        ObjSetNode* newChild = insertNode(gc, child, entry, mixed, shift + HAMT_BITS, added);
+        if (newChild == child) return node;
+
+        pushTemp(gc, OBJ_VAL(newChild));
+        ObjSetNode* copy = spliceNode(gc, node, node->dataMap, node->nodeMap, node->count + 1, index, index, (SetSlot){.node = newChild});
+        popTemp(gc);
+        return copy;
+    }
+
+    *added = true;
+    return spliceNode(gc, node, node->dataMap | bit, node->nodeMap, node->count + 1, -1, branchIndex(node->dataMap, bit), slot);
+}
+
+/**
+ * @brief Get a trie with an element inserted, sharing all nodes off the path to the element.
+ *
+ * @param root  The root of a trie, or NULL for an empty trie
+ * @param added Set to whether the element was not already in the trie
+ */
+ObjSetNode* hamtInsert(GC* gc, ObjSetNode* root, SetEntry entry, bool* added) {
+    *added = false;
+
+    if (root == NULL) {
+        *added = true;
+        ObjSetNode* node = newSetNode(gc, branchBit(hashAvalanche(entry.hash), 0), 0, 1, 1);
+        node->slots[0].entry = entry;
+        return node;
+    }
+
+    return insertNode(gc, root, entry, hashAvalanche(entry.hash), 0, added);
+}
+
+static ObjSetNode* removeNode(GC* gc, ObjSetNode* node, Value key, hash_t hash, hash_t mixed, int shift, bool* removed) {
+    SetSlot empty = {.node = NULL};
+
+    if (isCollisionNode(node)) {
+        for (uint32_t i = 0; i < node->size; i++) {
+            if (!valuesEqual(node->slots[i].entry.key, key)) continue;
+
+            *removed = true;
+            if (node->size == 1) return NULL;
+            return spliceNode(gc, node, 0, 0, node->count - 1, i, -1, empty);
+        }
+
+        return node;
+    }
+
+    uint32_t bit = branchBit(mixed, shift);
+
+    if (node->dataMap & bit) {
+        int index = branchIndex(node->dataMap, bit);
+        SetEntry existing = node->slots[index].entry;
+        if (existing.hash != hash || !valuesEqual(existing.key, key)) return node;
+
+        *removed = true;
+        if (node->size == 1) return NULL;
+        return spliceNode(gc, node, node->dataMap & ~bit, node->nodeMap, node->count - 1, index, -1, empty);
+    }
+
+    if (node->nodeMap & bit) {
+        int index = popCount(node->dataMap) + branchIndex(node->nodeMap, bit);
+        ObjSetNode* child = node->slots[index].node;
+        ObjSetNode* newChild = removeNode(gc, child, key, hash, mixed, shift + HAMT_BITS, removed);
+        if (newChild == child) return node;
+
+        if (newChild == NULL) {
+            if (node->size == 1) return NULL;
+            return spliceNode(gc, node, node->dataMap, node->nodeMap & ~bit, node->count - 1, index, -1, empty);
+        }
+
+        if (newChild->count == 1) {
+            // Pull a lone element up into this node
+            uint32_t dataMap = node->dataMap | bit;
+            SetSlot slot = {.entry = newChild->slots[0].entry};
+            return spliceNode(gc, node, dataMap, node->nodeMap & ~bit, node->count - 1, index, branchIndex(dataMap, bit), slot);
+        }
+
+        pushTemp(gc, OBJ_VAL(newChild));
+        ObjSetNode* copy = spliceNode(gc, node, node->dataMap, node->nodeMap, node->count - 1, index, index, (SetSlot){.node = newChild});
+        popTemp(gc);
+        return copy;
+    }
+
+    return node;
+}
+
+/**
+ * @brief Get a trie with an element removed, sharing all nodes off the path to the element.
+ *
+ * @param removed Set to whether the element was in the trie
+ * @return        The new root, or NULL if the trie is empty
+ */
+ObjSetNode* hamtRemove(GC* gc, ObjSetNode* root, Value key, hash_t hash, bool* removed) {
+    *removed = false;
+    if (root == NULL) return NULL;
+
+    return removeNode(gc, root, key, hash, hashAvalanche(hash), 0, removed);
+}
+
+SetEntry* hamtFind(ObjSetNode* root, Value key, hash_t hash) {
+    hash_t mixed = hashAvalanche(hash);
+    ObjSetNode* node = root;
+
+    for (int shift = 0; node != NULL; shift += HAMT_BITS) {
+        if (isCollisionNode(node)) {
+            for (uint32_t i = 0; i < node->size; i++) {
+                if (valuesEqual(node->slots[i].entry.key, key)) return &node->slots[i].entry;
+            }
+            return NULL;
+        }
+
+        uint32_t bit = branchBit(mixed, shift);
+
+        if (node->dataMap & bit) {
+            SetEntry* entry = &node->slots[branchIndex(node->dataMap, bit)].entry;
+            return entry->hash == hash && valuesEqual(entry->key, key) ? entry : NULL;
+        }
+
+        if (!(node->nodeMap & bit)) return NULL;
+        node = node->slots[popCount(node->dataMap) + branchIndex(node->nodeMap, bit)].node;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Get the element at a position in the iteration order of a trie.
+ *
+ * @param index A position less than the root's count
+ */
+SetEntry* hamtEntryAt(ObjSetNode* root, size_t index) {
+    ObjSetNode* node = root;
+
+    while (true) {
+        uint32_t dataCount = hamtDataCount(node);
+        if (index < dataCount) return &node->slots[index].entry;
+        index -= dataCount;
+
+        // Find the child containing the position
+        uint32_t i = dataCount;
+        while (index >= node->slots[i].node->count) {
+            index -= node->slots[i].node->count;
+            i++;
+        }
+        node = node->slots[i].node;
+    }
+}
+
+/**
+ * @brief Build the node for entries that share their hash bits below a shift.
+ *
+ * @param mixed   The mixed hash of each entry
+ * @param scratch Space for reordering the entries
+ */
+static ObjSetNode* buildNode(GC* gc, SetEntry* entries, hash_t* mixed, SetEntry* scratch, hash_t* mixedScratch,
+                             size_t count, int shift) {
+    if (shift >= HAMT_HASH_BITS) {
+        ObjSetNode* node = newSetNode(gc, 0, 0, count, count);
+        for (size_t i = 0; i < count; i++) {
+            node->slots[i].entry = entries[i];
+        }
+        return node;
+    }
+
+    // Sort the entries by branch
+    size_t starts[HAMT_WIDTH + 1] = {0};
+    for (size_t i = 0; i < count; i++) {
+        starts[((mixed[i] >> shift) & HAMT_MASK) + 1]++;
+    }
+    for (int b = 0; b < HAMT_WIDTH; b++) {
+        starts[b + 1] += starts[b];
+    }
+
+    size_t next[HAMT_WIDTH];
+    memcpy(next, starts, sizeof(next));
+    for (size_t i = 0; i < count; i++) {
+        size_t to = next[(mixed[i] >> shift) & HAMT_MASK]++;
+        scratch[to] = entries[i];
+        mixedScratch[to] = mixed[i];
+    }
+    memcpy(entries, scratch, count * sizeof(SetEntry));
+    memcpy(mixed, mixedScratch, count * sizeof(hash_t));
+
+    // Build the children first, keeping them reachable until the node is allocated
+    uint32_t dataMap = 0, nodeMap = 0;
+    int childCount = 0;
+
+    for (int b = 0; b < HAMT_WIDTH; b++) {
+        size_t branchCount = starts[b + 1] - starts[b];
+        if (branchCount == 1) {
+            dataMap |= 1u << b;
+        } else if (branchCount > 1) {
+            nodeMap |= 1u << b;
+            ObjSetNode* child = buildNode(gc, entries + starts[b], mixed + starts[b], scratch, mixedScratch,
+                                          branchCount, shift + HAMT_BITS);
+            pushTemp(gc, OBJ_VAL(child));
+            childCount++;
+        }
+    }
+
+    uint32_t dataCount = popCount(dataMap);
+    ObjSetNode* node = newSetNode(gc, dataMap, nodeMap, dataCount + childCount, count);
+
+    uint32_t slot = 0;
+    for (int b = 0; b < HAMT_WIDTH; b++) {
+        if (dataMap & (1u << b)) node->slots[slot++].entry = entries[starts[b]];
+    }
+    for (int i = 0; i < childCount; i++) {
+        node->slots[dataCount + i].node = (ObjSetNode*)AS_OBJ(gc->tempStack[gc->tempCount - childCount + i]);
+    }
+
+    for (int i = 0; i < childCount; i++) {
+        popTemp(gc);
+    }
+
+    return node;
+}
+
+/**
+ * @brief Build a trie of the elements of a set.
+ *
+ * @param set A non-empty set
+ */
+ObjSetNode* hamtBuild(GC* gc, ObjSet* set) {
+    size_t count = set->count;
+    // Not counted by the GC, as a worker that gives up while the nodes are allocated would leak them
+    SetEntry* entries = malloc(sizeof(SetEntry) * 2 * count);
+    hash_t* mixed = malloc(sizeof(hash_t) * 2 * count);
+    if (entries == NULL || mixed == NULL) exit(INTERNAL_SOFTWARE_ERROR);
+
+    SetIterator iterator;
+    initSetIterator(&iterator, set);
+
+    size_t i = 0;
+    for (SetEntry* entry = nextSetEntry(&iterator); entry != NULL; entry = nextSetEntry(&iterator)) {
+        entries[i] = *entry;
+        mixed[i++] = hashAvalanche(entry->hash);
+    }
+
+    ObjSetNode* root = buildNode(gc, entries, mixed, entries + count, mixed + count, count, 0);
+
+    free(entries);
+    free(mixed);
+    return root;
+}
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <string.h>
 
 #include "hash.h"
 
@@ -6,28 +7,37 @@
 #include "obj_string.h"
 #include "set.h"
 #include "tuple.h"
+#include "range.h"
+#include "parallel.h"
 
 #define TRUE_HASH  0xAAAA
 #define FALSE_HASH 0xBBBB
 #define NULL_HASH  0xCCCC
 
-static hash_t hashAvalanche(hash_t hash) {
+/**
+ * @brief Mixes the bits of a hash so that every input bit affects every output bit.
+ *
+ * Uses the finaliser of MurmurHash3, as sets pick slots and tags from both the low and high bits.
+ */
+hash_t hashAvalanche(hash_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
     hash ^= hash >> 33;
-    hash *= 1610612741;
-    hash ^= hash >> 29;
-    hash *= 805306457;
-    hash ^= hash >> 32;
 
     return hash;
 }
 
 /**
- * @brief Hashes a char array using xxHash-64.
+ * @brief Hashes a char array using FNV-1a.
  * 
- * @param hash   An initial hash
+ * @param hash   An initial hash, which can be the hash of a string to continue from
  * @param key    The char array that makes up the string
  * @param length The length of the string
  * @return       A hashed form of the string
+ * 
+ * The result isn't mixed, so the hash of a concatenation can be found from the hash of its first part.
  */
 hash_t hashString(hash_t hash, const unsigned char* key, int length) {
     for (int i = 0; i < length; i++) {
@@ -35,28 +45,53 @@ hash_t hashString(hash_t hash, const unsigned char* key, int length) {
         hash *= FNV_PRIME;
     }
 
-    return hashAvalanche(hash);
+    return hash;
 
     // return (hash_t)XXH64(key, length, hash);
 }
 
 /**
- * @brief Hashes a set using the FNV-1a hashing algorithm.
+ * @brief Hashes a set by summing the mixed hashes of its elements.
  * 
  * @param set The set to hash
  * @return    A hashed form of the set
+ * 
+ * The combination is order-independent so equal sets (and ranges) always hash the same,
+ * regardless of their capacity or insertion order.
+ * 
+ * The hash is cached in the set until an element is inserted, except by a parallel task, as other
+ * tasks may be reading the set.
  */
 static hash_t hashSet(ObjSet* set) {
+    if (set->isHashed) return set->hash;
+
     hash_t hash = FNV_INIT_HASH;
 
-    for (int i = 0; i < set->capacity; i++) {
-        SetEntry entry = set->entries[i];
-        if (!IS_NULL(entry.key)) {
-            hash_t elemHash = hashValue(entry.key);
+    SetIterator iterator;
+    initSetIterator(&iterator, set);
 
-            hash ^= elemHash;
-            hash *= FNV_PRIME;
-        }
+    for (SetEntry* entry = nextSetEntry(&iterator); entry != NULL; entry = nextSetEntry(&iterator)) {
+        hash += hashAvalanche(entry->hash);
+    }
+
+    if (!inParallelTask()) {
+        set->hash = hash;
+        set->isHashed = true;
+    }
+    return hash;
+}
+
+/**
+ * @brief Hashes a range the same way as a set with the same elements.
+ * 
+ * @param range The range to hash
+ * @return      A hashed form of the range
+ */
+static hash_t hashRange(ObjRange* range) {
+    hash_t hash = FNV_INIT_HASH;
+
+    for (size_t i = 0; i < range->count; i++) {
+        hash += hashAvalanche(hashValue(getRangeValue(range, i)));
     }
 
     return hash;
@@ -68,8 +103,13 @@ static hash_t hashSet(ObjSet* set) {
  * 
  * @param tuple The tuple to hash
  * @return      A hashed form of the tuple
+ * 
+ * Tuples can't change once created, so the hash is cached in the tuple (unless other parallel tasks may
+ * be reading it).
  */
 static hash_t hashTuple(ObjTuple* tuple) {
+    if (tuple->isHashed) return tuple->hash;
+
     hash_t hash = FNV_INIT_HASH;
 
     for (int i = 0; i < tuple->size; i++) {
@@ -81,6 +121,10 @@ static hash_t hashTuple(ObjTuple* tuple) {
         hash *= FNV_PRIME;
     }
 
+    if (!inParallelTask()) {
+        tuple->hash = hash;
+        tuple->isHashed = true;
+    }
     return hash;
 }
 
@@ -88,14 +132,23 @@ static hash_t hashObject(Obj* obj) {
     switch(obj->type) {
         case OBJ_SET:    return hashSet((ObjSet*)(obj));
         case OBJ_TUPLE:  return hashTuple((ObjTuple*)(obj));
-        case OBJ_STRING: {
-            ObjString* string = (ObjString*)(obj);
-            return (hash_t)hashString(FNV_INIT_HASH, string->utf8, string->utf8Length);
-        }
-        default:         return (hash_t)((uintptr_t)obj >> 2);
+        case OBJ_RANGE:  return hashRange((ObjRange*)(obj));
+        case OBJ_STRING: return hashAvalanche(((ObjString*)obj)->hash);
+        default:         return hashAvalanche((hash_t)((uintptr_t)obj >> 2));
     }
 }
 
+/**
+ * @brief Hash the bits of a number, where -0 hashes the same as 0 as they are equal.
+ */
+static hash_t hashNumber(double number) {
+    if (number == 0) number = 0;
+
+    uint64_t bits;
+    memcpy(&bits, &number, sizeof(bits));
+    return hashAvalanche(bits);
+}
+
 hash_t hashValue(Value value) {
 #ifdef JMPL_NAN_BOXING
     if (IS_BOOL(value)) {
@@ -103,9 +156,9 @@ hash_t hashValue(Value value) {
     } else if (IS_NULL(value)) {
         return NULL_HASH;
     } else if (IS_NUMBER(value)) {
-        return (hash_t)(AS_NUMBER(value));
+        return hashNumber(AS_NUMBER(value));
     } else if (IS_CHAR(value)) {
-        return (hash_t)(AS_CHAR(value));
+        return hashAvalanche((hash_t)(AS_CHAR(value)));
     } else if (IS_OBJ(value)) {
         return hashObject(AS_OBJ(value));
     } 
@@ -114,12 +167,9 @@ hash_t hashValue(Value value) {
     switch(value.type) {
         case VAL_BOOL: return AS_BOOL(value) ? TRUE_HASH : FALSE_HASH;
         case VAL_NULL: return NULL_HASH;
-        case VAL_NUMBER: {
-            uint64_t bits = *(uint64_t*)&value.as.number;
-            return (hash_t)(bits ^ (bits >> 32));
-        }
+        case VAL_NUMBER: return hashNumber(AS_NUMBER(value));
         case VAL_CHAR: {
-            return *(hash_t*)&value.as.character;
+            return hashAvalanche(*(hash_t*)&value.as.character);
         }
         case VAL_OBJ: {
             return hashObject(AS_OBJ(value));
@@ -4,129 +4,89 @@
 #include "iterator.h"
 #include "object.h"
 #include "set.h"
+#include "hamt.h"
 #include "tuple.h"
+#include "range.h"
 #include "obj_string.h"
-#include "memory.h"
-#include "gc.h"
 
-ObjIterator* newIterator(GC* gc, Obj* target) {
-    assert(target->isIterable);
-
-    pushTemp(gc, OBJ_VAL(target));
-    ObjIterator* iterator = ALLOCATE_OBJ(gc, ObjIterator, OBJ_ITERATOR, false);
-    iterator->target = target;
-    iterator->currentIndex = -1;
-
-    switch (target->type) {
-        case OBJ_SET: {
-            ObjSet* set = (ObjSet*)target;
-
-            // Find index of first value in set
-            for (size_t i = 0; i < set->capacity; i++) {
-                if (IS_NULL(getSetValue(set, i))) continue;
-
-                iterator->currentIndex = i;
-                break;
-            }
-            break;
-        }
-        case OBJ_TUPLE: {
-            ObjTuple* tuple = (ObjTuple*)target;
-
-            if (tuple->size > 0) {
-                iterator->currentIndex = 0;
-            } 
-            break;
-        }
-        case OBJ_STRING: {
-            ObjString* string = (ObjString*)target;
+static bool iterateSet(ObjSet* set, size_t* index, Value* value) {
+    if (set->bits != NULL) {
+        size_t bit;
+        if (!nextSetBit(set, *index, &bit)) return false;
 
-            if (string->length > 0) {
-                iterator->currentIndex = 0;
-            } 
-            break;
-        }
-        default: break;
+        *(value) = NUMBER_VAL(bit);
+        *index = bit + 1;
+        return true;
     }
 
-    popTemp(gc);
-    return iterator;
-}
-
-void freeIterator(GC* gc, ObjIterator* iterator) {
-    FREE(gc, ObjIterator, iterator);
-}
-
-static bool iterateSet(ObjIterator* iterator, Value* value) {
-    assert(iterator->target->type == OBJ_SET);
-
-    ObjSet* set = (ObjSet*)iterator->target;
-
-    size_t capacity = set->capacity;
-    int current = iterator->currentIndex;
-    if (current == -1 || capacity == 0 || current >= capacity) return false;
-
-    // Set value to point to the value pre-iteration
-    *(value) = getSetValue(set, current);
-
-    // Get next iteration
-    for (size_t i = current + 1; i < capacity; i++) {
-        if (IS_NULL(getSetValue(set, i))) continue;
+    if (set->root != NULL) {
+        if (*index >= set->count) return false;
 
-        iterator->currentIndex = i;
+        *(value) = hamtEntryAt(set->root, (*index)++)->key;
         return true;
     }
 
-    iterator->currentIndex = capacity;
-    return true; 
-}
-
-static bool iterateTuple(ObjIterator* iterator, Value* value) {
-    assert(iterator->target->type == OBJ_TUPLE);
-
-    ObjTuple* tuple = (ObjTuple*)iterator->target;
+    if (*index >= set->count) return false;
 
-    int capacity = tuple->size;
-    int current = iterator->currentIndex;
-    if (current == -1 || capacity == 0 || current >= capacity) return false;
+    *(value) = getSetValue(set, (*index)++);
+    return true;
+}
 
-    // Set value to point to the value pre-iteration
-    *(value) = tuple->elements[current];
+static bool iterateTuple(ObjTuple* tuple, size_t* index, Value* value) {
+    if (*index >= tuple->size) return false;
 
-    // Get next iteration
-    iterator->currentIndex++;
+    *(value) = tuple->elements[(*index)++];
     return true;
 }
 
-static bool iterateString(ObjIterator* iterator, Value* value) {
-    assert(iterator->target->type == OBJ_STRING);
+static bool iterateString(ObjString* string, size_t* index, Value* value) {
+    if (*index >= string->length) return false;
 
-    ObjString* string = (ObjString*)iterator->target;
-
-    int capacity = string->length;
-    int current = iterator->currentIndex;
-    if (current == -1 || capacity == 0 || current >= capacity) return false;
+    *(value) = indexString(string, (*index)++);
+    return true;
+}
 
-    // Set value to point to the value pre-iteration
-    *(value) = indexString(string, current);
+static bool iterateRange(ObjRange* range, size_t* index, Value* value) {
+    if (*index >= range->count) return false;
 
-    // Get next iteration
-    iterator->currentIndex++;
+    *(value) = getRangeValue(range, (*index)++);
     return true;
 }
 
 /**
- * @brief Iterates the iterator if possible
+ * @brief Get the next value of an iterable object.
  * 
- * @param iterator A pointer to an iterator object
- * @param value    A pointer to the current value 
- * @return         If the current iterator value is valid
+ * @param target An iterable object
+ * @param index  The index to continue from, starting at 0, which is moved past the value
+ * @param value  A pointer to the next value
+ * @return       If there was a next value
  */
-bool iterateObj(ObjIterator* iterator, Value* value) {
-    switch (iterator->target->type) {
-        case OBJ_SET:    return iterateSet(iterator, value);
-        case OBJ_TUPLE:  return iterateTuple(iterator, value);
-        case OBJ_STRING: return iterateString(iterator, value);
+bool iterateObj(Obj* target, size_t* index, Value* value) {
+    assert(target->isIterable);
+
+    switch (target->type) {
+        case OBJ_SET:    return iterateSet((ObjSet*)target, index, value);
+        case OBJ_TUPLE:  return iterateTuple((ObjTuple*)target, index, value);
+        case OBJ_STRING: return iterateString((ObjString*)target, index, value);
+        case OBJ_RANGE:  return iterateRange((ObjRange*)target, index, value);
         default:         return false;
     }
+}
+
+/**
+ * @brief Get the index a generator loop over an object stops at, which no value's index reaches.
+ *
+ * Indices are positions in the object, except that those of a bitset are its elements.
+ */
+size_t iterationEnd(Obj* target) {
+    switch (target->type) {
+        case OBJ_SET: {
+            ObjSet* set = (ObjSet*)target;
+            return set->bits != NULL ? set->bitCapacity * 64 : set->count;
+        }
+        case OBJ_TUPLE:  return ((ObjTuple*)target)->size;
+        case OBJ_STRING: return ((ObjString*)target)->length;
+        case OBJ_RANGE:  return ((ObjRange*)target)->count;
+        default:         return 0;
+    }
 }
\ No newline at end of file
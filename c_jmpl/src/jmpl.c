@@ -0,0 +1,365 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "jmpl.h"
+#include "compiler.h"
+#include "vm.h"
+#include "object.h"
+#include "obj_string.h"
+#include "set.h"
+#include "tuple.h"
+#include "range.h"
+#include "iterator.h"
+#include "gc.h"
+#include "parallel.h"
+
+#define SLOT(vm, slot) (*(assert((slot) >= 0 && (slot) < (vm)->slots.count), &(vm)->slots.values[slot]))
+
+static Handle* newHandle(VM* vm, Value value) {
+    Handle* handle = malloc(sizeof(Handle));
+    if (handle == NULL) exit(INTERNAL_SOFTWARE_ERROR);
+
+    handle->value = value;
+    handle->prev = NULL;
+    handle->next = vm->handles;
+    if (vm->handles != NULL) vm->handles->prev = handle;
+    vm->handles = handle;
+
+    return handle;
+}
+
+// --- VMs ---
+
+/**
+ * @brief Start the threads that large set operations and set-builders of every VM are split across.
+ *
+ * @param count The no. threads, including the calling thread, or 0 for the no. CPUs
+ */
+void jmplInitThreads(int count) {
+    initWorkers(count > 0 ? count : defaultWorkerCount(), PARALLEL_THRESHOLD_DEFAULT, BUILDER_THRESHOLD_DEFAULT);
+}
+
+void jmplFreeThreads(void) {
+    freeWorkers();
+}
+
+JmplVM* jmplNewVM(void) {
+    VM* vm = malloc(sizeof(VM));
+    if (vm == NULL) exit(INTERNAL_SOFTWARE_ERROR);
+
+    initVM(vm);
+    return vm;
+}
+
+void jmplFreeVM(JmplVM* vm) {
+    freeVM(vm);
+    free(vm);
+}
+
+/**
+ * @brief Set the most frames the VM's call stack can hold before a stack overflow error.
+ */
+void jmplSetMaxFrames(JmplVM* vm, int frameLimit) {
+    if (frameLimit > 0) vm->frameLimit = frameLimit;
+}
+
+/**
+ * @brief Set how many milliseconds each step of the VM's incremental marking aims to take.
+ *
+ * Shorter steps keep the pauses of a major collection short, but more of them are needed. 0 marks all at once.
+ */
+void jmplSetGCPause(JmplVM* vm, double milliseconds) {
+    if (milliseconds >= 0) vm->gc.pauseTarget = milliseconds;
+}
+
+/**
+ * @brief Compile and run a script, whose globals stay defined in the VM.
+ */
+JmplResult jmplInterpret(JmplVM* vm, const char* source) {
+    return (JmplResult)interpret(vm, (const unsigned char*)source);
+}
+
+// --- Functions ---
+
+/**
+ * @brief Compile a script into a function that runs it, which can be called any no. times with jmplCall.
+ *
+ * @return A handle to the function, or NULL if the script didn't compile
+ */
+JmplHandle* jmplCompile(JmplVM* vm, const char* source) {
+    ObjFunction* function = compile(vm, (const unsigned char*)source);
+    if (function == NULL) return NULL;
+
+    pushTemp(&vm->gc, OBJ_VAL(function));
+    ObjClosure* closure = newClosure(&vm->gc, function);
+    popTemp(&vm->gc);
+
+    return newHandle(vm, OBJ_VAL(closure));
+}
+
+/**
+ * @brief Put the value of a global variable in a slot.
+ *
+ * @return If the global is defined
+ */
+bool jmplGetGlobal(JmplVM* vm, const char* name, int slot) {
+    ObjString* nameStr = copyString(&vm->gc, (const unsigned char*)name, (int)strlen(name));
+
+    Value index;
+    if (!tableGet(&vm->globalSlots, nameStr, &index)) return false;
+
+    Global* global = &vm->globals[(int)AS_NUMBER(index)];
+    if (!global->isDefined) return false;
+
+    SLOT(vm, slot) = global->value;
+    return true;
+}
+
+/**
+ * @brief Call a function with the values of the first slots as its arguments.
+ *
+ * @param function A handle to a function, native or compiled script
+ * @param argCount The no. arguments, which are in slots 0 up to argCount
+ *
+ * The value it returns is put in slot 0, or null if there was an error.
+ */
+JmplResult jmplCall(JmplVM* vm, JmplHandle* function, int argCount) {
+    assert(argCount <= vm->slots.count);
+    jmplEnsureSlots(vm, 1);
+
+    Value result;
+    InterpretResult status = callFunction(vm, function->value, vm->slots.values, argCount, &result);
+    vm->slots.values[0] = result;
+
+    return (JmplResult)status;
+}
+
+// --- Handles ---
+
+/**
+ * @brief Hold the value in a slot, so it isn't collected until the handle is released.
+ */
+JmplHandle* jmplGetHandle(JmplVM* vm, int slot) {
+    return newHandle(vm, SLOT(vm, slot));
+}
+
+void jmplSetHandle(JmplVM* vm, int slot, JmplHandle* handle) {
+    SLOT(vm, slot) = handle->value;
+}
+
+void jmplReleaseHandle(JmplVM* vm, JmplHandle* handle) {
+    if (handle->prev != NULL) {
+        handle->prev->next = handle->next;
+    } else {
+        vm->handles = handle->next;
+    }
+
+    if (handle->next != NULL) handle->next->prev = handle->prev;
+    free(handle);
+}
+
+// --- Slots ---
+
+/**
+ * @brief Make sure there are at least a no. slots, where new slots are null.
+ */
+void jmplEnsureSlots(JmplVM* vm, int count) {
+    while (vm->slots.count < count) {
+        writeValueArray(&vm->gc, &vm->slots, NULL_VAL);
+    }
+}
+
+int jmplSlotCount(JmplVM* vm) {
+    return vm->slots.count;
+}
+
+JmplType jmplGetType(JmplVM* vm, int slot) {
+    Value value = SLOT(vm, slot);
+
+    if (IS_NULL(value))   return JMPL_TYPE_NULL;
+    if (IS_BOOL(value))   return JMPL_TYPE_BOOL;
+    if (IS_NUMBER(value)) return JMPL_TYPE_NUMBER;
+    if (IS_CHAR(value))   return JMPL_TYPE_CHAR;
+
+    switch (OBJ_TYPE(value)) {
+        case OBJ_STRING:   return JMPL_TYPE_STRING;
+        case OBJ_SET:
+        case OBJ_RANGE:    return JMPL_TYPE_SET;
+        case OBJ_TUPLE:    return JMPL_TYPE_TUPLE;
+        case OBJ_CLOSURE:
+        case OBJ_FUNCTION:
+        case OBJ_NATIVE:   return JMPL_TYPE_FUNCTION;
+        default:           return JMPL_TYPE_OTHER;
+    }
+}
+
+void jmplSetNull(JmplVM* vm, int slot) {
+    SLOT(vm, slot) = NULL_VAL;
+}
+
+void jmplSetBool(JmplVM* vm, int slot, bool value) {
+    SLOT(vm, slot) = BOOL_VAL(value);
+}
+
+void jmplSetNumber(JmplVM* vm, int slot, double value) {
+    SLOT(vm, slot) = NUMBER_VAL(value);
+}
+
+void jmplSetChar(JmplVM* vm, int slot, uint32_t codePoint) {
+    SLOT(vm, slot) = CHAR_VAL(codePoint);
+}
+
+/**
+ * @brief Put a string in a slot.
+ *
+ * @param utf8   A UTF-8 byte sequence, which is copied
+ * @param length The no. bytes of the sequence
+ */
+void jmplSetString(JmplVM* vm, int slot, const char* utf8, size_t length) {
+    SLOT(vm, slot) = OBJ_VAL(copyString(&vm->gc, (const unsigned char*)utf8, (int)length));
+}
+
+/**
+ * @brief Put a tuple of the values of a run of slots in a slot.
+ *
+ * @param first The slot of the first element
+ * @param count The no. elements
+ */
+void jmplSetTuple(JmplVM* vm, int slot, int first, int count) {
+    assert(first >= 0 && first + count <= vm->slots.count);
+
+    ObjTuple* tuple = newTuple(&vm->gc, count);
+    for (int i = 0; i < count; i++) {
+        tuple->elements[i] = vm->slots.values[first + i];
+    }
+
+    SLOT(vm, slot) = OBJ_VAL(tuple);
+}
+
+/**
+ * @brief Put a set of the values of a run of slots in a slot.
+ *
+ * @param first The slot of the first element
+ * @param count The no. values, which may include duplicates
+ */
+void jmplSetSet(JmplVM* vm, int slot, int first, int count) {
+    assert(first >= 0 && first + count <= vm->slots.count);
+
+    ObjSet* set = newSet(&vm->gc);
+    pushTemp(&vm->gc, OBJ_VAL(set));
+
+    for (int i = 0; i < count; i++) {
+        setInsert(&vm->gc, set, vm->slots.values[first + i]);
+    }
+
+    popTemp(&vm->gc);
+    SLOT(vm, slot) = OBJ_VAL(set);
+}
+
+void jmplSetNumberTuple(JmplVM* vm, int slot, const double* numbers, size_t count) {
+    ObjTuple* tuple = newTuple(&vm->gc, count);
+    for (size_t i = 0; i < count; i++) {
+        tuple->elements[i] = NUMBER_VAL(numbers[i]);
+    }
+
+    SLOT(vm, slot) = OBJ_VAL(tuple);
+}
+
+void jmplSetNumberSet(JmplVM* vm, int slot, const double* numbers, size_t count) {
+    ObjSet* set = newSet(&vm->gc);
+    pushTemp(&vm->gc, OBJ_VAL(set));
+
+    for (size_t i = 0; i < count; i++) {
+        setInsert(&vm->gc, set, NUMBER_VAL(numbers[i]));
+    }
+
+    popTemp(&vm->gc);
+    SLOT(vm, slot) = OBJ_VAL(set);
+}
+
+bool jmplGetBool(JmplVM* vm, int slot) {
+    Value value = SLOT(vm, slot);
+    return IS_BOOL(value) && AS_BOOL(value);
+}
+
+double jmplGetNumber(JmplVM* vm, int slot) {
+    Value value = SLOT(vm, slot);
+    return IS_NUMBER(value) ? AS_NUMBER(value) : 0;
+}
+
+uint32_t jmplGetChar(JmplVM* vm, int slot) {
+    Value value = SLOT(vm, slot);
+    return IS_CHAR(value) ? AS_CHAR(value) : 0;
+}
+
+/**
+ * @brief Get the UTF-8 bytes of a string in a slot, which live as long as the string.
+ *
+ * @param length Set to the no. bytes, unless it is NULL
+ * @return       The null-terminated bytes, or NULL if the value isn't a string
+ */
+const char* jmplGetString(JmplVM* vm, int slot, size_t* length) {
+    Value value = SLOT(vm, slot);
+    if (!IS_STRING(value)) return NULL;
+
+    ObjString* string = AS_STRING(value);
+    if (length != NULL) *length = (size_t)string->utf8Length;
+    return (const char*)string->utf8;
+}
+
+/**
+ * @brief Get the no. elements of a set or tuple, or characters of a string, in a slot.
+ */
+size_t jmplGetSize(JmplVM* vm, int slot) {
+    Value value = SLOT(vm, slot);
+    if (!IS_OBJ(value)) return 0;
+
+    switch (OBJ_TYPE(value)) {
+        case OBJ_SET:    return AS_SET(value)->count;
+        case OBJ_RANGE:  return AS_RANGE(value)->count;
+        case OBJ_TUPLE:  return AS_TUPLE(value)->size;
+        case OBJ_STRING: return AS_STRING(value)->length;
+        default:         return 0;
+    }
+}
+
+/**
+ * @brief Put the next element of a set, tuple or string in a slot.
+ *
+ * @param index       The index to continue from, starting at 0, which is moved past the element
+ * @param elementSlot The slot the element is put in
+ * @return            If there was a next element
+ *
+ * Sets give their elements in the order they were added, except sets of small integers, which are in ascending order.
+ */
+bool jmplIterate(JmplVM* vm, int slot, size_t* index, int elementSlot) {
+    Value value = SLOT(vm, slot);
+    if (!IS_OBJ(value) || !AS_OBJ(value)->isIterable) return false;
+
+    Value element;
+    if (!iterateObj(AS_OBJ(value), index, &element)) return false;
+
+    SLOT(vm, elementSlot) = element;
+    return true;
+}
+
+/**
+ * @brief Copy the elements of a set or tuple of numbers in a slot, in the order jmplIterate gives them.
+ *
+ * @param numbers Room for as many numbers as jmplGetSize gives
+ * @return        If the value is a set or tuple whose elements are all numbers
+ */
+bool jmplGetNumbers(JmplVM* vm, int slot, double* numbers) {
+    Value value = SLOT(vm, slot);
+    if (!IS_SET(value) && !IS_RANGE(value) && !IS_TUPLE(value)) return false;
+
+    size_t index = 0;
+    size_t count = 0;
+    Value element;
+    while (iterateObj(AS_OBJ(value), &index, &element)) {
+        if (!IS_NUMBER(element)) return false;
+        numbers[count++] = AS_NUMBER(element);
+    }
+
+    return true;
+}
\ No newline at end of file
@@ -8,6 +8,8 @@
 #include "chunk.h"
 #include "debug.h"
 #include "vm.h"
+#include "memory.h"
+#include "parallel.h"
 
 #define CURRENT_VERSION "0.2.2"
 
@@ -18,7 +20,7 @@
     #include <unistd.h>
 #endif
 
-static void repl() {
+static void repl(VM* vm) {
     printf("JMPL v%s\n", CURRENT_VERSION);
     printf("Note: if using Windows, terminal must be using code page 65001 to properly display mathematical symbols.\n");
 
@@ -32,13 +34,13 @@ static void repl() {
             break;
         }
 
-        interpret(line);
+        interpret(vm, line);
     }
 }
 
-static void runFile(const unsigned char* path) {
+static void runFile(VM* vm, const unsigned char* path) {
     unsigned char* source = readFile(path);
-    InterpretResult result = interpret(source);
+    InterpretResult result = interpret(vm, source);
     free(source);
 
     if (result != INTERPRET_OK) printf("Exited with code %d.\n", result);
@@ -46,22 +48,75 @@ static void runFile(const unsigned char* path) {
     if (result == INTERPRET_RUNTIME_ERROR) exit(INTERNAL_SOFTWARE_ERROR);
 }
 
+static void usage() {
+    fprintf(stderr, "Usage: jmpl [--max-frames n] [--threads n] [--parallel-threshold n] [--builder-threshold n] [--gc-pause ms] [--gc-stats] [path]\n");
+    exit(COMMAND_LINE_USAGE_ERROR);
+}
+
 int main(int argc, const char* argv[]) {
     srand(time(NULL) ^ getpid());
 
-    initVM();
+    const char* path = NULL;
+    int frameLimit = FRAMES_LIMIT_DEFAULT;
+    int threads = defaultWorkerCount();
+    long threshold = PARALLEL_THRESHOLD_DEFAULT;
+    long builderThreshold = BUILDER_THRESHOLD_DEFAULT;
+    double gcPause = GC_PAUSE_DEFAULT;
+    bool gcStats = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--max-frames") == 0) {
+            if (i + 1 == argc) usage();
+
+            frameLimit = atoi(argv[++i]);
+            if (frameLimit <= 0) usage();
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            if (i + 1 == argc) usage();
+
+            threads = atoi(argv[++i]);
+            if (threads <= 0) usage();
+        } else if (strcmp(argv[i], "--parallel-threshold") == 0) {
+            if (i + 1 == argc) usage();
+
+            threshold = atol(argv[++i]);
+            if (threshold <= 0) usage();
+        } else if (strcmp(argv[i], "--builder-threshold") == 0) {
+            if (i + 1 == argc) usage();
+
+            builderThreshold = atol(argv[++i]);
+            if (builderThreshold <= 0) usage();
+        } else if (strcmp(argv[i], "--gc-pause") == 0) {
+            if (i + 1 == argc) usage();
 
-    if (argc == 1) {
+            gcPause = atof(argv[++i]);
+            if (gcPause < 0) usage();
+        } else if (strcmp(argv[i], "--gc-stats") == 0) {
+            gcStats = true;
+        } else if (path == NULL) {
+            path = argv[i];
+        } else {
+            usage();
+        }
+    }
+
+    VM vm;
+    initVM(&vm);
+    vm.frameLimit = frameLimit;
+    vm.gc.pauseTarget = gcPause;
+    initWorkers(threads, (size_t)threshold, (size_t)builderThreshold);
+
+    if (path == NULL) {
         // If no file argument, run the REPL
-        repl();
-    } else if(argc == 2) {
-        // If there's a file argument, run the file
-        runFile(argv[1]);
+        repl(&vm);
     } else {
-        fprintf(stderr, "Usage: jmpl [path]\n");
-        exit(COMMAND_LINE_USAGE_ERROR);
+        // If there's a file argument, run the file
+        runFile(&vm, path);
     }
 
-    freeVM();
+    // Printed to stderr so the program's own output is unchanged
+    if (gcStats) printGCStats(&vm.gc, stderr);
+
+    freeVM(&vm);
+    freeWorkers();
     return 0;
 }
\ No newline at end of file
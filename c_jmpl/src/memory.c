@@ -1,31 +1,35 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 
 #include "compiler.h"
 #include "memory.h"
 #include "set.h"
+#include "hamt.h"
 #include "obj_string.h"
 #include "tuple.h"
 #include "vm.h"
-#include "iterator.h"
+#include "range.h"
+#include "utils.h"
 
 #ifdef DEBUG_LOG_GC
 #include <stdio.h>
 #include "debug.h"
 #endif
 
+#define MARK_BATCH_SIZE 64 // No. objects blackened between checks of a marking step's time
+
+static void runCollector(GC* gc);
+
 /**
  * @brief Function for dynamic memory reallocation in c_jmpl.
  */
 void* reallocate(GC* gc, void* pointer, size_t oldSize, size_t newSize) {
-    gc->bytesAllocated += newSize - oldSize;
     if (newSize > oldSize) {
-#ifdef DEBUG_STRESS_GC
-        collectGarbage(gc);
-#endif
-        if (gc->bytesAllocated > gc->nextGC) {
-            collectGarbage(gc);
-        }
+        addAllocated(gc, newSize - oldSize);
+    } else {
+        gc->bytesAllocated -= oldSize - newSize;
     }
 
     if (newSize == 0) {
@@ -39,16 +43,29 @@ void* reallocate(GC* gc, void* pointer, size_t oldSize, size_t newSize) {
     return result;
 }
 
+/**
+ * @brief Count bytes being allocated, running the collector once enough have been since it last ran.
+ */
+void addAllocated(GC* gc, size_t size) {
+    gc->bytesAllocated += size;
+    gc->youngBytes += size;
+#ifdef DEBUG_STRESS_GC
+    runCollector(gc);
+#else
+    if (gc->youngBytes > gc->stepAt) runCollector(gc);
+#endif
+}
+
 void markObject(GC* gc, Obj* object) {
     if (object == NULL) return;
-    if (object->isMarked) return;
+    if (isMarked(object)) return;
 
 #ifdef DEBUG_LOG_GC
     printf("%p mark ", (void*)object);
     printValue(OBJ_VAL(object), true);
     printf("\n");
 #endif
-    object->isMarked = true;
+    setBit(PAGE_MARKED(pageOf(object)), granuleOf(object));
 
     // Marking roots using the tricolour abstraction
     if (gc->greyCapacity < gc->greyCount + 1) {
@@ -61,6 +78,20 @@ void markObject(GC* gc, Obj* object) {
     gc->greyStack[gc->greyCount++] = object;
 }
 
+/**
+ * @brief Add a marked object to the remembered set, so the next minor collection or marking step traces it again.
+ */
+void rememberObject(GC* gc, Obj* object) {
+    if (gc->rememberedCapacity < gc->rememberedCount + 1) {
+        gc->rememberedCapacity = GROW_CAPACITY(gc->rememberedCapacity);
+        gc->remembered = (Obj**)realloc(gc->remembered, sizeof(Obj*) * gc->rememberedCapacity);
+        if (gc->remembered == NULL) exit(INTERNAL_SOFTWARE_ERROR);
+    }
+
+    object->isRemembered = true;
+    gc->remembered[gc->rememberedCount++] = object;
+}
+
 void markValue(GC* gc, Value value) {
     if (IS_OBJ(value)) markObject(gc, AS_OBJ(value));
 }
@@ -95,6 +126,7 @@ static void blackenObject(GC* gc, Obj* object) {
         }
         case OBJ_MODULE: {
             ObjModule* module = (ObjModule*)object;
+            markObject(gc, (Obj*)module->name);
             markTable(gc, &module->globals);
             break;
         }
@@ -104,14 +136,20 @@ static void blackenObject(GC* gc, Obj* object) {
         }
         case OBJ_SET: {
             ObjSet* set = (ObjSet*)object;
-            for (int i = 0; i < set->capacity; i++) {
+            if (set->root != NULL) {
+                markObject(gc, (Obj*)set->root);
+                break;
+            }
+
+            if (set->bits != NULL) break;
+
+            for (size_t i = 0; i < set->count; i++) {
                 markValue(gc, getSetValue(set, i));
             }
             break;
         }
-        case OBJ_ITERATOR: {
-            ObjIterator* iterator = (ObjIterator*)object;
-            markObject(gc, (Obj*)iterator->target);
+        case OBJ_SET_NODE: {
+            markSetNode(gc, (ObjSetNode*)object);
             break;
         }
         case OBJ_TUPLE: {
@@ -123,6 +161,7 @@ static void blackenObject(GC* gc, Obj* object) {
         }
         case OBJ_NATIVE:
         case OBJ_STRING:
+        case OBJ_RANGE:
         default:
             break;
     }
@@ -137,72 +176,83 @@ static void freeObject(GC* gc, Obj* object) {
         case OBJ_CLOSURE: {
             ObjClosure* closure = (ObjClosure*)object;
             FREE_ARRAY(gc, ObjUpvalue*, closure->upvalues, closure->upvalueCount);
-            FREE(gc, ObjClosure, object);
             break;
         }
         case OBJ_FUNCTION: {
             ObjFunction* function = (ObjFunction*)object;
             freeChunk(gc, &function->chunk);
-            FREE(gc, ObjFunction, object);
-            break;
-        }
-        case OBJ_NATIVE: {
-            FREE(gc, ObjNative, object);
             break;
         }
         case OBJ_MODULE: {
             ObjModule* module = (ObjModule*)object;
             freeTable(gc, &module->globals);
-            FREE(gc, ObjModule, object);
             break;
         }
         case OBJ_STRING: {
             freeString(gc, (ObjString*)object);
             break;
         }
-        case OBJ_UPVALUE: {
-            FREE(gc, ObjUpvalue, object);
-            break;
-        }
         case OBJ_SET: {
             freeSet(gc, (ObjSet*)object);
             break;
         }
-        case OBJ_ITERATOR: {
-            freeIterator(gc, (ObjIterator*)object);
-            break;
-        }
-        case OBJ_TUPLE: {
-            ObjTuple* tuple = (ObjTuple*)object;
-            FREE_ARRAY(gc, Value, tuple->elements, tuple->size);
-            FREE(gc, ObjTuple, object);
+        case OBJ_NATIVE:
+        case OBJ_UPVALUE:
+        case OBJ_TUPLE:
+        case OBJ_SET_NODE:
+        case OBJ_RANGE:
             break;
-        }
     }
+
+    releaseSlot(gc, object);
 }
 
-static void markRoots(GC* gc) {
+/**
+ * @brief Mark the roots of the VM.
+ *
+ * @param isMinor If only young objects are being collected, or marking is being finished, so roots that can only
+ *                reference old objects are skipped
+ */
+static void markRoots(GC* gc, bool isMinor) {
+    VM* vm = gc->vm;
+
     for (int i = 0; i < gc->tempCount; i++) {
         markValue(gc, gc->tempStack[i]);
     }
     
-    for (Value* slot = vm.stack; slot < vm.stackTop; slot++) {
+    for (Value* slot = vm->stack; slot < vm->stackTop; slot++) {
         markValue(gc, *slot);
     }
 
-    for (int i = 0; i < vm.frameCount; i++) {
-        markObject(gc, (Obj*)vm.frames[i].closure);
+    for (int i = 0; i < vm->frameCount; i++) {
+        markObject(gc, (Obj*)vm->frames[i].closure);
     }
 
-    for (ObjUpvalue* upvalue = vm.openUpvalues; upvalue != NULL; upvalue = upvalue->next) {
+    for (ObjUpvalue* upvalue = vm->openUpvalues; upvalue != NULL; upvalue = upvalue->next) {
         markObject(gc, (Obj*)upvalue);
     }
 
-    markValue(gc, vm.impReturnStash);
+    markValue(gc, vm->impReturnStash);
 
-    markTable(gc, &vm.globals);
-    markTable(gc, &vm.strings);
-    markCompilerRoots();
+    // Globals are roots rather than objects, so storing to one needs no write barrier
+    for (int i = 0; i < vm->globalCount; i++) {
+        markObject(gc, (Obj*)vm->globals[i].name);
+        markValue(gc, vm->globals[i].value);
+    }
+
+    markArray(gc, &vm->slots);
+    for (Handle* handle = vm->handles; handle != NULL; handle = handle->next) {
+        markValue(gc, handle->value);
+    }
+
+    markTable(gc, &vm->modules);
+    markCompilerRoots(gc);
+
+    // Strings are always old and are marked when they are allocated, and the global slots map them to numbers
+    if (isMinor) return;
+
+    markTable(gc, &vm->globalSlots);
+    markTable(gc, &vm->strings);
 }
 
 static void traceReferences(GC* gc) {
@@ -212,42 +262,286 @@ static void traceReferences(GC* gc) {
     }
 }
 
-static void sweep(GC* gc) {
-    Obj* previous = NULL;
-    Obj* object = gc->objects;
+/**
+ * @brief Free the objects of a page that are in a bitmap but aren't marked, without reading the rest.
+ */
+static void freeUnmarked(GC* gc, Page* page, const uint64_t* bitmap) {
+    uint64_t* marked = PAGE_MARKED(page);
 
-    while (object != NULL) {
-        if (object->isMarked) {
-            object->isMarked = false;
-            previous = object;
-            object = object->next;
-        } else {
-            Obj* unreached = object;
-            object = object->next;
+    for (uint32_t i = 0; i < page->words; i++) {
+        uint64_t unmarked = bitmap[i] & ~marked[i];
 
-            if(previous != NULL) {
-                previous->next = object;
+        while (unmarked != 0) {
+            uint32_t bit = (uint32_t)countTrailingZeros(unmarked);
+            unmarked &= unmarked - 1;
+            freeObject(gc, objectAt(page, i * 64 + bit));
+        }
+    }
+}
+
+/**
+ * @brief Free the unmarked objects of a page, leaving the rest marked.
+ */
+void sweepPage(GC* gc, Page* page) {
+    freeUnmarked(gc, page, PAGE_ALLOCATED(page));
+}
+
+/**
+ * @brief Sweep the pages that haven't been swept since the last major collection, freeing any that are empty.
+ */
+static void finishSweeping(GC* gc) {
+    if (!gc->isSweeping) return;
+
+    for (int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        SizeClass* class = &gc->classes[i];
+
+        while (class->unswept.first != NULL) {
+            Page* page = class->unswept.first;
+            unlinkPage(&class->unswept, page);
+            sweepPage(gc, page);
+
+            if (page->liveCount == 0) {
+                freePage(page);
             } else {
-                gc->objects = object;
+                appendPage(&class->pages, page);
             }
+        }
+
+        // The free slots may be in the pages that were freed
+        class->free = NULL;
+        class->bump = NULL;
+        class->bumpEnd = NULL;
+        class->current = class->pages.first;
+    }
 
-            freeObject(gc, unreached);
+    // What was allocated since marking finished is young
+    size_t oldBytes = gc->bytesAllocated > gc->youngBytes ? gc->bytesAllocated - gc->youngBytes : 0;
+    gc->nextGC = oldBytes * GC_HEAP_GROW_FACTOR;
+    gc->isSweeping = false;
+}
+
+/**
+ * @brief Free the unmarked young objects, and unmark the rest unless they are promoted.
+ *
+ * @param isPromoting If the survivors are promoted to old, which stay marked
+ */
+static void sweepYoung(GC* gc, bool isPromoting) {
+    int count = 0;
+
+    for (int i = 0; i < gc->youngPageCount; i++) {
+        Page* page = gc->youngPages[i];
+        uint64_t* young = PAGE_YOUNG(page);
+        uint64_t* marked = PAGE_MARKED(page);
+
+        freeUnmarked(gc, page, young);
+
+        // A large page's only object was young, so it is either promoted, kept young or freed with its page
+        if (page->liveCount == 0 && page->slotCount == 1) {
+            unlinkPage(&gc->largePages, page);
+            freePage(page);
+            continue;
+        }
+
+        bool isYoung = false;
+        for (uint32_t j = 0; j < page->words; j++) {
+            if (isPromoting) {
+#ifdef DEBUG_GC_STATS
+                gc->promotedCount += popCount(young[j]);
+#endif
+                young[j] = 0;
+            } else {
+                marked[j] &= ~young[j];
+                isYoung |= young[j] != 0;
+            }
         }
+
+        page->isYoung = isYoung;
+        if (isYoung) gc->youngPages[count++] = page;
     }
+
+    gc->youngPageCount = count;
+
+    // Slots may have been freed in any page
+    for (int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        gc->classes[i].current = gc->classes[i].pages.first;
+    }
+
+    gc->youngBytes = 0;
+    gc->stepAt = NURSERY_SIZE;
+    gc->youngAge = isPromoting ? 0 : gc->youngAge + 1;
 }
 
-void collectGarbage(GC* gc) {
+/**
+ * @brief Empty the remembered set once marking is done and the young objects are to be promoted.
+ */
+static void forgetRemembered(GC* gc) {
+    for (int i = 0; i < gc->rememberedCount; i++) {
+        gc->remembered[i]->isRemembered = false;
+    }
+    gc->rememberedCount = 0;
+}
+
+/**
+ * @brief Remember the old temps, as C code may still be filling them in without write barriers.
+ */
+static void rememberTemps(GC* gc) {
+    for (int i = 0; i < gc->tempCount; i++) {
+        if (IS_OBJ(gc->tempStack[i])) writeBarrier(gc, AS_OBJ(gc->tempStack[i]));
+    }
+}
+
+// The longest pause of each bucket of the histogram, in milliseconds, with a last bucket for longer ones
+static const double pauseBuckets[GC_PAUSE_BUCKETS - 1] = {0.1, 0.25, 0.5, 1, 2, 5, 10, 25, 50, 100};
+
+static double recordPause(GC* gc, clock_t start) {
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    int bucket = 0;
+    while (bucket < GC_PAUSE_BUCKETS - 1 && seconds * 1000 > pauseBuckets[bucket]) bucket++;
+    gc->pauses[bucket]++;
+
+    if (seconds > gc->longestPause) gc->longestPause = seconds;
+    return seconds;
+}
+
+/**
+ * @brief Collect only the young objects.
+ */
+static void collectYoung(GC* gc) {
+#ifdef DEBUG_LOG_GC
+    printf("-- minor gc begin\n");
+    size_t before = gc->bytesAllocated;
+#endif
+    clock_t start = clock();
+
+    finishSweeping(gc);
+    markRoots(gc, true);
+
+    // Old objects are already marked, so only the young objects that remembered ones reference are traced
+    for (int i = 0; i < gc->rememberedCount; i++) {
+        blackenObject(gc, gc->remembered[i]);
+    }
+
+    traceReferences(gc);
+
+    // Until they are promoted, the young objects may still be referenced by the remembered ones
+    bool isPromoting = gc->youngAge + 1 >= PROMOTION_AGE;
+    if (isPromoting) forgetRemembered(gc);
+
+    sweepYoung(gc, isPromoting);
+    rememberTemps(gc);
+
+    gc->minorCount++;
+    gc->minorSeconds += recordPause(gc, start);
+
+#ifdef DEBUG_LOG_GC
+    printf("-- minor gc end\n");
+    printf("   collected %zu bytes (from %zu to %zu)\n", before - gc->bytesAllocated, before, gc->bytesAllocated);
+#endif
+}
+
+/**
+ * @brief Make every young object old once a major collection has marked them, leaving the unmarked ones to be swept.
+ */
+static void promoteYoung(GC* gc) {
+    for (int i = 0; i < gc->youngPageCount; i++) {
+        Page* page = gc->youngPages[i];
+        uint64_t* young = PAGE_YOUNG(page);
+
+        for (uint32_t j = 0; j < page->words; j++) {
+#ifdef DEBUG_GC_STATS
+            gc->promotedCount += popCount(young[j] & PAGE_MARKED(page)[j]);
+#endif
+            young[j] = 0;
+        }
+        page->isYoung = false;
+    }
+
+    gc->youngPageCount = 0;
+    gc->youngBytes = 0;
+    gc->stepAt = NURSERY_SIZE;
+    gc->youngAge = 0;
+}
+
+static void clearMarks(PageList* list) {
+    for (Page* page = list->first; page != NULL; page = page->next) {
+        memset(PAGE_MARKED(page), 0, page->words * sizeof(uint64_t));
+    }
+}
+
+/**
+ * @brief Start a major collection by unmarking every object and marking the roots.
+ *
+ * Minor collections are suspended until marking is finished, so the remembered set only holds the objects that
+ * change after they are marked.
+ */
+static void startMarking(GC* gc) {
 #ifdef DEBUG_LOG_GC
     printf("-- gc begin\n");
+#endif
+
+    // The pages being swept still need their marks
+    finishSweeping(gc);
+    forgetRemembered(gc);
+
+    for (int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        clearMarks(&gc->classes[i].pages);
+    }
+    clearMarks(&gc->largePages);
+
+    markRoots(gc, false);
+    gc->isMarking = true;
+    gc->markStart = gc->youngBytes;
+}
+
+/**
+ * @brief Finish a major collection, marking the roots again and tracing whatever has changed, then promote every
+ * young object that survived.
+ *
+ * Large objects are freed now, and the pages of small ones are left to be swept lazily.
+ */
+static void finishMarking(GC* gc) {
+#ifdef DEBUG_LOG_GC
     size_t before = gc->bytesAllocated;
 #endif
 
-    markRoots(gc);
+    // The roots were only marked at the start, and the remembered objects have changed since they were traced
+    markRoots(gc, true);
+    for (int i = 0; i < gc->rememberedCount; i++) {
+        blackenObject(gc, gc->remembered[i]);
+    }
+
     traceReferences(gc);
-    tableRemoveWhite(&vm.strings);
-    sweep(gc);
-    
-    gc->nextGC = gc->bytesAllocated * GC_HEAP_GROW_FACTOR;
+    tableRemoveWhite(&gc->vm->strings);
+    forgetRemembered(gc);
+    promoteYoung(gc);
+
+    for (Page* page = gc->largePages.first; page != NULL;) {
+        Page* next = page->next;
+        sweepPage(gc, page);
+
+        if (page->liveCount == 0) {
+            unlinkPage(&gc->largePages, page);
+            freePage(page);
+        }
+        page = next;
+    }
+
+    for (int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        SizeClass* class = &gc->classes[i];
+        class->unswept = class->pages;
+        class->pages = (PageList){NULL, NULL};
+        class->current = NULL;
+        class->free = NULL;
+        class->bump = NULL;
+        class->bumpEnd = NULL;
+    }
+    gc->isSweeping = true;
+    rememberTemps(gc);
+
+    gc->isMarking = false;
+
+    gc->majorCount++;
 
 #ifdef DEBUG_LOG_GC
     printf("-- gc end\n");
@@ -255,14 +549,149 @@ void collectGarbage(GC* gc) {
 #endif
 }
 
+/**
+ * @brief Blacken grey objects until there are none left or the step has taken the pause target.
+ *
+ * @return If marking is finished
+ */
+static bool markStep(GC* gc) {
+    clock_t start = clock();
+    clock_t budget = (clock_t)(gc->pauseTarget * CLOCKS_PER_SEC / 1000);
+
+    do {
+        // The objects that changed since they were marked are traced again once everything else has been
+        if (gc->greyCount == 0) {
+            for (int i = 0; i < gc->rememberedCount; i++) {
+                gc->remembered[i]->isRemembered = false;
+                blackenObject(gc, gc->remembered[i]);
+            }
+            gc->rememberedCount = 0;
+            if (gc->greyCount == 0) return true;
+        }
+
+        for (int i = 0; i < MARK_BATCH_SIZE && gc->greyCount > 0; i++) {
+            blackenObject(gc, gc->greyStack[--gc->greyCount]);
+        }
+    } while (clock() - start < budget);
+
+    return false;
+}
+
+/**
+ * @brief Run the collector once enough has been allocated since it last ran.
+ *
+ * A major collection starts once what survived the nursery has outgrown the limit, and then marks a step at a time,
+ * with finishing done in one pause and sweeping left until the next minor collection. If the program allocates faster than marking keeps up, as much as
+ * the heap held when marking started, the rest is marked at once.
+ */
+static void runCollector(GC* gc) {
+    // A worker can't see the roots of the VM it works for, so its objects are collected once it hands them back.
+    // Until then, it gives up on its chunk as soon as it has allocated more than its budget
+    if (gc->vm->isWorker) {
+        if (gc->bytesAllocated > gc->budget) longjmp(*gc->vm->overBudget, 1);
+        return;
+    }
+
+    clock_t start = clock();
+
+    if (!gc->isMarking) {
+        // What survived the nursery is only known once the last major collection has been swept
+        if (gc->isSweeping || gc->bytesAllocated <= gc->youngBytes || gc->bytesAllocated - gc->youngBytes <= gc->nextGC) {
+            collectYoung(gc);
+            return;
+        }
+
+        startMarking(gc);
+    }
+
+    bool isFinished = gc->pauseTarget <= 0 || gc->youngBytes - gc->markStart > gc->nextGC;
+    if (!isFinished) isFinished = markStep(gc);
+
+    if (isFinished) {
+        finishMarking(gc);
+    } else {
+        rememberTemps(gc);
+        gc->stepAt = gc->youngBytes + MARK_STEP_SIZE;
+    }
+
+    gc->stepCount++;
+    gc->majorSeconds += recordPause(gc, start);
+}
+
+/**
+ * @brief Collect the objects of both generations at once, finishing a major collection that is marking.
+ */
+void collectGarbage(GC* gc) {
+    if (gc->vm->isWorker) return;
+
+    clock_t start = clock();
+
+    if (!gc->isMarking) startMarking(gc);
+    traceReferences(gc);
+    finishMarking(gc);
+
+    gc->majorSeconds += recordPause(gc, start);
+}
+
+static void freePages(GC* gc, PageList* list) {
+    Page* page = list->first;
+
+    while (page != NULL) {
+        Page* next = page->next;
+
+        // Every object is freed, marked or not
+        uint64_t* allocated = PAGE_ALLOCATED(page);
+        for (uint32_t i = 0; i < page->words; i++) {
+            uint64_t bits = allocated[i];
+
+            while (bits != 0) {
+                uint32_t bit = (uint32_t)countTrailingZeros(bits);
+                bits &= bits - 1;
+                freeObject(gc, objectAt(page, i * 64 + bit));
+            }
+        }
+
+        freePage(page);
+        page = next;
+    }
+
+    list->first = NULL;
+    list->last = NULL;
+}
+
 void freeObjects(GC* gc) {
-    Obj* object = gc->objects;
-    
-    while (object != NULL) {
-        Obj* next = object->next;
-        freeObject(gc, object);
-        object = next;
+    for (int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        freePages(gc, &gc->classes[i].pages);
+        freePages(gc, &gc->classes[i].unswept);
+        gc->classes[i].current = NULL;
+        gc->classes[i].free = NULL;
+        gc->classes[i].bump = NULL;
+        gc->classes[i].bumpEnd = NULL;
     }
+    freePages(gc, &gc->largePages);
+    gc->youngPageCount = 0;
 
     free(gc->greyStack);
+}
+
+void printGCStats(GC* gc, FILE* file) {
+    fprintf(file, "------- GC Stats -------\n");
+    fprintf(file, "Minor collections: %-10llu time: %.3fs\n", (unsigned long long)gc->minorCount, gc->minorSeconds);
+    fprintf(file, "Major collections: %-10llu time: %.3fs\n", (unsigned long long)gc->majorCount, gc->majorSeconds);
+    fprintf(file, "Marking steps: %llu\n", (unsigned long long)gc->stepCount);
+#ifdef DEBUG_GC_STATS
+    fprintf(file, "Promoted objects: %llu\n", (unsigned long long)gc->promotedCount);
+#endif
+    fprintf(file, "Pause target: %.3fms\n", gc->pauseTarget);
+    fprintf(file, "Longest pause: %.3fms\n", gc->longestPause * 1000);
+
+    fprintf(file, "Pauses:\n");
+    for (int i = 0; i < GC_PAUSE_BUCKETS; i++) {
+        if (i < GC_PAUSE_BUCKETS - 1) {
+            fprintf(file, "  <= %6.2fms: %llu\n", pauseBuckets[i], (unsigned long long)gc->pauses[i]);
+        } else {
+            fprintf(file, "  >  %6.2fms: %llu\n", pauseBuckets[i - 1], (unsigned long long)gc->pauses[i]);
+        }
+    }
+    fprintf(file, "------------------------\n");
 }
\ No newline at end of file
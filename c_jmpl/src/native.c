@@ -5,6 +5,7 @@
 #include <time.h>
 
 #include "common.h"
+#include "memory.h"
 #include "object.h"
 #include "value.h"
 #include "obj_string.h"
@@ -32,20 +33,41 @@
  * @param name     The name of the function in JMPL
  * @param arity    How many parameters it should have
  * @param function The C function that is called
+ * @param isPure   If it has no side effects and makes no strings, so a parallel set-builder can call it
  */
-static void defineNative(ObjModule* module, const unsigned char* name, int arity, NativeFn function) {
-    ObjString* nameStr = copyString(&vm.gc, name, (int)strlen(name));
-    pushTemp(&vm.gc, OBJ_VAL(nameStr));
-    ObjNative* native = newNative(&vm.gc, function, arity);
-    pushTemp(&vm.gc, OBJ_VAL(native));
+static void defineNative(VM* vm, ObjModule* module, const unsigned char* name, int arity, NativeFn function, bool isPure) {
+    ObjString* nameStr = copyString(&vm->gc, name, (int)strlen(name));
+    pushTemp(&vm->gc, OBJ_VAL(nameStr));
+    ObjNative* native = newNative(&vm->gc, function, arity, isPure);
+    pushTemp(&vm->gc, OBJ_VAL(native));
+
+    tableSet(&vm->gc, &module->globals, nameStr, OBJ_VAL(native));
+    writeBarrier(&vm->gc, (Obj*)module);
+    popTemp(&vm->gc);
+    popTemp(&vm->gc); 
+}
+
+/**
+ * @brief Makes a module for a library and adds it to the VM's modules, which keep it alive while it is defined.
+ */
+static ObjModule* defineLibrary(VM* vm, const unsigned char* name) {
+    ObjString* nameStr = copyString(&vm->gc, name, (int)strlen(name));
+    pushTemp(&vm->gc, OBJ_VAL(nameStr));
+    ObjModule* module = newModule(&vm->gc, nameStr);
+    pushTemp(&vm->gc, OBJ_VAL(module));
+
+    tableSet(&vm->gc, &vm->modules, nameStr, OBJ_VAL(module));
+    popTemp(&vm->gc);
+    popTemp(&vm->gc);
 
-    tableSet(&vm.gc, &module->globals, nameStr, OBJ_VAL(native));
-    popTemp(&vm.gc);
-    popTemp(&vm.gc); 
+    return module;
 }
 
-void loadModule(ObjModule* module) {
-    tableAddAll(&vm.gc, &module->globals, &vm.globals);
+void loadModule(VM* vm, ObjModule* module) {
+    for (int i = 0; i < module->globals.capacity; i++) {
+        Entry* entry = &module->globals.entries[i];
+        if (entry->key != NULL) defineGlobal(vm, entry->key, entry->value);
+    }
 }
 
 // ==============================================================
@@ -174,6 +196,7 @@ DEF_NATIVE(type) {
             case OBJ_CLOSURE:  str = "FUNCTION"; break;
             case OBJ_NATIVE:   str = "NATIVE";   break;
             case OBJ_SET:      str = "SET";      break;
+            case OBJ_RANGE:    str = "SET";      break;
             case OBJ_TUPLE:    str = "TUPLE";    break;
             case OBJ_STRING:   str = "STRING";   break;
             default:           str = "UNKNOWN";  break;
@@ -244,29 +267,24 @@ DEF_NATIVE(char) {
 /**
  * @brief Define the natives in the core library.
  */
-ObjModule* defineCoreLibrary() {
-    unsigned char* name = "core";
-    ObjModule* core = newModule(&vm.gc, copyString(&vm.gc, name, strlen(name)));
+ObjModule* defineCoreLibrary(VM* vm) {
+    ObjModule* core = defineLibrary(vm, "core");
     
     // General purpose
-    defineNative(core, "clock", 0, LOAD_NATIVE(clock));
-    defineNative(core, "sleep", 1, LOAD_NATIVE(sleep));
+    defineNative(vm, core, "clock", 0, LOAD_NATIVE(clock), false);
+    defineNative(vm, core, "sleep", 1, LOAD_NATIVE(sleep), false);
 
     // I/O
-    defineNative(core, "print", 1, LOAD_NATIVE(print));
-    defineNative(core, "println", 1, LOAD_NATIVE(println));
+    defineNative(vm, core, "print", 1, LOAD_NATIVE(print), false);
+    defineNative(vm, core, "println", 1, LOAD_NATIVE(println), false);
 
-    defineNative(core, "input", 0, LOAD_NATIVE(input));
+    defineNative(vm, core, "input", 0, LOAD_NATIVE(input), false);
 
     // Types
-    defineNative(core, "type", 1, LOAD_NATIVE(type));
-    defineNative(core, "num", 1, LOAD_NATIVE(num));
-    defineNative(core, "str", 1, LOAD_NATIVE(str));
-    defineNative(core, "char", 1, LOAD_NATIVE(char));
-
-    pushTemp(&vm.gc, OBJ_VAL(core));
-    tableSet(&vm.gc, &vm.modules, core->name, OBJ_VAL(core));
-    popTemp(&vm.gc);
+    defineNative(vm, core, "type", 1, LOAD_NATIVE(type), false);
+    defineNative(vm, core, "num", 1, LOAD_NATIVE(num), true);
+    defineNative(vm, core, "str", 1, LOAD_NATIVE(str), false);
+    defineNative(vm, core, "char", 1, LOAD_NATIVE(char), true);
 
     return core;
 }
@@ -473,33 +491,28 @@ DEF_NATIVE(round) {
 /**
  * @brief Define the natives in the maths library.
  */
-ObjModule* defineMathLibrary() {
-    unsigned char* name = "math";
-    ObjModule* math = newModule(&vm.gc, copyString(&vm.gc, name, strlen(name)));
+ObjModule* defineMathLibrary(VM* vm) {
+    ObjModule* math = defineLibrary(vm, "math");
 
     // Constants
-    defineNative(math, "pi", 0, LOAD_NATIVE(pi));
-    defineNative(math, "e", 0, LOAD_NATIVE(e));
-    defineNative(math, "epsilon", 0, LOAD_NATIVE(epsilon));
+    defineNative(vm, math, "pi", 0, LOAD_NATIVE(pi), true);
+    defineNative(vm, math, "e", 0, LOAD_NATIVE(e), true);
+    defineNative(vm, math, "epsilon", 0, LOAD_NATIVE(epsilon), true);
 
     // Trigonometry
-    defineNative(math, "sin", 1, LOAD_NATIVE(sin));
-    defineNative(math, "cos", 1, LOAD_NATIVE(cos));
-    defineNative(math, "tan", 1, LOAD_NATIVE(tan));
-    defineNative(math, "arcsin", 1, LOAD_NATIVE(arcsin));
-    defineNative(math, "arccos", 1, LOAD_NATIVE(arccos));
-    defineNative(math, "arctan", 1, LOAD_NATIVE(arctan));
+    defineNative(vm, math, "sin", 1, LOAD_NATIVE(sin), true);
+    defineNative(vm, math, "cos", 1, LOAD_NATIVE(cos), true);
+    defineNative(vm, math, "tan", 1, LOAD_NATIVE(tan), true);
+    defineNative(vm, math, "arcsin", 1, LOAD_NATIVE(arcsin), true);
+    defineNative(vm, math, "arccos", 1, LOAD_NATIVE(arccos), true);
+    defineNative(vm, math, "arctan", 1, LOAD_NATIVE(arctan), true);
 
     // Misc.
-    defineNative(math, "max", 2, LOAD_NATIVE(max));
-    defineNative(math, "min", 2, LOAD_NATIVE(min));
-    defineNative(math, "floor", 1, LOAD_NATIVE(floor));
-    defineNative(math, "ceil", 1, LOAD_NATIVE(ceil));
-    defineNative(math, "round", 1, LOAD_NATIVE(round));
-
-    pushTemp(&vm.gc, OBJ_VAL(math));
-    tableSet(&vm.gc, &vm.modules, math->name, OBJ_VAL(math));
-    popTemp(&vm.gc);
+    defineNative(vm, math, "max", 2, LOAD_NATIVE(max), true);
+    defineNative(vm, math, "min", 2, LOAD_NATIVE(min), true);
+    defineNative(vm, math, "floor", 1, LOAD_NATIVE(floor), true);
+    defineNative(vm, math, "ceil", 1, LOAD_NATIVE(ceil), true);
+    defineNative(vm, math, "round", 1, LOAD_NATIVE(round), true);
 
     return math;
 }
@@ -517,7 +530,7 @@ DEF_NATIVE(seed) {
     if(!IS_NUMBER(args[0])) return NULL_VAL;
 
     // Set the seed
-    pcg32_srandom((uint64_t)AS_NUMBER(round(args[0])), (intptr_t)&defineRandomLibrary);
+    pcg32_srandom_r(&vm->rng, (uint64_t)AS_NUMBER(round(args[0])), (intptr_t)&defineRandomLibrary);
 
     return NULL_VAL;
 }
@@ -528,7 +541,7 @@ DEF_NATIVE(seed) {
  * Returns a random double between 0 and 1.
  */
 DEF_NATIVE(random) {
-    return NUMBER_VAL(ldexp(pcg32_random(), -32));
+    return NUMBER_VAL(ldexp(pcg32_random_r(&vm->rng), -32));
 }
 
 /**
@@ -543,7 +556,7 @@ DEF_NATIVE(randrange) {
     int min = AS_NUMBER(args[0]);
     int max = AS_NUMBER(args[1]);
 
-    return NUMBER_VAL(ldexp(pcg32_random(), -32) * (max - min + 1) + min);
+    return NUMBER_VAL(ldexp(pcg32_random_r(&vm->rng), -32) * (max - min + 1) + min);
 }
 
 /**
@@ -557,28 +570,23 @@ DEF_NATIVE(randint) {
     int min = (int)(round(AS_NUMBER(args[0])));
     int max = (int)(round(AS_NUMBER(args[1])));
 
-    return NUMBER_VAL(pcg32_boundedrand(max - min + 1) + min);
+    return NUMBER_VAL(pcg32_boundedrand_r(&vm->rng, max - min + 1) + min);
 }
 
 
 /**
  * @brief Define the natives in the random library.
  */
-ObjModule* defineRandomLibrary() {
-    unsigned char* name = "random";
-    ObjModule* random = newModule(&vm.gc, copyString(&vm.gc, name, strlen(name)));
-
-    // Init PRNG
-    pcg32_srandom(time(NULL) ^ getpid(), (intptr_t)&printf);
+ObjModule* defineRandomLibrary(VM* vm) {
+    ObjModule* random = defineLibrary(vm, "random");
 
-    defineNative(random, "seed", 1, LOAD_NATIVE(seed));
-    defineNative(random, "random", 0, LOAD_NATIVE(random));
-    defineNative(random, "randrange", 2, LOAD_NATIVE(randrange));
-    defineNative(random, "randint", 2, LOAD_NATIVE(randint));
+    // Init PRNG, on a stream of its own for each VM
+    pcg32_srandom_r(&vm->rng, time(NULL) ^ getpid(), (intptr_t)vm);
 
-    pushTemp(&vm.gc, OBJ_VAL(random));
-    tableSet(&vm.gc, &vm.modules, random->name, OBJ_VAL(random));
-    popTemp(&vm.gc);
+    defineNative(vm, random, "seed", 1, LOAD_NATIVE(seed), false);
+    defineNative(vm, random, "random", 0, LOAD_NATIVE(random), false);
+    defineNative(vm, random, "randrange", 2, LOAD_NATIVE(randrange), false);
+    defineNative(vm, random, "randint", 2, LOAD_NATIVE(randint), false);
 
     return random;
 }
\ No newline at end of file
@@ -19,8 +19,6 @@ void freeString(GC* gc, ObjString* string) {
         case KIND_2_BYTE: FREE_ARRAY(gc, UCS2, string->as.ucs2, string->length); break;
         case KIND_4_BYTE: FREE_ARRAY(gc, UCS4, string->as.ucs4, string->length); break;
     }
-
-    FREE(gc, ObjString, string);
 }
 
 static void printCodePoints(StringKind kind, const void* codePoints, size_t length) {
@@ -174,7 +172,7 @@ static ObjString* allocateString(GC* gc, StringKind kind, const void* codePoints
     string->utf8Length = utf8Length;
 
     pushTemp(gc, OBJ_VAL(string));
-    tableSet(gc, &vm.strings, string, NULL_VAL);
+    tableSet(gc, &gc->vm->strings, string, NULL_VAL);
     popTemp(gc);
 
     return string;
@@ -192,7 +190,7 @@ static ObjString* allocateString(GC* gc, StringKind kind, const void* codePoints
 ObjString* copyString(GC* gc, const unsigned char* utf8, int utf8Length) {
     hash_t hash = hashString(FNV_INIT_HASH, utf8, utf8Length);
     
-    ObjString* interned = tableFindString(gc, &vm.strings, utf8, utf8Length, hash);
+    ObjString* interned = tableFindString(gc, &gc->vm->strings, utf8, utf8Length, hash);
     if (interned != NULL) {
         return interned;
     }
@@ -227,7 +225,7 @@ static ObjString* stringFromCodePoints(GC* gc, StringKind kind, const void* code
     
     hash_t hash = hashString(FNV_INIT_HASH, utf8, utf8Length);
     
-    ObjString* interned = tableFindString(gc, &vm.strings, utf8, utf8Length, hash);
+    ObjString* interned = tableFindString(gc, &gc->vm->strings, utf8, utf8Length, hash);
     if (interned != NULL) {
         free(utf8);
         return interned;
@@ -265,7 +263,7 @@ static ObjString* stringFromCodePoints(GC* gc, StringKind kind, const void* code
  */
 static ObjString* concatenateStrings(GC* gc, ObjString* a, ObjString* b) {
     hash_t hash = hashString(a->hash, b->utf8, b->utf8Length);
-    Entry* entry = tableFindJoinedStrings(gc, &vm.strings, a->utf8, a->utf8Length, b->utf8, b->utf8Length, hash);
+    Entry* entry = tableFindJoinedStrings(gc, &gc->vm->strings, a->utf8, a->utf8Length, b->utf8, b->utf8Length, hash);
     if (entry->key != NULL) {
         return entry->key;
     }
@@ -298,8 +296,16 @@ static ObjString* concatenateStringAndValue(GC* gc, ObjString* a, Value b, bool
     unsigned char* bUtf8 = valueToString(b);
     int bUtf8Length = strlen(bUtf8);
 
-    hash_t hash = hashString(a->hash, bUtf8, bUtf8Length);
-    Entry* entry = tableFindJoinedStrings(gc, &vm.strings, a->utf8, a->utf8Length, bUtf8, bUtf8Length, hash);
+    Entry* entry;
+    hash_t hash;
+    if (aFirst) {
+        hash = hashString(a->hash, bUtf8, bUtf8Length);
+        entry = tableFindJoinedStrings(gc, &gc->vm->strings, a->utf8, a->utf8Length, bUtf8, bUtf8Length, hash);
+    } else {
+        hash = hashString(hashString(FNV_INIT_HASH, bUtf8, bUtf8Length), a->utf8, a->utf8Length);
+        entry = tableFindJoinedStrings(gc, &gc->vm->strings, bUtf8, bUtf8Length, a->utf8, a->utf8Length, hash);
+    }
+
     if (entry->key != NULL) {
         free(bUtf8);
         return entry->key;
@@ -341,11 +347,11 @@ ObjString* concatenateStringsHelper(GC* gc, Value a, Value b) {
     assert(IS_STRING(a) || IS_STRING(b));
 
     if (IS_STRING(a) && IS_STRING(b)) {
-        return concatenateStrings(&vm.gc, AS_STRING(a), AS_STRING(b));
+        return concatenateStrings(gc, AS_STRING(a), AS_STRING(b));
     } else if (IS_STRING(a)) {
-        return concatenateStringAndValue(&vm.gc, AS_STRING(a), b, true);
+        return concatenateStringAndValue(gc, AS_STRING(a), b, true);
     } else {
-        return concatenateStringAndValue(&vm.gc, AS_STRING(b), a, false);
+        return concatenateStringAndValue(gc, AS_STRING(b), a, false);
     }
 }
 
@@ -7,6 +7,7 @@
 #include "object.h"
 #include "set.h"
 #include "tuple.h"
+#include "range.h"
 #include "table.h"
 #include "obj_string.h"
 #include "value.h"
@@ -14,13 +15,11 @@
 #include "../lib/c-stringbuilder/sb.h"
 
 Obj* allocateObject(GC* gc, size_t size, ObjType type, bool isIterable) {
-    Obj* object = (Obj*)reallocate(gc, NULL, 0, size);
+    // Strings are interned, and the table of them keeps them alive, so they start old
+    Obj* object = allocateSlot(gc, size, type == OBJ_STRING);
     object->type = type;
-    object->isMarked = false;
     object->isIterable = isIterable;
-
-    object->next = gc->objects;
-    gc->objects = object;
+    object->isRemembered = false;
 
 #ifdef DEBUG_LOG_GC
     printf("%p allocate %zu for %d\n", (void*)object, size, type);
@@ -47,13 +46,16 @@ ObjFunction* newFunction(GC* gc) {
     function->arity = 0;
     function->upvalueCount = 0;
     function->name = NULL;
+    function->isPure = false;
+    function->maxStack = 0;
     initChunk(&function->chunk);
     return function;
 }
 
-ObjNative* newNative(GC* gc, NativeFn function, int arity) {
+ObjNative* newNative(GC* gc, NativeFn function, int arity, bool isPure) {
     ObjNative* native = ALLOCATE_OBJ(gc, ObjNative, OBJ_NATIVE, false);
     native->arity = arity;
+    native->isPure = isPure;
     native->function = function;
     return native;
 }
@@ -118,6 +120,9 @@ void printObject(Value value, bool simple) {
                 free(str);
             }
             break;
+        case OBJ_SET_NODE:
+            printf("<set node>");
+            break;
         case OBJ_TUPLE:
             if (simple) {
                 printf("<tuple>");
@@ -127,8 +132,14 @@ void printObject(Value value, bool simple) {
                 free(str);
             }
             break;
-        case OBJ_ITERATOR:
-            printf("<iterator>");
+        case OBJ_RANGE:
+            if (simple) {
+                printf("<set>");
+            } else {
+                unsigned char* str = rangeToString(AS_RANGE(value));
+                printf("%s", str);
+                free(str);
+            }
             break;
         default: 
             printf("<unknown>");
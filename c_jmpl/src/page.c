@@ -0,0 +1,277 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "page.h"
+#include "gc.h"
+#include "memory.h"
+
+#ifdef _WIN32
+    #include <malloc.h>
+#endif
+
+/**
+ * @brief Get the bytes before the first slot of a page, whose bitmaps have a no. words.
+ */
+static size_t headerSize(uint32_t words) {
+    size_t size = sizeof(Page) + 3 * words * sizeof(uint64_t);
+    return (size + GRANULE_SIZE - 1) / GRANULE_SIZE * GRANULE_SIZE;
+}
+
+static uint32_t slotGranule(Page* page, uint32_t slot) {
+    return (uint32_t)((headerSize(page->words) + (size_t)slot * page->slotSize) / GRANULE_SIZE);
+}
+
+static Page* newPage(size_t size, uint32_t slotSize, uint32_t slotCount, uint32_t words) {
+    Page* page;
+#ifdef _WIN32
+    page = (Page*)_aligned_malloc(size, PAGE_SIZE);
+    if (page == NULL) exit(INTERNAL_SOFTWARE_ERROR);
+#else
+    if (posix_memalign((void**)&page, PAGE_SIZE, size) != 0) exit(INTERNAL_SOFTWARE_ERROR);
+#endif
+
+    page->prev = NULL;
+    page->next = NULL;
+    page->slotSize = slotSize;
+    page->slotCount = slotCount;
+    page->liveCount = 0;
+    page->words = words;
+    page->isYoung = false;
+    memset(page->bits, 0, 3 * words * sizeof(uint64_t));
+
+    return page;
+}
+
+void freePage(Page* page) {
+#ifdef _WIN32
+    _aligned_free(page);
+#else
+    free(page);
+#endif
+}
+
+void initPages(GC* gc) {
+    for (int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        SizeClass* class = &gc->classes[i];
+        class->pages = (PageList){NULL, NULL};
+        class->unswept = (PageList){NULL, NULL};
+        class->current = NULL;
+        class->free = NULL;
+        class->bump = NULL;
+        class->bumpEnd = NULL;
+    }
+
+    gc->largePages = (PageList){NULL, NULL};
+    gc->isSweeping = false;
+
+    gc->youngPageCount = 0;
+    gc->youngPageCapacity = 0;
+    gc->youngPages = NULL;
+}
+
+void appendPage(PageList* list, Page* page) {
+    page->prev = list->last;
+    page->next = NULL;
+
+    if (list->last != NULL) {
+        list->last->next = page;
+    } else {
+        list->first = page;
+    }
+    list->last = page;
+}
+
+void unlinkPage(PageList* list, Page* page) {
+    if (page->prev != NULL) {
+        page->prev->next = page->next;
+    } else {
+        list->first = page->next;
+    }
+
+    if (page->next != NULL) {
+        page->next->prev = page->prev;
+    } else {
+        list->last = page->prev;
+    }
+}
+
+/**
+ * @brief Move the pages of one list onto the end of another.
+ */
+static void splicePages(PageList* list, PageList* pages) {
+    if (pages->first == NULL) return;
+
+    if (list->last != NULL) {
+        list->last->next = pages->first;
+        pages->first->prev = list->last;
+    } else {
+        list->first = pages->first;
+    }
+    list->last = pages->last;
+
+    pages->first = NULL;
+    pages->last = NULL;
+}
+
+static void addYoungPage(GC* gc, Page* page) {
+    if (gc->youngPageCapacity < gc->youngPageCount + 1) {
+        gc->youngPageCapacity = GROW_CAPACITY(gc->youngPageCapacity);
+        gc->youngPages = (Page**)realloc(gc->youngPages, sizeof(Page*) * gc->youngPageCapacity);
+        if (gc->youngPages == NULL) exit(INTERNAL_SOFTWARE_ERROR);
+    }
+
+    page->isYoung = true;
+    gc->youngPages[gc->youngPageCount++] = page;
+}
+
+/**
+ * @brief Move the pages of another GC into this one. A worker never collects, so none of them are waiting to be swept.
+ */
+void movePages(GC* gc, GC* from) {
+    for (int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        SizeClass* class = &gc->classes[i];
+        Page* first = from->classes[i].pages.first;
+
+        splicePages(&class->pages, &from->classes[i].pages);
+        if (class->current == NULL) class->current = first;
+        from->classes[i].current = NULL;
+        from->classes[i].free = NULL;
+        from->classes[i].bump = NULL;
+        from->classes[i].bumpEnd = NULL;
+    }
+
+    splicePages(&gc->largePages, &from->largePages);
+
+    for (int i = 0; i < from->youngPageCount; i++) {
+        addYoungPage(gc, from->youngPages[i]);
+    }
+    from->youngPageCount = 0;
+}
+
+/**
+ * @brief Find a page of a size class with a free slot, sweeping the pages waiting to be swept before adding a new one.
+ */
+static Page* findPage(GC* gc, SizeClass* class, uint32_t slotSize) {
+    for (Page* page = class->current; page != NULL; page = page->next) {
+        if (page->liveCount < page->slotCount) {
+            class->current = page;
+            return page;
+        }
+    }
+
+    while (class->unswept.first != NULL) {
+        Page* page = class->unswept.first;
+        unlinkPage(&class->unswept, page);
+        sweepPage(gc, page);
+        appendPage(&class->pages, page);
+
+        if (page->liveCount < page->slotCount) {
+            class->current = page;
+            return page;
+        }
+    }
+
+    uint32_t slotCount = (uint32_t)((PAGE_SIZE - headerSize(PAGE_WORDS)) / slotSize);
+    Page* page = newPage(PAGE_SIZE, slotSize, slotCount, PAGE_WORDS);
+    appendPage(&class->pages, page);
+    class->current = page;
+    return page;
+}
+
+/**
+ * @brief Fill the empty free list of a size class with the free slots of a page, in address order.
+ */
+static void refillSlots(GC* gc, SizeClass* class, uint32_t slotSize) {
+    Page* page = findPage(gc, class, slotSize);
+    uint64_t* allocated = PAGE_ALLOCATED(page);
+
+    // Sweeping the page may have freed slots onto the list, which are added again with the rest
+    class->free = NULL;
+
+    if (page->liveCount == 0) {
+        class->bump = (char*)objectAt(page, slotGranule(page, 0));
+        class->bumpEnd = class->bump + (size_t)page->slotCount * slotSize;
+        return;
+    }
+
+    // A slot that was on the list before has since been allocated, as the list was empty
+    for (uint32_t slot = page->slotCount; slot-- > 0;) {
+        uint32_t granule = slotGranule(page, slot);
+        if (testBit(allocated, granule)) continue;
+
+        FreeSlot* free = (FreeSlot*)objectAt(page, granule);
+        free->next = class->free;
+        class->free = free;
+    }
+}
+
+/**
+ * @brief Allocate the memory of an object, counting it towards the next collection.
+ *
+ * @param isOld If the object starts old, and so marked, rather than young
+ */
+Obj* allocateSlot(GC* gc, size_t size, bool isOld) {
+    Page* page;
+    uint32_t granule;
+
+    if (size > MAX_SLOT_SIZE) {
+        addAllocated(gc, size);
+
+        page = newPage(headerSize(1) + size, (uint32_t)size, 1, 1);
+        appendPage(&gc->largePages, page);
+        granule = slotGranule(page, 0);
+    } else {
+        SizeClass* class = &gc->classes[(size - 1) / GRANULE_SIZE];
+        uint32_t slotSize = (uint32_t)((size + GRANULE_SIZE - 1) / GRANULE_SIZE * GRANULE_SIZE);
+
+        // Counted first, as it may collect and sweep
+        addAllocated(gc, slotSize);
+        if (class->free == NULL && class->bump == class->bumpEnd) refillSlots(gc, class, slotSize);
+
+        Obj* slot;
+        if (class->free != NULL) {
+            slot = (Obj*)class->free;
+            class->free = class->free->next;
+        } else {
+            slot = (Obj*)class->bump;
+            class->bump += slotSize;
+        }
+
+        page = pageOf(slot);
+        granule = granuleOf(slot);
+    }
+
+    page->liveCount++;
+    setBit(PAGE_ALLOCATED(page), granule);
+
+    if (isOld) {
+        setBit(PAGE_MARKED(page), granule);
+    } else {
+        setBit(PAGE_YOUNG(page), granule);
+        if (!page->isYoung) addYoungPage(gc, page);
+    }
+
+    return objectAt(page, granule);
+}
+
+/**
+ * @brief Free the slot of an object, adding it to the free list of its size class. A large page is instead freed by
+ * the sweep that empties it.
+ */
+void releaseSlot(GC* gc, Obj* object) {
+    Page* page = pageOf(object);
+    uint32_t granule = granuleOf(object);
+
+    clearBit(PAGE_ALLOCATED(page), granule);
+    clearBit(PAGE_MARKED(page), granule);
+    clearBit(PAGE_YOUNG(page), granule);
+
+    page->liveCount--;
+    gc->bytesAllocated -= page->slotSize;
+    if (page->slotSize > MAX_SLOT_SIZE) return;
+
+    SizeClass* class = &gc->classes[page->slotSize / GRANULE_SIZE - 1];
+    FreeSlot* free = (FreeSlot*)object;
+    free->next = class->free;
+    class->free = free;
+}
\ No newline at end of file
@@ -0,0 +1,328 @@
+#include <stdlib.h>
+
+#include "parallel.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+
+    typedef HANDLE Thread;
+    typedef CRITICAL_SECTION Mutex;
+    typedef CONDITION_VARIABLE Condition;
+
+    #define initMutex(mutex)        InitializeCriticalSection(mutex)
+    #define freeMutex(mutex)        DeleteCriticalSection(mutex)
+    #define lockMutex(mutex)        EnterCriticalSection(mutex)
+    #define unlockMutex(mutex)      LeaveCriticalSection(mutex)
+    #define initCondition(cond)     InitializeConditionVariable(cond)
+    #define freeCondition(cond)     ((void)(cond))
+    #define waitCondition(cond, m)  SleepConditionVariableCS(cond, m, INFINITE)
+    #define wakeAll(cond)           WakeAllConditionVariable(cond)
+#else
+    #include <pthread.h>
+    #include <unistd.h>
+
+    typedef pthread_t Thread;
+    typedef pthread_mutex_t Mutex;
+    typedef pthread_cond_t Condition;
+
+    #define initMutex(mutex)        pthread_mutex_init(mutex, NULL)
+    #define freeMutex(mutex)        pthread_mutex_destroy(mutex)
+    #define lockMutex(mutex)        pthread_mutex_lock(mutex)
+    #define unlockMutex(mutex)      pthread_mutex_unlock(mutex)
+    #define initCondition(cond)     pthread_cond_init(cond, NULL)
+    #define freeCondition(cond)     pthread_cond_destroy(cond)
+    #define waitCondition(cond, m)  pthread_cond_wait(cond, m)
+    #define wakeAll(cond)           pthread_cond_broadcast(cond)
+#endif
+
+/**
+ * @brief A pool of threads that each run a part of the current task when it changes.
+ *
+ * The thread that submits a task runs the first part itself, so there is one fewer thread than parts. The pool is
+ * shared by every VM in the process, and runs one task at a time.
+ */
+typedef struct {
+    Thread threads[MAX_WORKERS];
+    int count;               // No. parts work is split into
+    size_t threshold;        // Fewest elements worth splitting a set operation
+    size_t builderThreshold; // Fewest values worth splitting a set-builder
+
+    Mutex mutex;
+    Condition start;  // Signalled when there is a new task, or the pool is stopping
+    Condition done;   // Signalled when the last part of a task finishes
+
+    ParallelTask task;
+    void* context;
+    size_t size;      // No. indices of the task
+    uint64_t round;   // Incremented for each task
+    int running;      // No. parts still running
+    bool isRunning;   // If a task has been submitted and hasn't finished
+    bool stopping;
+} Workers;
+
+/**
+ * @brief The state of a run of chunks, which the parts claim one at a time.
+ */
+typedef struct {
+    ChunkTask task;
+    void* context;
+    size_t count;
+    size_t chunkSize;
+    size_t next;    // Start of the next chunk to claim
+    bool hasFailed; // If a chunk failed, so no more are claimed
+} Chunks;
+
+static Workers workers = {
+    .count = 1,
+    .threshold = PARALLEL_THRESHOLD_DEFAULT,
+    .builderThreshold = BUILDER_THRESHOLD_DEFAULT
+};
+
+static THREAD_LOCAL bool isInTask = false; // If the thread is running a part, so the work it does isn't split again
+
+static size_t partStart(size_t size, int part, int parts) {
+    return (size_t)((uint64_t)size * part / parts);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI workerMain(LPVOID arg) {
+#else
+static void* workerMain(void* arg) {
+#endif
+    int part = (int)(intptr_t)arg;
+    uint64_t round = 0;
+    isInTask = true;
+
+    lockMutex(&workers.mutex);
+    while (true) {
+        while (workers.round == round && !workers.stopping) {
+            waitCondition(&workers.start, &workers.mutex);
+        }
+        if (workers.stopping) break;
+
+        round = workers.round;
+        ParallelTask task = workers.task;
+        void* context = workers.context;
+        size_t size = workers.size;
+        int parts = workers.count;
+        unlockMutex(&workers.mutex);
+
+        task(context, part, partStart(size, part, parts), partStart(size, part + 1, parts));
+
+        lockMutex(&workers.mutex);
+        if (--workers.running == 0) wakeAll(&workers.done);
+    }
+    unlockMutex(&workers.mutex);
+
+    return 0;
+}
+
+/**
+ * @brief Get the no. threads to use when none is given, which is the JMPL_THREADS environment variable or the no. CPUs.
+ */
+int defaultWorkerCount() {
+    const char* variable = getenv("JMPL_THREADS");
+    if (variable != NULL && atoi(variable) > 0) return atoi(variable);
+
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+/**
+ * @brief Start the threads that work is split across.
+ *
+ * @param count            The no. threads, including the main thread
+ * @param threshold        Fewest elements worth splitting a set operation for
+ * @param builderThreshold Fewest values of its first generator worth splitting a set-builder for
+ */
+void initWorkers(int count, size_t threshold, size_t builderThreshold) {
+    if (count > MAX_WORKERS) count = MAX_WORKERS;
+
+    workers.threshold = threshold;
+    workers.builderThreshold = builderThreshold;
+    if (count <= 1) return;
+
+    workers.round = 0;
+    workers.running = 0;
+    workers.isRunning = false;
+    workers.stopping = false;
+
+    initMutex(&workers.mutex);
+    initCondition(&workers.start);
+    initCondition(&workers.done);
+
+    workers.count = 1;
+    for (int i = 1; i < count; i++) {
+#ifdef _WIN32
+        workers.threads[i] = CreateThread(NULL, 0, workerMain, (LPVOID)(intptr_t)i, 0, NULL);
+        bool started = workers.threads[i] != NULL;
+#else
+        bool started = pthread_create(&workers.threads[i], NULL, workerMain, (void*)(intptr_t)i) == 0;
+#endif
+        // Run with however many threads could be started
+        if (!started) break;
+        workers.count++;
+    }
+}
+
+void freeWorkers() {
+    if (workers.count == 1) return;
+
+    lockMutex(&workers.mutex);
+    workers.stopping = true;
+    wakeAll(&workers.start);
+    unlockMutex(&workers.mutex);
+
+    for (int i = 1; i < workers.count; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(workers.threads[i], INFINITE);
+        CloseHandle(workers.threads[i]);
+#else
+        pthread_join(workers.threads[i], NULL);
+#endif
+    }
+
+    freeCondition(&workers.done);
+    freeCondition(&workers.start);
+    freeMutex(&workers.mutex);
+    workers.count = 1;
+}
+
+/**
+ * @brief Checks if work on a no. elements should be split across the workers.
+ */
+bool isParallel(size_t count) {
+    return workers.count > 1 && !isInTask && count >= workers.threshold;
+}
+
+/**
+ * @brief Checks if a set-builder whose first generator has a no. values should be split across the workers.
+ */
+bool isParallelBuilder(size_t count) {
+    return workers.count > 1 && !isInTask && count >= workers.builderThreshold;
+}
+
+/**
+ * @brief Get the no. parts work is split into.
+ */
+int workerCount() {
+    return workers.count;
+}
+
+/**
+ * @brief Checks if the current thread is running part of a task, at the same time as other threads.
+ *
+ * Objects shared between the parts must not be changed, even to cache something about them.
+ */
+bool inParallelTask() {
+    return isInTask;
+}
+
+/**
+ * @brief Run a task on the indices up to a count, split into contiguous parts that run at the same time.
+ *
+ * If another thread's task is using the workers, e.g. one from another VM, the task runs on this thread as one part.
+ *
+ * @return The no. parts, where part i handles the indices from count * i / parts up to count * (i + 1) / parts
+ */
+int runParallel(ParallelTask task, void* context, size_t count) {
+    int parts = workers.count;
+    if (parts == 1) {
+        task(context, 0, 0, count);
+        return 1;
+    }
+
+    lockMutex(&workers.mutex);
+    if (workers.isRunning) {
+        unlockMutex(&workers.mutex);
+
+        isInTask = true;
+        task(context, 0, 0, count);
+        isInTask = false;
+        return 1;
+    }
+
+    workers.isRunning = true;
+    workers.task = task;
+    workers.context = context;
+    workers.size = count;
+    workers.running = parts - 1;
+    workers.round++;
+    wakeAll(&workers.start);
+    unlockMutex(&workers.mutex);
+
+    isInTask = true;
+    task(context, 0, 0, partStart(count, 1, parts));
+    isInTask = false;
+
+    lockMutex(&workers.mutex);
+    while (workers.running > 0) {
+        waitCondition(&workers.done, &workers.mutex);
+    }
+    workers.isRunning = false;
+    unlockMutex(&workers.mutex);
+
+    return parts;
+}
+
+/**
+ * @brief Claim the next chunk, unless they have all been claimed or one has failed.
+ */
+static bool claimChunk(Chunks* chunks, size_t* start, size_t* end) {
+    lockMutex(&workers.mutex);
+
+    bool isClaimed = !chunks->hasFailed && chunks->next < chunks->count;
+    if (isClaimed) {
+        *start = chunks->next;
+        *end = chunks->count - *start > chunks->chunkSize ? *start + chunks->chunkSize : chunks->count;
+        chunks->next = *end;
+    }
+
+    unlockMutex(&workers.mutex);
+    return isClaimed;
+}
+
+static void chunkPart(void* context, int part, size_t start, size_t end) {
+    (void)start;
+    (void)end;
+    Chunks* chunks = (Chunks*)context;
+
+    size_t chunkStart, chunkEnd;
+    while (claimChunk(chunks, &chunkStart, &chunkEnd)) {
+        if (chunks->task(chunks->context, part, chunkStart, chunkEnd)) continue;
+
+        lockMutex(&workers.mutex);
+        chunks->hasFailed = true;
+        unlockMutex(&workers.mutex);
+        return;
+    }
+}
+
+/**
+ * @brief Run a task on the indices up to a count in chunks, which each part claims in order as it finishes the last.
+ *
+ * Parts whose chunks are quicker to run take on more of them, so the work stays balanced when the cost of each
+ * index varies. The chunks claimed by any one part are in increasing order.
+ *
+ * @return If every chunk succeeded
+ */
+bool runChunks(ChunkTask task, void* context, size_t count, size_t chunkSize) {
+    if (workers.count == 1) {
+        for (size_t start = 0; start < count; start += chunkSize) {
+            size_t end = count - start > chunkSize ? start + chunkSize : count;
+            if (!task(context, 0, start, end)) return false;
+        }
+        return true;
+    }
+
+    Chunks chunks = {.task = task, .context = context, .count = count, .chunkSize = chunkSize, .next = 0, .hasFailed = false};
+    runParallel(chunkPart, &chunks, count);
+
+    return !chunks.hasFailed;
+}
\ No newline at end of file
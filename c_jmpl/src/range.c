@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "range.h"
+#include "memory.h"
+#include "object.h"
+#include "set.h"
+#include "gc.h"
+#include "../lib/c-stringbuilder/sb.h"
+#include "../lib/pcg/pcg_basic.h"
+
+ObjRange* newRange(GC* gc, int first, int step, size_t count, bool isChar) {
+    ObjRange* range = ALLOCATE_OBJ(gc, ObjRange, OBJ_RANGE, true);
+    range->isChar = isChar;
+    range->first = first;
+    range->step = step;
+    range->count = count;
+    return range;
+}
+
+/**
+ * @brief Get the element at an index of a range.
+ *
+ * @param range The range
+ * @param index An index less than the range's count
+ */
+Value getRangeValue(ObjRange* range, size_t index) {
+    int value = range->first + (int)index * range->step;
+    return range->isChar ? CHAR_VAL(value) : NUMBER_VAL(value);
+}
+
+/**
+ * @brief Checks if a value is in a range without generating its elements.
+ */
+bool rangeContains(ObjRange* range, Value value) {
+    if (range->count == 0) return false;
+
+    double number;
+    if (range->isChar) {
+        if (!IS_CHAR(value)) return false;
+        number = AS_CHAR(value);
+    } else {
+        if (!IS_NUMBER(value)) return false;
+        number = AS_NUMBER(value);
+        if (number != floor(number)) return false;
+    }
+
+    double offset = number - range->first;
+    if (offset < 0) return false;
+
+    double index = offset / range->step;
+    return index == floor(index) && index < range->count;
+}
+
+bool rangesEqual(ObjRange* a, ObjRange* b) {
+    if (a->count != b->count) return false;
+    if (a->count == 0) return true;
+
+    if (a->isChar != b->isChar || a->first != b->first) return false;
+
+    return a->count == 1 || a->step == b->step;
+}
+
+bool rangeEqualsSet(ObjRange* range, ObjSet* set) {
+    if (range->count != set->count) return false;
+
+    // Set elements are unique, so if they are all in the range the two are equal
+    SetIterator iterator;
+    initSetIterator(&iterator, set);
+
+    for (SetEntry* entry = nextSetEntry(&iterator); entry != NULL; entry = nextSetEntry(&iterator)) {
+        if (!rangeContains(range, entry->key)) return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Generate the elements of a range into a new set.
+ */
+ObjSet* rangeToSet(GC* gc, ObjRange* range) {
+    pushTemp(gc, OBJ_VAL(range));
+    ObjSet* set = newSet(gc);
+    pushTemp(gc, OBJ_VAL(set));
+
+    for (size_t i = 0; i < range->count; i++) {
+        setInsert(gc, set, getRangeValue(range, i));
+    }
+
+    popTemp(gc);
+    popTemp(gc);
+    return set;
+}
+
+Value getRangeArb(ObjRange* range, pcg32_random_t* rng) {
+    if (range->count == 0) return NULL_VAL;
+
+    return getRangeValue(range, pcg32_boundedrand_r(rng, (uint32_t)range->count));
+}
+
+/**
+ * @brief Converts a range to a C string.
+ *
+ * @param range Pointer to the range
+ * @return      An array of characters
+ *
+ * Must be freed.
+ */
+unsigned char* rangeToString(ObjRange* range) {
+    StringBuilder* sb = sb_create();
+    char* str = NULL;
+
+    sb_append(sb, "{");
+
+    for (size_t i = 0; i < range->count; i++) {
+        Value value = getRangeValue(range, i);
+
+        unsigned char* str = valueToString(value);
+        if (range->isChar) {
+            sb_appendf(sb, "'%s'", str);
+        } else {
+            sb_appendf(sb, "%s", str);
+        }
+        free(str);
+
+        if (i < range->count - 1) sb_append(sb, ", ");
+    }
+
+    sb_append(sb, "}");
+    str = sb_concat(sb);
+
+    sb_free(sb);
+
+    return str;
+}
\ No newline at end of file
@@ -1,7 +1,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
-#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "set.h"
@@ -10,67 +10,619 @@
 #include "debug.h"
 #include "gc.h"
 #include "hash.h"
+#include "hamt.h"
+#include "utils.h"
+#include "parallel.h"
 #include "../lib/c-stringbuilder/sb.h"
+#include "../lib/pcg/pcg_basic.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SET_SSE2
+#endif
 
-#define SET_MAX_LOAD 0.65
+#define SET_GROUP_SIZE 16
 #define MAX_PRINT_ELEMENTS 100
 
+#define SET_PERSISTENT_MIN   64 // Smallest set worth sharing the structure of
+#define SET_PERSISTENT_RATIO 8  // How many times larger a set must be than the other operand to be shared
+
+#define SET_BITSET_LIMIT     (1 << 24) // Elements of a bitset must be integers below this
+#define SET_BITSET_MIN_WORDS 16        // No. words a bitset can always grow to
+#define SET_BITSET_DENSITY   4         // No. words per element a bitset can grow to beyond the minimum
+
 static void initSet(ObjSet* set) {
     set->count = 0;
     set->capacity = 0;
     set->entries = NULL;
+    set->control = NULL;
+    set->indices = NULL;
+    set->root = NULL;
+    set->bits = NULL;
+    set->bitCapacity = 0;
+    set->hash = 0;
+    set->isHashed = false;
+    set->isOwned = false;
 }
 
-static void printDebugSet(ObjSet* set) {
-    printf("\n==============\n");
-    for (int i = 0; i < set->capacity; i++) {
-        unsigned char* str = valueToString(getSetValue(set, i));
-        printf("%d. %s\n", i, str);
-        free(str);
+static inline bool isSetSlotFull(ObjSet* set, size_t slot) {
+    return set->control[slot] != SET_CTRL_EMPTY;
+}
+
+/**
+ * @brief Get the no. elements a table with a no. slots can hold before it grows.
+ *
+ * Whole groups are searched at once, so tables can be 7/8 full.
+ */
+static inline size_t maxSetCount(size_t capacity) {
+    return capacity - capacity / 8;
+}
+
+/**
+ * @brief Get a bit mask of the slots in a group whose control byte matches.
+ */
+static inline uint32_t matchControl(const uint8_t* group, uint8_t control) {
+#ifdef SET_SSE2
+    __m128i bytes = _mm_loadu_si128((const __m128i*)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)control)));
+#else
+    uint32_t matches = 0;
+    for (int i = 0; i < SET_GROUP_SIZE; i++) {
+        matches |= (uint32_t)(group[i] == control) << i;
     }
-    printf("==============\n");
+    return matches;
+#endif
 }
 
-static SetEntry* findEntry(SetEntry* entries, size_t capacity, Value key, hash_t hash) {
-    // Map the key's hash code to an index in the array
-    size_t index = hash & (capacity - 1);
-    uint64_t perturb = hash;
-    
-    while (true) {
-        SetEntry* entry = &entries[index];
+/**
+ * @brief Find the slot of a key, or the empty slot it would be inserted into.
+ *
+ * @param found Set to whether the key is in the set
+ *
+ * The table is split into groups of 16 slots, whose control bytes hold a 7-bit tag of the hash of their
+ * element or SET_CTRL_EMPTY. A whole group is checked at once, and values are only compared if their tags
+ * and hashes match. Elements are never removed, so the search can stop at the first group with an empty slot.
+ */
+static size_t findSlot(ObjSet* set, Value key, hash_t hash, bool* found) {
+    // Hashes are mixed, so the group and tag can be taken from either end
+    uint8_t tag = hash >> 57;
+    size_t groupMask = set->capacity / SET_GROUP_SIZE - 1;
+    size_t group = hash & groupMask;
+
+    // Triangular probing visits every group as the no. groups is a power of two
+    for (size_t step = 1; ; step++) {
+        size_t first = group * SET_GROUP_SIZE;
+
+        for (uint32_t matches = matchControl(set->control + first, tag); matches != 0; matches &= matches - 1) {
+            size_t slot = first + countTrailingZeros(matches);
+            SetEntry* entry = &set->entries[set->indices[slot]];
+            if (entry->hash == hash && valuesEqual(entry->key, key)) {
+                *found = true;
+                return slot;
+            }
+        }
 
-        if (IS_NULL(entry->key) || valuesEqual(entry->key, key)) {
-            return entry;
+        uint32_t empty = matchControl(set->control + first, SET_CTRL_EMPTY);
+        if (empty != 0) {
+            *found = false;
+            return first + countTrailingZeros(empty);
         }
 
-        // Collision, so start probing
-        index = (index * 5 + 1 + perturb) & (capacity - 1);
-        perturb >>= 5;
+        group = (group + step) & groupMask;
+    }
+}
+
+/**
+ * @brief Find the slot a new element would be inserted into, without checking if it is in the set.
+ */
+static size_t findEmptySlot(ObjSet* set, hash_t hash) {
+    size_t groupMask = set->capacity / SET_GROUP_SIZE - 1;
+    size_t group = hash & groupMask;
+
+    for (size_t step = 1; ; step++) {
+        size_t first = group * SET_GROUP_SIZE;
+
+        uint32_t empty = matchControl(set->control + first, SET_CTRL_EMPTY);
+        if (empty != 0) return first + countTrailingZeros(empty);
+
+        group = (group + step) & groupMask;
+    }
+}
+
+/**
+ * @brief Insert a key into a table with room for it, after the existing elements.
+ *
+ * @return If the key wasn't already in the set
+ */
+static bool tableInsert(ObjSet* set, Value key, hash_t hash) {
+    bool found;
+    size_t slot = findSlot(set, key, hash, &found);
+    if (found) return false;
+
+    set->control[slot] = hash >> 57;
+    set->indices[slot] = set->count;
+    set->entries[set->count].key = key;
+    set->entries[set->count].hash = hash;
+    set->count++;
+    set->isHashed = false;
+    return true;
+}
+
+/**
+ * @brief Get the no. slots of the smallest table that can hold a no. elements.
+ */
+static size_t tableCapacity(size_t count) {
+    size_t capacity = SET_GROUP_SIZE;
+    while (count > maxSetCount(capacity)) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+/**
+ * @brief Put an entry of a table that isn't in any slot into an empty one.
+ */
+static inline void slotEntry(ObjSet* set, size_t index) {
+    size_t slot = findEmptySlot(set, set->entries[index].hash);
+    set->control[slot] = set->entries[index].hash >> 57;
+    set->indices[slot] = (uint32_t)index;
+}
+
+/**
+ * @brief Fill the empty slots of a table with its entries.
+ *
+ * Elements are unique, so each only needs an empty slot.
+ */
+static void slotEntries(ObjSet* set) {
+    memset(set->control, SET_CTRL_EMPTY, set->capacity);
+
+    for (size_t i = 0; i < set->count; i++) {
+        slotEntry(set, i);
     }
 }
 
+/**
+ * @brief Resize a table, keeping its elements in order.
+ *
+ * Only the slots are rebuilt, as the elements are stored densely in insertion order. Each array is put in the set as
+ * soon as it is allocated, so none is lost if a worker gives up while the next is allocated.
+ */
 static void adjustCapacity(GC* gc, ObjSet* set, size_t capacity) {
-    SetEntry* entries = ALLOCATE(gc, SetEntry, capacity);
-    // Initialise every entry's key to be null
-    for (int i = 0; i < capacity; i++) {
-        entries[i].key = NULL_VAL;
+    uint8_t* control = ALLOCATE(gc, uint8_t, capacity);
+    FREE_ARRAY(gc, uint8_t, set->control, set->capacity);
+    set->control = control;
+
+    uint32_t* indices = ALLOCATE(gc, uint32_t, capacity);
+    FREE_ARRAY(gc, uint32_t, set->indices, set->capacity);
+    set->indices = indices;
+
+    set->entries = GROW_ARRAY(gc, SetEntry, set->entries, maxSetCount(set->capacity), maxSetCount(capacity));
+    set->capacity = capacity;
+
+    slotEntries(set);
+}
+
+/**
+ * @brief Grow an empty set or a table so it can hold a no. elements without resizing.
+ */
+static void reserveTable(GC* gc, ObjSet* set, size_t count) {
+    if (count == 0) return;
+
+    size_t capacity = tableCapacity(count);
+    if (capacity > set->capacity) adjustCapacity(gc, set, capacity);
+}
+
+/**
+ * @brief Fill an empty set with the elements of a table, with room for a no. elements.
+ *
+ * The entries are copied as they are, and so are the slots unless the copy needs more of them.
+ */
+static void copyTable(GC* gc, ObjSet* set, ObjSet* table, size_t count) {
+    if (count == 0) return;
+
+    size_t capacity = tableCapacity(count);
+    if (capacity < table->capacity) capacity = table->capacity;
+
+    // Each array is put in the set as soon as it is allocated, as in adjustCapacity
+    set->control = ALLOCATE(gc, uint8_t, capacity);
+    set->indices = ALLOCATE(gc, uint32_t, capacity);
+    set->entries = ALLOCATE(gc, SetEntry, maxSetCount(capacity));
+    if (table->count > 0) memcpy(set->entries, table->entries, table->count * sizeof(SetEntry));
+
+    set->capacity = capacity;
+    set->count = table->count;
+
+    if (capacity == table->capacity) {
+        memcpy(set->control, table->control, capacity);
+        memcpy(set->indices, table->indices, capacity * sizeof(uint32_t));
+    } else {
+        slotEntries(set);
     }
+}
 
-    // Insert entries into array
-    set->count = 0;
-    for (int i = 0; i < set->capacity; i++) {
-        SetEntry* entry = &set->entries[i];
-        if(IS_NULL(entry->key)) continue;
+/**
+ * @brief Shrink a table built with room for more elements than it ended up with.
+ */
+static void trimTable(GC* gc, ObjSet* set) {
+    size_t capacity = tableCapacity(set->count);
+    if (capacity < set->capacity) adjustCapacity(gc, set, capacity);
+}
+
+/**
+ * @brief Slot the entries of a table that were written to it directly, shrinking it if it has room to spare.
+ */
+static void finishTable(GC* gc, ObjSet* set) {
+    size_t capacity = tableCapacity(set->count);
+    if (capacity < set->capacity) {
+        adjustCapacity(gc, set, capacity);
+    } else {
+        slotEntries(set);
+    }
+}
+
+/**
+ * @brief Insert a key with a known hash into a table, growing it if it is full.
+ */
+static bool growingInsert(GC* gc, ObjSet* set, Value key, hash_t hash) {
+    if (set->count + 1 > maxSetCount(set->capacity)) {
+        size_t capacity = set->capacity < SET_GROUP_SIZE ? SET_GROUP_SIZE : set->capacity * 2;
+        adjustCapacity(gc, set, capacity);
+    }
 
-        SetEntry* destination = findEntry(entries, capacity, entry->key, entry->hash);
-        destination->key = entry->key;
-        destination->hash = entry->hash;
+    return tableInsert(set, key, hash);
+}
+// --- Bitsets ---
+
+static bool isBitsetValue(Value value) {
+    if (!IS_NUMBER(value)) return false;
+
+    double number = AS_NUMBER(value);
+    return number >= 0 && number < SET_BITSET_LIMIT && number == (uint32_t)number;
+}
+
+/**
+ * @brief Get the first element of a bitset at or after a position.
+ *
+ * @param from The position to search from
+ * @param bit  A pointer to the element found
+ * @return     If there was an element
+ */
+bool nextSetBit(ObjSet* set, size_t from, size_t* bit) {
+    size_t word = from / 64;
+    if (word >= set->bitCapacity) return false;
+
+    uint64_t bits = set->bits[word] & (~0ULL << (from % 64));
+    while (bits == 0) {
+        if (++word >= set->bitCapacity) return false;
+        bits = set->bits[word];
+    }
+
+    *bit = word * 64 + countTrailingZeros(bits);
+    return true;
+}
+
+/**
+ * @brief Get the element at a position in the ascending order of a bitset.
+ *
+ * @param index A position less than the set's count
+ */
+static size_t selectSetBit(ObjSet* set, size_t index) {
+    for (size_t word = 0; ; word++) {
+        uint64_t bits = set->bits[word];
+        size_t count = popCount(bits);
+
+        if (index < count) {
+            for (; index > 0; index--) bits &= bits - 1;
+            return word * 64 + countTrailingZeros(bits);
+        }
+        index -= count;
+    }
+}
+
+static bool bitsetContains(ObjSet* set, Value value) {
+    if (!isBitsetValue(value)) return false;
+
+    size_t bit = (size_t)AS_NUMBER(value);
+    return bit / 64 < set->bitCapacity && (set->bits[bit / 64] >> (bit % 64)) & 1;
+}
+
+/**
+ * @brief Try to insert a value into a bitset (or an empty set).
+ *
+ * @param isNewKey Set to whether the value wasn't already in the set
+ * @return         If the value could be stored in the bitset
+ *
+ * Fails if the value isn't a small non-negative integer, or if storing it would make the bitset too sparse.
+ */
+static bool bitsetInsert(GC* gc, ObjSet* set, Value value, bool* isNewKey) {
+    if (!isBitsetValue(value)) return false;
+
+    size_t bit = (size_t)AS_NUMBER(value);
+    size_t word = bit / 64;
+
+    if (word >= set->bitCapacity) {
+        size_t maxWords = SET_BITSET_DENSITY * (set->count + 1);
+        if (maxWords < SET_BITSET_MIN_WORDS) maxWords = SET_BITSET_MIN_WORDS;
+        if (word >= maxWords) return false;
+
+        size_t oldCapacity = set->bitCapacity;
+        size_t capacity = GROW_CAPACITY(oldCapacity);
+        if (capacity <= word) capacity = word + 1;
+
+        set->bits = GROW_ARRAY(gc, uint64_t, set->bits, oldCapacity, capacity);
+        memset(set->bits + oldCapacity, 0, (capacity - oldCapacity) * sizeof(uint64_t));
+        set->bitCapacity = capacity;
+    }
+
+    uint64_t mask = 1ULL << (bit % 64);
+    *isNewKey = (set->bits[word] & mask) == 0;
+    if (*isNewKey) {
+        set->bits[word] |= mask;
         set->count++;
+        set->isHashed = false;
     }
 
-    FREE_ARRAY(gc, SetEntry, set->entries, set->capacity);
-    set->entries = entries;
-    set->capacity = capacity;
+    return true;
+}
+
+/**
+ * @brief Create a bitset with room for a no. words, which must all be set by the caller.
+ */
+static ObjSet* newBitset(GC* gc, size_t words) {
+    ObjSet* set = newSet(gc);
+    pushTemp(gc, OBJ_VAL(set));
+
+    // Allocate at least one word so the set is a bitset even if it is empty
+    size_t capacity = words > 0 ? words : 1;
+    set->bits = ALLOCATE(gc, uint64_t, capacity);
+    set->bits[0] = 0;
+    set->bitCapacity = capacity;
+
+    popTemp(gc);
+    return set;
+}
+
+static void countBits(ObjSet* set) {
+    size_t count = 0;
+    for (size_t i = 0; i < set->bitCapacity; i++) {
+        count += popCount(set->bits[i]);
+    }
+    set->count = count;
+}
+
+static ObjSet* bitsetUnion(GC* gc, ObjSet* a, ObjSet* b) {
+    if (a->bitCapacity < b->bitCapacity) {
+        ObjSet* temp = a;
+        a = b;
+        b = temp;
+    }
+
+    ObjSet* result = newBitset(gc, a->bitCapacity);
+    for (size_t i = 0; i < b->bitCapacity; i++) {
+        result->bits[i] = a->bits[i] | b->bits[i];
+    }
+    memcpy(result->bits + b->bitCapacity, a->bits + b->bitCapacity, (a->bitCapacity - b->bitCapacity) * sizeof(uint64_t));
+
+    countBits(result);
+    return result;
+}
+
+static ObjSet* bitsetIntersect(GC* gc, ObjSet* a, ObjSet* b) {
+    size_t words = a->bitCapacity < b->bitCapacity ? a->bitCapacity : b->bitCapacity;
+
+    ObjSet* result = newBitset(gc, words);
+    for (size_t i = 0; i < words; i++) {
+        result->bits[i] = a->bits[i] & b->bits[i];
+    }
+
+    countBits(result);
+    return result;
+}
+
+static ObjSet* bitsetDifference(GC* gc, ObjSet* a, ObjSet* b) {
+    size_t words = a->bitCapacity < b->bitCapacity ? a->bitCapacity : b->bitCapacity;
+
+    ObjSet* result = newBitset(gc, a->bitCapacity);
+    for (size_t i = 0; i < words; i++) {
+        result->bits[i] = a->bits[i] & ~b->bits[i];
+    }
+    memcpy(result->bits + words, a->bits + words, (a->bitCapacity - words) * sizeof(uint64_t));
+
+    countBits(result);
+    return result;
+}
+
+static bool bitsetIsSubset(ObjSet* a, ObjSet* b) {
+    size_t words = a->bitCapacity < b->bitCapacity ? a->bitCapacity : b->bitCapacity;
+
+    uint64_t extra = 0;
+    for (size_t i = 0; i < words; i++) {
+        extra |= a->bits[i] & ~b->bits[i];
+    }
+    for (size_t i = words; i < a->bitCapacity; i++) {
+        extra |= a->bits[i];
+    }
+
+    return extra == 0;
+}
+
+/**
+ * @brief Move the elements of a bitset into a hash table, so that any value can be inserted.
+ */
+static void bitsetToTable(GC* gc, ObjSet* set) {
+    size_t capacity = tableCapacity(set->count + 1);
+
+    // The table is filled from the bits, which are kept until it is done
+    set->count = 0;
+    adjustCapacity(gc, set, capacity);
+
+    size_t bit = 0;
+    while (nextSetBit(set, bit, &bit)) {
+        Value value = NUMBER_VAL(bit);
+        tableInsert(set, value, hashValue(value));
+        bit++;
+    }
+
+    FREE_ARRAY(gc, uint64_t, set->bits, set->bitCapacity);
+    set->bits = NULL;
+    set->bitCapacity = 0;
+}
+
+// --- Set iteration ---
+
+void initSetIterator(SetIterator* iterator, ObjSet* set) {
+    iterator->set = set;
+    iterator->index = 0;
+    iterator->depth = 0;
+    iterator->nodes[0] = set->root;
+    iterator->positions[0] = 0;
+}
+
+/**
+ * @brief Get the next element of a set.
+ *
+ * @return A pointer to the next entry, or NULL when every element has been visited
+ *
+ * The set mustn't be changed while it is being iterated.
+ */
+SetEntry* nextSetEntry(SetIterator* iterator) {
+    ObjSet* set = iterator->set;
+
+    if (set->bits != NULL) {
+        size_t bit;
+        if (!nextSetBit(set, iterator->index, &bit)) return NULL;
+
+        iterator->index = bit + 1;
+        iterator->current.key = NUMBER_VAL(bit);
+        iterator->current.hash = hashValue(iterator->current.key);
+        return &iterator->current;
+    }
+
+    if (set->root == NULL) {
+        if (iterator->index >= set->count) return NULL;
+        return &set->entries[iterator->index++];
+    }
+
+    // Walk the trie depth first, visiting the elements of a node before its children
+    while (iterator->depth >= 0) {
+        ObjSetNode* node = iterator->nodes[iterator->depth];
+        uint32_t position = iterator->positions[iterator->depth]++;
+
+        if (position >= node->size) {
+            iterator->depth--;
+        } else if (position < hamtDataCount(node)) {
+            return &node->slots[position].entry;
+        } else {
+            iterator->depth++;
+            iterator->nodes[iterator->depth] = node->slots[position].node;
+            iterator->positions[iterator->depth] = 0;
+        }
+    }
+
+    return NULL;
+}
+
+// --- Parallel set operations ---
+
+/**
+ * @brief Checks if an element of another set is in a set, reusing its hash.
+ */
+static bool containsEntry(ObjSet* set, SetEntry* entry) {
+    if (set->count == 0) return false;
+    if (set->bits != NULL) return bitsetContains(set, entry->key);
+    if (set->root != NULL) return hamtFind(set->root, entry->key, entry->hash) != NULL;
+
+    bool found;
+    findSlot(set, entry->key, entry->hash, &found);
+
+    return found;
+}
+
+/**
+ * @brief Work shared by the parts of a scan of the entries of a table for those in (or not in) another set.
+ */
+typedef struct {
+    SetEntry* entries;
+    ObjSet* other;
+    bool keepFound;  // If the entries found are kept, rather than those that aren't
+    SetEntry* kept;  // Where each part writes the entries it keeps, from its first index
+    size_t starts[MAX_WORKERS];
+    size_t counts[MAX_WORKERS];
+} ScanJob;
+
+static void scanPart(void* context, int part, size_t start, size_t end) {
+    ScanJob* job = (ScanJob*)context;
+    size_t count = 0;
+
+    for (size_t i = start; i < end; i++) {
+        if (containsEntry(job->other, &job->entries[i]) == job->keepFound) {
+            job->kept[start + count++] = job->entries[i];
+        }
+    }
+
+    job->starts[part] = start;
+    job->counts[part] = count;
+}
+
+/**
+ * @brief Keep the entries of a table that are (or aren't) in another set, looking them up across the workers.
+ *
+ * @param kept Room for every entry, where the entries kept are written in order
+ * @return     The no. entries kept
+ *
+ * The lookups only read the sets, as the hash of an element is cached when it is inserted.
+ */
+static size_t parallelScan(SetEntry* entries, size_t count, ObjSet* other, bool keepFound, SetEntry* kept) {
+    ScanJob job = {.entries = entries, .other = other, .keepFound = keepFound, .kept = kept};
+    int parts = runParallel(scanPart, &job, count);
+
+    // Move the entries each part kept down to follow those of the part before
+    size_t total = 0;
+    for (int i = 0; i < parts; i++) {
+        memmove(kept + total, kept + job.starts[i], job.counts[i] * sizeof(SetEntry));
+        total += job.counts[i];
+    }
+
+    return total;
+}
+
+typedef struct {
+    SetEntry* entries;
+    ObjSet* other;
+    bool isMissing[MAX_WORKERS];
+} SubsetJob;
+
+static void subsetPart(void* context, int part, size_t start, size_t end) {
+    SubsetJob* job = (SubsetJob*)context;
+    job->isMissing[part] = false;
+
+    for (size_t i = start; i < end; i++) {
+        if (!containsEntry(job->other, &job->entries[i])) {
+            job->isMissing[part] = true;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Checks if every element of a table is in a set, looking them up across the workers.
+ */
+static bool parallelSubset(ObjSet* a, ObjSet* b) {
+    SubsetJob job = {.entries = a->entries, .other = b};
+    int parts = runParallel(subsetPart, &job, a->count);
+
+    for (int i = 0; i < parts; i++) {
+        if (job.isMissing[i]) return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Checks if a set is a table large enough to scan across the workers.
+ */
+static bool isParallelTable(ObjSet* set) {
+    return set->bits == NULL && set->root == NULL && isParallel(set->count);
 }
 
 // --- Sets --- 
@@ -80,53 +632,125 @@ ObjSet* newSet(GC* gc) {
     return set;
 }
 
+/**
+ * @brief Create an empty set that is a table with room for a no. elements.
+ *
+ * Unlike an empty set, it never becomes a bitset, so its elements stay in the order they are inserted.
+ */
+ObjSet* newTableSet(GC* gc, size_t count) {
+    ObjSet* set = newSet(gc);
+    pushTemp(gc, OBJ_VAL(set));
+    reserveTable(gc, set, count > 0 ? count : 1);
+    popTemp(gc);
+    return set;
+}
+
 void freeSet(GC* gc, ObjSet* set) {
-    FREE_ARRAY(gc, SetEntry, set->entries, set->capacity);
+    FREE_ARRAY(gc, SetEntry, set->entries, maxSetCount(set->capacity));
+    FREE_ARRAY(gc, uint8_t, set->control, set->capacity);
+    FREE_ARRAY(gc, uint32_t, set->indices, set->capacity);
+    FREE_ARRAY(gc, uint64_t, set->bits, set->bitCapacity);
     initSet(set);
-    FREE(gc, ObjSet, set); 
 }
 
 bool setInsert(GC* gc, ObjSet* set, Value value) {
     pushTemp(gc, OBJ_VAL(set));
+    writeBarrier(gc, (Obj*)set);
 
-    if(set->count + 1 > set->capacity * SET_MAX_LOAD) {
-        size_t capacity = GROW_CAPACITY(set->capacity);
-        adjustCapacity(gc, set, capacity);
+    if (set->root != NULL) {
+        bool isNewKey;
+        set->root = hamtInsert(gc, set->root, (SetEntry){.key = value, .hash = hashValue(value)}, &isNewKey);
+        if (isNewKey) {
+            set->count++;
+            set->isHashed = false;
+        }
+
+        popTemp(gc);
+        return isNewKey;
     }
 
-    hash_t hash = hashValue(value);
+    // An empty set starts as a bitset, and stays one until a value doesn't fit
+    if (set->bits != NULL || set->capacity == 0) {
+        bool isNewKey;
+        if (bitsetInsert(gc, set, value, &isNewKey)) {
+            popTemp(gc);
+            return isNewKey;
+        }
 
-    SetEntry* entry = findEntry(set->entries, set->capacity, value, hash);
-    bool isNewKey = IS_NULL(entry->key); // Change for better NULL entry checking
-    if (isNewKey) set->count++;
+        if (set->bits != NULL) bitsetToTable(gc, set);
+    }
 
-    entry->key = value;
-    entry->hash = hash;
+    bool isNewKey = growingInsert(gc, set, value, hashValue(value));
 
     popTemp(gc);
     return isNewKey;
 }
 
+/**
+ * @brief Insert an element of another set, reusing its hash.
+ *
+ * The set must be reachable by the GC.
+ */
+static bool insertEntry(GC* gc, ObjSet* set, SetEntry* entry) {
+    if (set->root != NULL) {
+        bool isNewKey;
+        set->root = hamtInsert(gc, set->root, *entry, &isNewKey);
+        if (isNewKey) {
+            set->count++;
+            set->isHashed = false;
+        }
+        return isNewKey;
+    }
+
+    if (set->bits != NULL || set->capacity == 0) {
+        bool isNewKey;
+        if (bitsetInsert(gc, set, entry->key, &isNewKey)) return isNewKey;
+
+        if (set->bits != NULL) bitsetToTable(gc, set);
+    }
+
+    return growingInsert(gc, set, entry->key, entry->hash);
+}
+
+/**
+ * @brief Insert the elements of a table from one index up to another, in order and reusing their hashes.
+ */
+void setInsertEntries(GC* gc, ObjSet* set, ObjSet* table, size_t start, size_t end) {
+    pushTemp(gc, OBJ_VAL(set));
+    writeBarrier(gc, (Obj*)set);
+
+    for (size_t i = start; i < end; i++) {
+        insertEntry(gc, set, &table->entries[i]);
+    }
+
+    popTemp(gc);
+}
+
 bool setContains(ObjSet* set, Value value) {
     if(set->count == 0) return false;
+    if (set->bits != NULL) return bitsetContains(set, value);
+    if (set->root != NULL) return hamtFind(set->root, value, hashValue(value)) != NULL;
 
-    SetEntry* entry = findEntry(set->entries, set->capacity, value, hashValue(value));
+    bool found;
+    findSlot(set, value, hashValue(value), &found);
 
-    return !IS_NULL(entry->key);
+    return found;
 }
 
 bool setsEqual(ObjSet* a, ObjSet* b) {
     assert(a != NULL && b != NULL);
 
+    if (a == b) return true;
     if (a->count != b->count) return false;
+    if (a->isHashed && b->isHashed && a->hash != b->hash) return false;
+    if (a->bits != NULL && b->bits != NULL) return bitsetIsSubset(a, b);
+    if (isParallelTable(a)) return parallelSubset(a, b);
     
-    for (int i = 0; i < a->capacity; i++) {
-        Value valA = getSetValue(a, i);
-        if (IS_NULL(valA)) continue;
+    SetIterator iterator;
+    initSetIterator(&iterator, a);
 
-        if (!setContains(b, valA)) {
-            return false;
-        }
+    for (SetEntry* entry = nextSetEntry(&iterator); entry != NULL; entry = nextSetEntry(&iterator)) {
+        if (!setContains(b, entry->key)) return false;
     }
 
     return true;
@@ -135,6 +759,8 @@ bool setsEqual(ObjSet* a, ObjSet* b) {
 ObjSet* setIntersect(GC* gc, ObjSet* a, ObjSet* b) {
     assert(a != NULL && b != NULL);
 
+    if (a->bits != NULL && b->bits != NULL) return bitsetIntersect(gc, a, b);
+
     ObjSet* result = newSet(gc);
     pushTemp(gc, OBJ_VAL(result));
 
@@ -145,23 +771,65 @@ ObjSet* setIntersect(GC* gc, ObjSet* a, ObjSet* b) {
         b = temp;
     }
 
-    for (int i = 0; i < a->capacity; i++) {
-        Value valA = getSetValue(a, i);
-        if (IS_NULL(valA)) continue;
+    // The result can't outgrow the smaller set, and is left to become a bitset if either set is one
+    if (a->bits == NULL && b->bits == NULL) reserveTable(gc, result, a->count);
+
+    if (b->bits == NULL && isParallelTable(a)) {
+        result->count = parallelScan(a->entries, a->count, b, true, result->entries);
+        finishTable(gc, result);
+
+        popTemp(gc);
+        return result;
+    }
+
+    SetIterator iterator;
+    initSetIterator(&iterator, a);
 
-        if (setContains(b, valA)) setInsert(gc, result, valA);
+    for (SetEntry* entry = nextSetEntry(&iterator); entry != NULL; entry = nextSetEntry(&iterator)) {
+        if (containsEntry(b, entry)) insertEntry(gc, result, entry);
     }
 
+    if (result->bits == NULL) trimTable(gc, result);
+
     popTemp(gc);
     return result;
 }
 
-ObjSet* setUnion(GC* gc, ObjSet* a, ObjSet* b) {
-    assert(a != NULL && b != NULL);
+/**
+ * @brief Checks if the result of changing a large set by a small one should share the large set's nodes.
+ *
+ * Sharing makes the change cost O(k log n) rather than O(n), but a trie is slower to search than
+ * a flat table, so it is only used when the large set dwarfs the change.
+ */
+static bool shareStructure(ObjSet* large, ObjSet* small) {
+    if (large->bits != NULL) return false;
+    if (large->root == NULL && large->count < SET_PERSISTENT_MIN) return false;
+
+    return small->count * SET_PERSISTENT_RATIO <= large->count;
+}
 
+/**
+ * @brief Create a persistent set with the elements of another set.
+ */
+static ObjSet* persistentCopy(GC* gc, ObjSet* set) {
     ObjSet* result = newSet(gc);
     pushTemp(gc, OBJ_VAL(result));
 
+    ObjSetNode* root = set->root != NULL ? set->root : hamtBuild(gc, set);
+    result->root = root;
+    result->count = set->count;
+    result->hash = set->hash;
+    result->isHashed = set->isHashed;
+
+    popTemp(gc);
+    return result;
+}
+
+ObjSet* setUnion(GC* gc, ObjSet* a, ObjSet* b) {
+    assert(a != NULL && b != NULL);
+
+    if (a->bits != NULL && b->bits != NULL) return bitsetUnion(gc, a, b);
+
     // Duplicate larger set
     if (a->count < b->count) {
         ObjSet* temp = a;
@@ -169,19 +837,78 @@ ObjSet* setUnion(GC* gc, ObjSet* a, ObjSet* b) {
         b = temp;
     }
 
-    // Mem copy a
-    SetEntry* entries = ALLOCATE(gc, SetEntry, a->capacity);
-    memcpy(entries, a->entries, a->capacity * sizeof(SetEntry));
+    SetIterator iterator;
+
+    if (shareStructure(a, b)) {
+        ObjSet* result = persistentCopy(gc, a);
+        pushTemp(gc, OBJ_VAL(result));
 
-    result->entries = entries;
-    result->capacity = a->capacity;
-    result->count = a->count;
+        initSetIterator(&iterator, b);
+
+        for (SetEntry* entry = nextSetEntry(&iterator); entry != NULL; entry = nextSetEntry(&iterator)) {
+            bool added;
+            result->root = hamtInsert(gc, result->root, *entry, &added);
+            if (added) {
+                result->count++;
+                result->isHashed = false;
+            }
+        }
 
-    // Add in b - DO NOT COPY B - THE HASHES WILL BE MESSED UP
-    for (int i = 0; i < b->capacity; i++) {
-        Value valB = getSetValue(b, i);
-        if (IS_NULL(valB)) continue;
-        setInsert(gc, result, valB);
+        popTemp(gc);
+        return result;
+    }
+
+    ObjSet* result = newSet(gc);
+    pushTemp(gc, OBJ_VAL(result));
+
+    if (a->bits != NULL || b->bits != NULL) {
+        // The result may still be a bitset
+        initSetIterator(&iterator, a);
+
+        for (SetEntry* entry = nextSetEntry(&iterator); entry != NULL; entry = nextSetEntry(&iterator)) {
+            insertEntry(gc, result, entry);
+        }
+
+        initSetIterator(&iterator, b);
+
+        for (SetEntry* entry = nextSetEntry(&iterator); entry != NULL; entry = nextSetEntry(&iterator)) {
+            insertEntry(gc, result, entry);
+        }
+
+        popTemp(gc);
+        return result;
+    }
+
+    // Size the result for both sets up front, so it is never rehashed while b is added
+    if (a->root == NULL && isParallelTable(b)) {
+        copyTable(gc, result, a, a->count + b->count);
+
+        size_t added = parallelScan(b->entries, b->count, a, false, result->entries + result->count);
+        for (size_t i = result->count; i < result->count + added; i++) {
+            slotEntry(result, i);
+        }
+        result->count += added;
+
+        popTemp(gc);
+        return result;
+    }
+
+    if (a->root == NULL) {
+        copyTable(gc, result, a, a->count + b->count);
+    } else {
+        reserveTable(gc, result, a->count + b->count);
+
+        initSetIterator(&iterator, a);
+
+        for (SetEntry* entry = nextSetEntry(&iterator); entry != NULL; entry = nextSetEntry(&iterator)) {
+            tableInsert(result, entry->key, entry->hash);
+        }
+    }
+
+    initSetIterator(&iterator, b);
+
+    for (SetEntry* entry = nextSetEntry(&iterator); entry != NULL; entry = nextSetEntry(&iterator)) {
+        tableInsert(result, entry->key, entry->hash);
     }
 
     popTemp(gc);
@@ -191,34 +918,187 @@ ObjSet* setUnion(GC* gc, ObjSet* a, ObjSet* b) {
 ObjSet* setDifference(GC* gc, ObjSet* a, ObjSet* b) {
     assert(a != NULL && b != NULL);
 
+    if (a->bits != NULL && b->bits != NULL) return bitsetDifference(gc, a, b);
+
+    SetIterator iterator;
+
+    if (shareStructure(a, b)) {
+        ObjSet* result = persistentCopy(gc, a);
+        pushTemp(gc, OBJ_VAL(result));
+
+        initSetIterator(&iterator, b);
+
+        for (SetEntry* entry = nextSetEntry(&iterator); entry != NULL && result->root != NULL; entry = nextSetEntry(&iterator)) {
+            bool removed;
+            result->root = hamtRemove(gc, result->root, entry->key, entry->hash, &removed);
+            if (removed) {
+                result->count--;
+                result->isHashed = false;
+            }
+        }
+
+        popTemp(gc);
+        return result;
+    }
+
     ObjSet* result = newSet(gc);
     pushTemp(gc, OBJ_VAL(result));
 
-    for (int i = 0; i < a->capacity; i++) {
-        Value valA = getSetValue(a, i);
-        if (IS_NULL(valA)) continue;
+    // The result can't outgrow a, and is left to become a bitset if a is one
+    if (a->bits == NULL) reserveTable(gc, result, a->count);
 
-        if (!setContains(b, valA)) {
-            setInsert(gc, result, valA);
-        }
+    if (isParallelTable(a)) {
+        result->count = parallelScan(a->entries, a->count, b, false, result->entries);
+        finishTable(gc, result);
+
+        popTemp(gc);
+        return result;
+    }
+
+    initSetIterator(&iterator, a);
+
+    for (SetEntry* entry = nextSetEntry(&iterator); entry != NULL; entry = nextSetEntry(&iterator)) {
+        if (!containsEntry(b, entry)) insertEntry(gc, result, entry);
     }
 
+    if (result->bits == NULL) trimTable(gc, result);
+
     popTemp(gc);
     return result;
 }
 
+/**
+ * @brief Add the elements of b to a, which nothing else may reference.
+ */
+void setUnionInPlace(GC* gc, ObjSet* a, ObjSet* b) {
+    assert(a != NULL && b != NULL);
+    if (a == b) return;
+
+    if (a->bits != NULL && b->bits != NULL) {
+        if (a->bitCapacity < b->bitCapacity) {
+            a->bits = GROW_ARRAY(gc, uint64_t, a->bits, a->bitCapacity, b->bitCapacity);
+            memset(a->bits + a->bitCapacity, 0, (b->bitCapacity - a->bitCapacity) * sizeof(uint64_t));
+            a->bitCapacity = b->bitCapacity;
+        }
+
+        for (size_t i = 0; i < b->bitCapacity; i++) {
+            a->bits[i] |= b->bits[i];
+        }
+
+        countBits(a);
+        a->isHashed = false;
+        return;
+    }
+
+    pushTemp(gc, OBJ_VAL(a));
+    writeBarrier(gc, (Obj*)a);
+
+    if (a->root == NULL && a->bits == NULL && b->bits == NULL) reserveTable(gc, a, a->count + b->count);
+
+    SetIterator iterator;
+    initSetIterator(&iterator, b);
+
+    for (SetEntry* entry = nextSetEntry(&iterator); entry != NULL; entry = nextSetEntry(&iterator)) {
+        insertEntry(gc, a, entry);
+    }
+
+    popTemp(gc);
+}
+
+/**
+ * @brief Remove the elements of b from a, which nothing else may reference.
+ *
+ * A table only ever has elements added, so it is compacted and its slots rebuilt, unless it is large and
+ * b is small, when it becomes a persistent set that elements can be removed from one at a time.
+ */
+void setDifferenceInPlace(GC* gc, ObjSet* a, ObjSet* b) {
+    assert(a != NULL && b != NULL);
+
+    // Every element is removed, and b can't be walked while its trie is replaced
+    if (a == b) {
+        if (a->bits != NULL) memset(a->bits, 0, a->bitCapacity * sizeof(uint64_t));
+        a->root = NULL;
+        a->count = 0;
+        a->isHashed = false;
+        if (a->capacity > 0) slotEntries(a);
+        return;
+    }
+
+    SetIterator iterator;
+
+    if (a->bits != NULL) {
+        initSetIterator(&iterator, b);
+
+        for (SetEntry* entry = nextSetEntry(&iterator); entry != NULL; entry = nextSetEntry(&iterator)) {
+            if (!bitsetContains(a, entry->key)) continue;
+
+            size_t bit = (size_t)AS_NUMBER(entry->key);
+            a->bits[bit / 64] &= ~(1ULL << (bit % 64));
+            a->count--;
+            a->isHashed = false;
+        }
+        return;
+    }
+
+    pushTemp(gc, OBJ_VAL(a));
+    writeBarrier(gc, (Obj*)a);
+
+    if (a->root == NULL && a->count > 0 && shareStructure(a, b)) {
+        ObjSetNode* root = hamtBuild(gc, a);
+
+        FREE_ARRAY(gc, SetEntry, a->entries, maxSetCount(a->capacity));
+        FREE_ARRAY(gc, uint8_t, a->control, a->capacity);
+        FREE_ARRAY(gc, uint32_t, a->indices, a->capacity);
+        a->entries = NULL;
+        a->control = NULL;
+        a->indices = NULL;
+        a->capacity = 0;
+        a->root = root;
+    }
+
+    if (a->root != NULL) {
+        initSetIterator(&iterator, b);
+
+        for (SetEntry* entry = nextSetEntry(&iterator); entry != NULL && a->root != NULL; entry = nextSetEntry(&iterator)) {
+            bool removed;
+            a->root = hamtRemove(gc, a->root, entry->key, entry->hash, &removed);
+            if (removed) {
+                a->count--;
+                a->isHashed = false;
+            }
+        }
+
+        popTemp(gc);
+        return;
+    }
+
+    popTemp(gc);
+
+    // Keep the remaining elements in order, then slot them again
+    size_t count = 0;
+    for (size_t i = 0; i < a->count; i++) {
+        if (!containsEntry(b, &a->entries[i])) a->entries[count++] = a->entries[i];
+    }
+
+    if (count != a->count) {
+        a->count = count;
+        a->isHashed = false;
+        slotEntries(a);
+    }
+}
+
 bool isSubset(ObjSet* a, ObjSet* b) {
     assert(a != NULL && b != NULL);
     
     if (a->count > b->count) return false;
+    if (a->bits != NULL && b->bits != NULL) return bitsetIsSubset(a, b);
+    if (isParallelTable(a)) return parallelSubset(a, b);
 
-    for (int i = 0; i < a->capacity; i++) {
-        Value valA = getSetValue(a, i);
-        if (IS_NULL(valA)) continue;
-        
-        if (!setContains(b, valA)) {
-            return false;
-        }
+    SetIterator iterator;
+    initSetIterator(&iterator, a);
+
+    for (SetEntry* entry = nextSetEntry(&iterator); entry != NULL; entry = nextSetEntry(&iterator)) {
+        if (!setContains(b, entry->key)) return false;
     }
 
     return true;
@@ -231,44 +1111,46 @@ bool isProperSubset(ObjSet* a, ObjSet* b) {
     return isSubset(a, b);
 }
 
-Value getArb(ObjSet* set) {
-    if (set->capacity == 0) return NULL_VAL;
+/**
+ * @brief Get a uniformly random element of a set, or null if it is empty.
+ *
+ * @param rng The state of the VM's random numbers
+ */
+Value getArb(ObjSet* set, pcg32_random_t* rng) {
+    if (set->count == 0) return NULL_VAL;
 
-    int randIndex = rand() % set->capacity;
+    uint32_t index = pcg32_boundedrand_r(rng, (uint32_t)set->count);
 
-    for (int i = randIndex; i < set->capacity; i++) {
-        Value val = getSetValue(set, i);
-        if (IS_NULL(val)) continue;
+    if (set->root != NULL) return hamtEntryAt(set->root, index)->key;
+    if (set->bits != NULL) return NUMBER_VAL(selectSetBit(set, index));
 
-        return val;
-    }
-    
-    return getArb(set); // Repeat until one is found
+    return getSetValue(set, index);
 }
 
 void printSet(ObjSet* set) {
     int numElements = set->count;
     int count = 0;
     
-    fputc('{', stdout);
-    for (int i = 0; i < set->capacity; i++) {
-        Value value = getSetValue(set, i);
-        if (!IS_NULL(value)) {
-            if (IS_OBJ(value) && IS_STRING(value)) {
-                fputc('"', stdout);
-                printValue(getSetValue(set, i), false);
-                fputc('"', stdout);
-            } else if (IS_CHAR(value)) {
-                fputc('\'', stdout);
-                printValue(getSetValue(set, i), false);
-                fputc('\'', stdout);
-            } else {
-                printValue(getSetValue(set, i), false);
-            }
+    SetIterator iterator;
+    initSetIterator(&iterator, set);
 
-            if (count < numElements - 1) fputs(", ", stdout);
-            count++;
+    fputc('{', stdout);
+    for (SetEntry* entry = nextSetEntry(&iterator); entry != NULL; entry = nextSetEntry(&iterator)) {
+        Value value = entry->key;
+        if (IS_OBJ(value) && IS_STRING(value)) {
+            fputc('"', stdout);
+            printValue(value, false);
+            fputc('"', stdout);
+        } else if (IS_CHAR(value)) {
+            fputc('\'', stdout);
+            printValue(value, false);
+            fputc('\'', stdout);
+        } else {
+            printValue(value, false);
         }
+
+        if (count < numElements - 1) fputs(", ", stdout);
+        count++;
     }
     fputc('}', stdout);
 }   
@@ -292,27 +1174,29 @@ unsigned char* setToString(ObjSet* set) {
     int numElements = set->count;
     int count = 0;
 
-    for (int i = 0; i < set->capacity; i++) {
-        Value value = getSetValue(set, i);
-        if (!IS_NULL(value)) {
-            // if (count == MAX_PRINT_ELEMENTS) {
-            //     sb_appendf(sb, "...");
-            //     break;
-            // }
-            
-            unsigned char* str = valueToString(value);
-            if (IS_OBJ(value) && IS_STRING(value)) {
-                sb_appendf(sb, "\"%s\"", str);
-            } else if (IS_CHAR(value)) {
-                sb_appendf(sb, "'%s'", str);
-            } else {
-                sb_appendf(sb, "%s", str);
-            }
-            free(str);
+    SetIterator iterator;
+    initSetIterator(&iterator, set);
+
+    for (SetEntry* entry = nextSetEntry(&iterator); entry != NULL; entry = nextSetEntry(&iterator)) {
+        Value value = entry->key;
 
-            if (count < numElements - 1) sb_append(sb, ", ");
-            count++;
+        // if (count == MAX_PRINT_ELEMENTS) {
+        //     sb_appendf(sb, "...");
+        //     break;
+        // }
+        
+        unsigned char* str = valueToString(value);
+        if (IS_OBJ(value) && IS_STRING(value)) {
+            sb_appendf(sb, "\"%s\"", str);
+        } else if (IS_CHAR(value)) {
+            sb_appendf(sb, "'%s'", str);
+        } else {
+            sb_appendf(sb, "%s", str);
         }
+        free(str);
+
+        if (count < numElements - 1) sb_append(sb, ", ");
+        count++;
     }
 
     sb_append(sb, "}");
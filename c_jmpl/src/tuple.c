@@ -8,20 +8,23 @@
 #include "utils.h"
 #include "../lib/c-stringbuilder/sb.h"
 
+/**
+ * @brief Allocate a tuple in one slot with its elements.
+ *
+ * The elements are left unset, so they must all be set before anything else is allocated.
+ */
 ObjTuple* newTuple(GC* gc, size_t size) {
-    ObjTuple* tuple = ALLOCATE_OBJ(gc, ObjTuple, OBJ_TUPLE, true);
-    tuple->size = size;
-    tuple->elements = ALLOCATE(gc, Value, size); 
-    
-    for (size_t i = 0; i < size; i++) {
-        tuple->elements[i] = NULL_VAL;
-    }
-    
+    ObjTuple* tuple = (ObjTuple*)allocateObject(gc, sizeof(ObjTuple) + size * sizeof(Value), OBJ_TUPLE, true);
+    tuple->size = (uint32_t)size;
+    tuple->isHashed = false;
+
     return tuple;
 }
 
 bool tuplesEqual(ObjTuple* a, ObjTuple* b) {
+    if (a == b) return true;
     if (a->size != b->size) return false;
+    if (a->isHashed && b->isHashed && a->hash != b->hash) return false;
     
     for (size_t i = 0; i < a->size; i++) {
         Value valA = a->elements[i];
@@ -50,17 +53,11 @@ ObjTuple* sliceTuple(GC* gc, ObjTuple* tuple, int start, int end) {
     size_t length = (start <= end && start < tuple->size) ? end - start + 1 : 0;
 
     pushTemp(gc, OBJ_VAL(tuple));
-
-    ObjTuple* result = ALLOCATE_OBJ(gc, ObjTuple, OBJ_TUPLE, true);
-
-    Value* elements = ALLOCATE(gc, Value, length);
-    memcpy(elements, tuple->elements + start, length * sizeof(Value));
-
-    result->size = length;
-    result->elements = elements;
-
+    ObjTuple* result = newTuple(gc, length);
     popTemp(gc);
 
+    memcpy(result->elements, tuple->elements + start, length * sizeof(Value));
+
     return result;
 }
 
@@ -74,24 +71,13 @@ ObjTuple* sliceTuple(GC* gc, ObjTuple* tuple, int start, int end) {
 ObjTuple* concatenateTuple(GC* gc, ObjTuple* a, ObjTuple* b) {
     pushTemp(gc, OBJ_VAL(a));
     pushTemp(gc, OBJ_VAL(b));
-
-    ObjTuple* tuple = ALLOCATE_OBJ(gc, ObjTuple, OBJ_TUPLE, true);
-    pushTemp(gc, OBJ_VAL(tuple));
-    tuple->size = 0;
-    tuple->elements = NULL;
-    
-    size_t size = a->size + b->size;
-    Value* elements = ALLOCATE(gc, Value, size);
-    memcpy(elements, a->elements, a->size * sizeof(Value));
-    memcpy(elements + a->size, b->elements, b->size * sizeof(Value));
-
-    tuple->elements = elements;
-    tuple->size = size;
-
-    popTemp(gc);
+    ObjTuple* tuple = newTuple(gc, (size_t)a->size + b->size);
     popTemp(gc);
     popTemp(gc);
-    
+
+    memcpy(tuple->elements, a->elements, a->size * sizeof(Value));
+    memcpy(tuple->elements + a->size, b->elements, b->size * sizeof(Value));
+
     return tuple;
 }
 
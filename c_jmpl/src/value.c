@@ -8,6 +8,7 @@
 #include "obj_string.h"
 #include "set.h"
 #include "tuple.h"
+#include "range.h"
 #include "memory.h"
 #include "utils.h"
 #include "hash.h"
@@ -51,11 +52,16 @@ bool valuesEqual(Value a, Value b) {
         ObjType aType = AS_OBJ(a)->type;
         ObjType bType = AS_OBJ(b)->type;
 
+        // A range is equal to a set with the same elements
+        if (aType == OBJ_RANGE && bType == OBJ_SET) return rangeEqualsSet(AS_RANGE(a), AS_SET(b));
+        if (aType == OBJ_SET && bType == OBJ_RANGE) return rangeEqualsSet(AS_RANGE(b), AS_SET(a));
+
         if (aType != bType) return false;
 
         switch(AS_OBJ(a)->type) {
             case OBJ_SET:   return setsEqual(AS_SET(a), AS_SET(b));
             case OBJ_TUPLE: return tuplesEqual(AS_TUPLE(a), AS_TUPLE(b));
+            case OBJ_RANGE: return rangesEqual(AS_RANGE(a), AS_RANGE(b));
             default:        return AS_OBJ(a) == AS_OBJ(b);
         }
     } else {
@@ -74,9 +80,14 @@ bool valuesEqual(Value a, Value b) {
         case VAL_NUMBER: return AS_NUMBER(a) == AS_NUMBER(b);
         case VAL_CHAR:   return AS_CHAR(a) == AS_CHAR(b);
         case VAL_OBJ:    
+            if (IS_RANGE(a) && IS_SET(b)) return rangeEqualsSet(AS_RANGE(a), AS_SET(b));
+            if (IS_SET(a) && IS_RANGE(b)) return rangeEqualsSet(AS_RANGE(b), AS_SET(a));
+            if (AS_OBJ(a)->type != AS_OBJ(b)->type) return false;
+
             switch(AS_OBJ(a)->type) {
                 case OBJ_SET:   return setsEqual(AS_SET(a), AS_SET(b));
                 case OBJ_TUPLE: return tuplesEqual(AS_TUPLE(a), AS_TUPLE(b));
+                case OBJ_RANGE: return rangesEqual(AS_RANGE(a), AS_RANGE(b));
                 default:        return AS_OBJ(a) == AS_OBJ(b);
             }
 
@@ -151,8 +162,8 @@ unsigned char* valueToString(Value value) {
             return tupleToString(AS_TUPLE(value));
         }
 
-        if (IS_ITERATOR(value)) {
-            return strdup("<iterator>");
+        if (IS_RANGE(value)) {
+            return rangeToString(AS_RANGE(value));
         }
     }
 
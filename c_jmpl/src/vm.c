@@ -18,47 +18,56 @@
 #include "utils.h"
 #include "gc.h"
 #include "iterator.h"
+#include "range.h"
+#include "parallel.h"
 
 // Check for types on the stack
-#define T_BOOL(n)     (IS_BOOL(peek(n)))
-#define T_NULL(n)     (IS_NULL(peek(n)))
-#define T_NUM(n)      (IS_NUMBER(peek(n)))
-#define T_INT(n)      (IS_INTEGER(peek(n)))
-#define T_CHAR(n)     (IS_CHAR(peek(n)))
-#define T_OBJ(n)      (IS_OBJ(peek(n)))
-
-#define T_CLOSURE(n)  (IS_CLOSURE(peek(n)))
-#define T_FUNC(n)     (IS_FUNCTION(peek(n)))
-#define T_NATIVE(n)   (IS_NATIVE(peek(n)))
-#define T_STRING(n)   (IS_STRING(peek(n)))
-#define T_MODULE(n)   (IS_MODULE(peek(n)))
-#define T_SET(n)      (IS_SET(peek(n)))
-#define T_TUPLE(n)    (IS_TUPLE(peek(n)))
-#define T_ITER(n)     (IS_ITERATOR(peek(n)))
+#define T_BOOL(n)     (IS_BOOL(peek(vm, n)))
+#define T_NULL(n)     (IS_NULL(peek(vm, n)))
+#define T_NUM(n)      (IS_NUMBER(peek(vm, n)))
+#define T_INT(n)      (IS_INTEGER(peek(vm, n)))
+#define T_CHAR(n)     (IS_CHAR(peek(vm, n)))
+#define T_OBJ(n)      (IS_OBJ(peek(vm, n)))
+
+#define T_CLOSURE(n)  (IS_CLOSURE(peek(vm, n)))
+#define T_FUNC(n)     (IS_FUNCTION(peek(vm, n)))
+#define T_NATIVE(n)   (IS_NATIVE(peek(vm, n)))
+#define T_STRING(n)   (IS_STRING(peek(vm, n)))
+#define T_MODULE(n)   (IS_MODULE(peek(vm, n)))
+#define T_SET(n)      (IS_SET(peek(vm, n)))
+#define T_TUPLE(n)    (IS_TUPLE(peek(vm, n)))
+#define T_RANGE(n)    (IS_RANGE(peek(vm, n)))
+#define T_SET_LIKE(n) (T_SET(n) || T_RANGE(n))
 
 // Check for runtime errors - if !condition then return error
 #define ASSERT_THAT(condition, message) \
     do { \
         if (!(condition)) { \
-            runtimeError(message); \
+            runtimeError(vm, message); \
             return INTERPRET_RUNTIME_ERROR; \
         } \
     } while(false)
 
+// Give up on running code in a worker that it can't run safely, so that it is run again by the main VM
+#define ASSERT_NOT_WORKER() \
+    do { \
+        if (vm->isWorker) return INTERPRET_RUNTIME_ERROR; \
+    } while (false)
 
-// ToDo: swap this for a pointer
-VM vm;
 
-static void resetStack() {
-    vm.stackTop = vm.stack;
-    vm.frameCount = 0;
-    vm.openUpvalues = NULL;
+static void resetStack(VM* vm) {
+    vm->stackTop = vm->stack;
+    vm->frameCount = 0;
+    vm->openUpvalues = NULL;
 }
 
-static void runtimeError(const unsigned char* format, ...) {
+static void runtimeError(VM* vm, const unsigned char* format, ...) {
+    // The error is reported when the main VM runs the code again
+    if (vm->isWorker) return;
+
     // Print the stack trace
-    for (int i = 0; i < vm.frameCount; i++) {
-        CallFrame* frame = &vm.frames[i];
+    for (int i = 0; i < vm->frameCount; i++) {
+        CallFrame* frame = &vm->frames[i];
         ObjFunction* function = frame->closure->function;
         size_t instruction = frame->ip - function->chunk.code - 1;
         fprintf(stderr, "[line %d] in ", getLine(&function->chunk, instruction));
@@ -79,38 +88,162 @@ static void runtimeError(const unsigned char* format, ...) {
     va_end(args);
     fputs(".\n", stderr);
 
-    resetStack();
+    resetStack(vm);
 }
 
-void initVM() {
-    resetStack();
-    initGC(&vm.gc);
+void initVM(VM* vm) {
+    vm->frames = malloc(sizeof(CallFrame) * FRAMES_INITIAL);
+    vm->stack = malloc(sizeof(Value) * STACK_INITIAL);
+    if (vm->frames == NULL || vm->stack == NULL) exit(INTERNAL_SOFTWARE_ERROR);
+
+    vm->frameCapacity = FRAMES_INITIAL;
+    vm->frameLimit = FRAMES_LIMIT_DEFAULT;
+    vm->stackCapacity = STACK_INITIAL;
+
+    resetStack(vm);
+    initGC(&vm->gc, vm);
 
-    vm.impReturnStash = NULL_VAL;
+    vm->impReturnStash = NULL_VAL;
+    vm->isWorker = false;
+    vm->builderEnd = NULL;
+    vm->rng = (pcg32_random_t)PCG32_INITIALIZER;
 
-    initTable(&vm.globals);
-    initTable(&vm.strings);
-    initTable(&vm.modules);
+    vm->globals = NULL;
+    vm->globalCount = 0;
+    vm->globalCapacity = 0;
+    initTable(&vm->globalSlots);
+    initTable(&vm->strings);
+    initTable(&vm->modules);
+    initValueArray(&vm->slots);
+    vm->handles = NULL;
 
     // --- Load core library ---
-    loadModule(defineCoreLibrary());
+    loadModule(vm, defineCoreLibrary(vm));
+}
+
+#ifdef DEBUG_GLOBAL_STATS
+static void printGlobalStats(VM* vm) {
+    printf("------- Global Stats -------\n");
+
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    for (int i = 0; i < vm->globalCount; i++) {
+        Global* global = &vm->globals[i];
+        reads += global->reads;
+        writes += global->writes;
+
+        if (global->reads == 0 && global->writes == 0) continue;
+        printf("%4d %-16s reads: %-10llu writes: %llu\n", i, global->name->utf8, 
+            (unsigned long long)global->reads, (unsigned long long)global->writes);
+    }
+
+    printf("Slots: %d\n", vm->globalCount);
+    printf("Indexed reads: %llu\n", (unsigned long long)reads);
+    printf("Indexed writes: %llu\n", (unsigned long long)writes);
+    printf("----------------------------\n");
+}
+#endif
+
+#ifdef DEBUG_QUICKEN_STATS
+static void printQuickenStats(VM* vm) {
+    static const char* opcodeNames[] = {
+        #define OPCODE(name) #name,
+        #include "opcodes.h"
+        #undef OPCODE
+    };
+
+    printf("------- Quicken Stats -------\n");
+
+    for (int i = 0; i < END; i++) {
+        uint64_t hits = vm->quickenHits[i];
+        uint64_t misses = vm->quickenMisses[i];
+        if (hits == 0 && misses == 0) continue;
+
+        printf("OP_%-18s hits: %-10llu misses: %-10llu hit rate: %.2f%%\n", opcodeNames[i], 
+            (unsigned long long)hits, (unsigned long long)misses, 100.0 * hits / (hits + misses));
+    }
+
+    printf("-----------------------------\n");
+}
+#endif
+
+void freeVM(VM* vm) {
+#ifdef DEBUG_GLOBAL_STATS
+    printGlobalStats(vm);
+#endif
+#ifdef DEBUG_QUICKEN_STATS
+    printQuickenStats(vm);
+#endif
+#ifdef DEBUG_GC_STATS
+    printGCStats(&vm->gc, stdout);
+#endif
+
+    FREE_ARRAY(&vm->gc, Global, vm->globals, vm->globalCapacity);
+    freeTable(&vm->gc, &vm->globalSlots);
+    freeTable(&vm->gc, &vm->strings);
+    freeTable(&vm->gc, &vm->modules);
+    freeValueArray(&vm->gc, &vm->slots);
+    freeGC(&vm->gc);
+
+    while (vm->handles != NULL) {
+        Handle* next = vm->handles->next;
+        free(vm->handles);
+        vm->handles = next;
+    }
+
+    free(vm->frames);
+    free(vm->stack);
+}
+
+/**
+ * @brief Get the slot index of a global variable, adding an undefined slot if it has none.
+ *
+ * @param name The name of the global
+ * @return     The index of its slot in vm->globals
+ */
+int resolveGlobal(VM* vm, ObjString* name) {
+    Value index;
+    if (tableGet(&vm->globalSlots, name, &index)) return (int)AS_NUMBER(index);
+
+    pushTemp(&vm->gc, OBJ_VAL(name));
+
+    if (vm->globalCapacity < vm->globalCount + 1) {
+        int oldCapacity = vm->globalCapacity;
+        vm->globalCapacity = GROW_CAPACITY(oldCapacity);
+        vm->globals = GROW_ARRAY(&vm->gc, Global, vm->globals, oldCapacity, vm->globalCapacity);
+    }
+
+    Global* global = &vm->globals[vm->globalCount];
+    global->name = name;
+    global->value = NULL_VAL;
+    global->isDefined = false;
+#ifdef DEBUG_GLOBAL_STATS
+    global->reads = 0;
+    global->writes = 0;
+#endif
+
+    int slot = vm->globalCount++;
+    tableSet(&vm->gc, &vm->globalSlots, name, NUMBER_VAL(slot));
+    popTemp(&vm->gc);
+
+    return slot;
 }
 
-void freeVM() {
-    freeTable(&vm.gc, &vm.globals);
-    freeTable(&vm.gc, &vm.strings);
-    freeTable(&vm.gc, &vm.modules);
-    freeGC(&vm.gc);
+void defineGlobal(VM* vm, ObjString* name, Value value) {
+    int slot = resolveGlobal(vm, name); // May grow the array
+    Global* global = &vm->globals[slot];
+    global->value = value;
+    global->isDefined = true;
 }
 
-static inline void push(Value value) {
-    *vm.stackTop = value;
-    vm.stackTop++;
+static inline void push(VM* vm, Value value) {
+    *vm->stackTop = value;
+    vm->stackTop++;
 }
 
-static inline Value pop() {
-    vm.stackTop--;
-    return *vm.stackTop;
+static inline Value pop(VM* vm) {
+    vm->stackTop--;
+    return *vm->stackTop;
 }
 
 /**
@@ -119,29 +252,79 @@ static inline Value pop() {
  * @param distance How far down from the top of the stack to look, zero being the top
  * @return         The value at that distance on the stack
  */
-static Value peek(int distance) {
-    return vm.stackTop[-1 - distance];
+static Value peek(VM* vm, int distance) {
+    return vm->stackTop[-1 - distance];
 }
 
-static bool call(ObjClosure* closure, int argCount) {
-    if(argCount != closure->function->arity) {
-        if (closure->function->arity != 1) {
-            runtimeError("Expected %d arguments but got %d", closure->function->arity, argCount);
-        } else {
-            runtimeError("Expected %d argument but got %d", closure->function->arity, argCount);
-        }
-        return false;
+static bool checkArity(VM* vm, int arity, int argCount) {
+    if (argCount == arity) return true;
+
+    if (arity != 1) {
+        runtimeError(vm, "Expected %d arguments but got %d", arity, argCount);
+    } else {
+        runtimeError(vm, "Expected %d argument but got %d", arity, argCount);
     }
+    return false;
+}
 
-    if (vm.frameCount == FRAMES_MAX) {
-        runtimeError("(Internal) Call stack overflow");
+/**
+ * @brief Grow the value stack until there is room for a function's frame, which starts at a given slot.
+ *
+ * Frame slots and open upvalues point into the stack, so they are moved with it.
+ *
+ * @param base The slot of the frame's callee
+ */
+static void ensureStack(VM* vm, size_t base, ObjFunction* function) {
+    // One more for the module OP_IMPORT_LIB pushes before it pops it
+    size_t needed = base + (size_t)function->maxStack + 1;
+    if (needed <= vm->stackCapacity) return;
+
+    while (vm->stackCapacity < needed) vm->stackCapacity *= 2;
+
+    Value* oldStack = vm->stack;
+    vm->stack = realloc(vm->stack, sizeof(Value) * vm->stackCapacity);
+    if (vm->stack == NULL) exit(INTERNAL_SOFTWARE_ERROR);
+
+    if (vm->stack == oldStack) return;
+
+    vm->stackTop = vm->stack + (vm->stackTop - oldStack);
+
+    for (int i = 0; i < vm->frameCount; i++) {
+        vm->frames[i].slots = vm->stack + (vm->frames[i].slots - oldStack);
+    }
+
+    for (ObjUpvalue* upvalue = vm->openUpvalues; upvalue != NULL; upvalue = upvalue->next) {
+        upvalue->location = vm->stack + (upvalue->location - oldStack);
+    }
+}
+
+static bool call(VM* vm, ObjClosure* closure, int argCount) {
+    // Workers can only call functions that don't change what they share
+    if (vm->isWorker && !closure->function->isPure) return false;
+    if (!checkArity(vm, closure->function->arity, argCount)) return false;
+
+    if (vm->frameCount >= vm->frameLimit) {
+        runtimeError(vm, "Call stack overflow (more than %d frames)", vm->frameLimit);
         return false;
     }
 
-    CallFrame* frame = &vm.frames[vm.frameCount++];
+    if (vm->frameCount == vm->frameCapacity) {
+        int newCapacity = vm->frameCapacity * 2;
+        if (newCapacity > vm->frameLimit) newCapacity = vm->frameLimit;
+
+        CallFrame* frames = realloc(vm->frames, sizeof(CallFrame) * newCapacity);
+        if (frames == NULL) exit(INTERNAL_SOFTWARE_ERROR);
+
+        vm->frames = frames;
+        vm->frameCapacity = newCapacity;
+    }
+
+    ensureStack(vm, (size_t)(vm->stackTop - vm->stack) - argCount - 1, closure->function);
+
+    CallFrame* frame = &vm->frames[vm->frameCount++];
     frame->closure = closure;
     frame->ip = closure->function->chunk.code;
-    frame->slots = vm.stackTop - argCount - 1;
+    frame->slots = vm->stackTop - argCount - 1;
 
     return true;
 }
@@ -152,27 +335,20 @@ static bool call(ObjClosure* closure, int argCount) {
  * @param callee   The object to call
  * @param argCount The number of arguments to the callable
  */
-static bool callValue(Value callee, int argCount) {
+static bool callValue(VM* vm, Value callee, int argCount) {
     if(IS_OBJ(callee)) {
         switch (OBJ_TYPE(callee)) {
             case OBJ_CLOSURE:
-                return call(AS_CLOSURE(callee), argCount);
+                return call(vm, AS_CLOSURE(callee), argCount);
             case OBJ_NATIVE: {
                 ObjNative* objNative = AS_NATIVE(callee);
-
-                if(argCount != objNative->arity) {
-                    if (objNative->arity != 1) {
-                        runtimeError("Expected %d arguments but got %d", objNative->arity, argCount);
-                    } else {
-                        runtimeError("Expected %d argument but got %d", objNative->arity, argCount);
-                    }
-                    return false;
-                }
+                if (vm->isWorker && !objNative->isPure) return false;
+                if (!checkArity(vm, objNative->arity, argCount)) return false;
 
                 NativeFn native = objNative->function;
-                Value result = native(&vm, argCount, vm.stackTop - argCount);
-                vm.stackTop -= argCount + 1;
-                push(result);
+                Value result = native(vm, argCount, vm->stackTop - argCount);
+                vm->stackTop -= argCount + 1;
+                push(vm, result);
                 return true;
             }
             default:
@@ -180,13 +356,13 @@ static bool callValue(Value callee, int argCount) {
         }
     }
 
-    runtimeError("Can only call functions");
+    runtimeError(vm, "Can only call functions");
     return false;
 }
 
-static ObjUpvalue* captureUpvalue(Value* local) {
+static ObjUpvalue* captureUpvalue(VM* vm, Value* local) {
     ObjUpvalue* prevUpvalue = NULL;
-    ObjUpvalue* upvalue = vm.openUpvalues;
+    ObjUpvalue* upvalue = vm->openUpvalues;
     while(upvalue != NULL && upvalue->location > local) {
         prevUpvalue = upvalue;
         upvalue = upvalue->next;
@@ -196,11 +372,11 @@ static ObjUpvalue* captureUpvalue(Value* local) {
         return upvalue;
     }
 
-    ObjUpvalue* createdUpvalue = newUpvalue(&vm.gc, local);
+    ObjUpvalue* createdUpvalue = newUpvalue(&vm->gc, local);
     createdUpvalue->next = upvalue;
 
     if(prevUpvalue == NULL) {
-        vm.openUpvalues = createdUpvalue;
+        vm->openUpvalues = createdUpvalue;
     } else {
         prevUpvalue->next = createdUpvalue;
     }
@@ -208,53 +384,90 @@ static ObjUpvalue* captureUpvalue(Value* local) {
     return createdUpvalue;
 }
 
-static void closeUpvalues(Value* last) {
-    while(vm.openUpvalues != NULL && vm.openUpvalues->location >= last) {
-        ObjUpvalue* upvalue = vm.openUpvalues;
+static void closeUpvalues(VM* vm, Value* last) {
+    while(vm->openUpvalues != NULL && vm->openUpvalues->location >= last) {
+        ObjUpvalue* upvalue = vm->openUpvalues;
         upvalue->closed = *upvalue->location;
         upvalue->location = &upvalue->closed;
-        vm.openUpvalues = upvalue->next;
+        writeBarrier(&vm->gc, (Obj*)upvalue);
+        vm->openUpvalues = upvalue->next;
     }
 }
 
-static void setInsertN(int count) {
+/**
+ * @brief Call a closure in tail position by reusing the current frame.
+ *
+ * The callee and its arguments are moved down over the current frame's slots, 
+ * so tail recursion runs in constant stack.
+ */
+static bool tailCall(VM* vm, ObjClosure* closure, int argCount) {
+    if (vm->isWorker && !closure->function->isPure) return false;
+    if (!checkArity(vm, closure->function->arity, argCount)) return false;
+
+    // The callee may need more of the stack than the frame it replaces
+    ensureStack(vm, (size_t)(vm->frames[vm->frameCount - 1].slots - vm->stack), closure->function);
+
+    CallFrame* frame = &vm->frames[vm->frameCount - 1];
+    closeUpvalues(vm, frame->slots);
+
+    memmove(frame->slots, vm->stackTop - argCount - 1, (argCount + 1) * sizeof(Value));
+    vm->stackTop = frame->slots + argCount + 1;
+
+    frame->closure = closure;
+    frame->ip = closure->function->chunk.code;
+    vm->impReturnStash = NULL_VAL; // The caller's stashed value is never returned
+
+    return true;
+}
+
+static void setInsertN(VM* vm, int count) {
     // Uses the temp stack to protect values about to be inserted from being freed too soon
     for (int i = 0; i < count; i++) {
-        Value value = pop();
-        pushTemp(&vm.gc, value);
+        Value value = pop(vm);
+        pushTemp(&vm->gc, value);
     }
     
-    ObjSet* set = AS_SET(pop());
+    ObjSet* set = AS_SET(pop(vm));
 
     for (int i = 0; i < count; i++) {
-        setInsert(&vm.gc, set, vm.gc.tempStack[vm.gc.tempCount - 1]);
-        popTemp(&vm.gc);
+        setInsert(&vm->gc, set, vm->gc.tempStack[vm->gc.tempCount - 1]);
+        popTemp(&vm->gc);
     }
     
-    push(OBJ_VAL(set));
+    push(vm, OBJ_VAL(set));
 }
 
 /**
- * @brief Create an omission set or tuple.
+ * @brief The terms of an omission operation.
+ */
+typedef struct {
+    int first;   // First element
+    int step;    // Signed gap between consecutive elements
+    int size;    // No. elements
+    bool isChar; // If the elements are characters rather than integers
+} Omission;
+
+/**
+ * @brief Pop and validate the terms of an omission operation.
  * 
- * @param isSet   If true -> set, if false -> tuple
- * @param hasNext If there is a 'step' value
- * @return        If the operation succeeded
+ * @param hasNext   If there is a 'step' value
+ * @param omission  The resulting omission
+ * @return          If the operation succeeded
  * 
  * Can be [int, int ... int] or [char, char ... char].
  */
-static InterpretResult omission(bool isSet, bool hasNext) {
+static InterpretResult popOmission(VM* vm, bool hasNext, Omission* omission) {
     bool isIntOmission = T_INT(0) && T_INT(1) && (!hasNext || T_INT(2));
     bool isCharOmission = T_CHAR(0) && T_CHAR(1) && (!hasNext || T_CHAR(2));
 
     ASSERT_THAT(isIntOmission || isCharOmission, "Terms of an omission operation must be all integers or all bcharacters");
 
-    int last = (int)(isCharOmission ? AS_CHAR(pop()) : AS_NUMBER(pop()));
+    int last = (int)(isCharOmission ? AS_CHAR(pop(vm)) : AS_NUMBER(pop(vm)));
     int next = 0;
     if (hasNext) {
-        next =  (int)(isCharOmission ? AS_CHAR(pop()) : AS_NUMBER(pop()));
+        next =  (int)(isCharOmission ? AS_CHAR(pop(vm)) : AS_NUMBER(pop(vm)));
     }
-    int first =  (int)(isCharOmission ? AS_CHAR(pop()) : AS_NUMBER(pop()));
+    int first =  (int)(isCharOmission ? AS_CHAR(pop(vm)) : AS_NUMBER(pop(vm)));
 
     int gap = hasNext ? abs(next - first) : 1;
     ASSERT_THAT(gap != 0, "Omission step cannot be zero");
@@ -265,28 +478,43 @@ static InterpretResult omission(bool isSet, bool hasNext) {
         size = (int)floorl((double)abs(first - last) / (double)gap) + 1;
     }
 
-    int current = first;
-    int step = (first < last) ? gap : -gap;
+    omission->first = first;
+    omission->step = (first < last) ? gap : -gap;
+    omission->size = size;
+    omission->isChar = isCharOmission;
 
-    if (isSet) {
-        ObjSet* set = AS_SET(pop());
-        pushTemp(&vm.gc, OBJ_VAL(set));
+    return INTERPRET_OK;
+}
 
-        for (int i = 0; i < size; i++) {
-            setInsert(&vm.gc, set, isCharOmission ? CHAR_VAL(current) : NUMBER_VAL(current));
-            current += step;
-        }
+/**
+ * @brief Create an omission set or tuple.
+ * 
+ * @param isSet   If true -> set, if false -> tuple
+ * @param hasNext If there is a 'step' value
+ * @return        If the operation succeeded
+ */
+static InterpretResult omission(VM* vm, bool isSet, bool hasNext) {
+    Omission terms;
+    InterpretResult status = popOmission(vm, hasNext, &terms);
+    if (status != INTERPRET_OK) return status;
+
+    int current = terms.first;
+    int step = terms.step;
+    int size = terms.size;
+
+    if (isSet) {
+        // Sets are unordered, so store the range from its smallest element
+        int smallest = (step > 0 || size == 0) ? current : current + (size - 1) * step;
 
-        popTemp(&vm.gc); // set
-        push(OBJ_VAL(set));
+        push(vm, OBJ_VAL(newRange(&vm->gc, smallest, abs(step), size, terms.isChar)));
     } else {
-        ObjTuple* tuple = newTuple(&vm.gc, size);
+        ObjTuple* tuple = newTuple(&vm->gc, size);
 
         for (int i = 0; i < size; i++) {
-            tuple->elements[i] = isCharOmission ? CHAR_VAL(current) : NUMBER_VAL(current);
+            tuple->elements[i] = terms.isChar ? CHAR_VAL(current) : NUMBER_VAL(current);
             current += step;
         }
-        push(OBJ_VAL(tuple));
+        push(vm, OBJ_VAL(tuple));
     }
 
     return INTERPRET_OK;
@@ -306,6 +534,7 @@ static bool isFalse(Value value) {
            (IS_BOOL(value) && !AS_BOOL(value)) ||
            (IS_STRING(value) && AS_CSTRING(value)[0] == '\0') ||
            (IS_SET(value) && AS_SET(value)->count == 0) ||
+           (IS_RANGE(value) && AS_RANGE(value)->count == 0) ||
            (IS_TUPLE(value) && AS_TUPLE(value)->size == 0);
 }
 
@@ -318,6 +547,7 @@ static int getSize(Value value) {
             case OBJ_STRING: return AS_STRING(value)->length;
             case OBJ_SET:    return AS_SET(value)->count;
             case OBJ_TUPLE:  return AS_TUPLE(value)->size;
+            case OBJ_RANGE:  return AS_RANGE(value)->count;
             default:         return -1;
         }
     }
@@ -330,6 +560,7 @@ static int getSize(Value value) {
                 case OBJ_STRING: return AS_STRING(value)->length;
                 case OBJ_SET:    return AS_SET(value)->count;
                 case OBJ_TUPLE:  return AS_TUPLE(value)->size;
+                case OBJ_RANGE:  return AS_RANGE(value)->count;
                 default:         return -1;
             }
             break;
@@ -342,13 +573,58 @@ static int getSize(Value value) {
     return -1;
 }
 
-static InterpretResult indexObj() {
+/**
+ * @brief Checks if a value is a member of a set or a range.
+ */
+static bool setLikeContains(Value set, Value value) {
+    return IS_RANGE(set) ? rangeContains(AS_RANGE(set), value) : setContains(AS_SET(set), value);
+}
+
+/**
+ * @brief Checks if a is a subset of b, where a and b are sets or ranges.
+ * 
+ * @param isProper If the subset must be proper
+ */
+static bool setLikeSubset(Value a, Value b, bool isProper) {
+    if (IS_SET(a) && IS_SET(b)) {
+        return isProper ? isProperSubset(AS_SET(a), AS_SET(b)) : isSubset(AS_SET(a), AS_SET(b));
+    }
+
+    size_t countA = IS_RANGE(a) ? AS_RANGE(a)->count : AS_SET(a)->count;
+    size_t countB = IS_RANGE(b) ? AS_RANGE(b)->count : AS_SET(b)->count;
+    if (countA > countB || (isProper && countA == countB)) return false;
+
+    if (IS_RANGE(a)) {
+        ObjRange* range = AS_RANGE(a);
+        for (size_t i = 0; i < range->count; i++) {
+            if (!setLikeContains(b, getRangeValue(range, i))) return false;
+        }
+    } else {
+        SetIterator iterator;
+        initSetIterator(&iterator, AS_SET(a));
+
+        for (SetEntry* entry = nextSetEntry(&iterator); entry != NULL; entry = nextSetEntry(&iterator)) {
+            if (!setLikeContains(b, entry->key)) return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Get an operand as a set, generating the elements of a range if needed.
+ */
+static ObjSet* toSet(VM* vm, Value value) {
+    return IS_RANGE(value) ? rangeToSet(&vm->gc, AS_RANGE(value)) : AS_SET(value);
+}
+
+static InterpretResult indexObj(VM* vm) {
     ASSERT_THAT(T_INT(0), "Index must be an integer");
 
-    int index = (signed int)AS_NUMBER(pop());
+    int index = (signed int)AS_NUMBER(pop(vm));
     int length;
 
-    Value value = pop();
+    Value value = pop(vm);
     if (IS_TUPLE(value)) {
         length = (int)AS_TUPLE(value)->size;
     } else if (IS_STRING(value)) {
@@ -359,25 +635,27 @@ static InterpretResult indexObj() {
 
     ASSERT_THAT(index >= -length && index < length, "Index out of range");
 
-    push(IS_TUPLE(value) ? indexTuple(AS_TUPLE(value), index) : indexString(AS_STRING(value), index));
+    push(vm, IS_TUPLE(value) ? indexTuple(AS_TUPLE(value), index) : indexString(AS_STRING(value), index));
 
     return INTERPRET_OK;
 }
 
-static InterpretResult sliceObj() {
+static InterpretResult sliceObj(VM* vm) {
     ASSERT_THAT((T_INT(0) || T_NULL(0)) && (T_INT(1) || T_NULL(1)), "Slice indices must be integers or null");
 
-    Value end = pop();
-    Value start = pop();
+    Value end = pop(vm);
+    Value start = pop(vm);
 
     int startIndex = IS_NULL(start) ? 0 : (signed int)AS_NUMBER(start);
     int endIndex;
     int length;
 
-    Value value = pop();
+    Value value = pop(vm);
     if (IS_TUPLE(value)) {
         length = (int)AS_TUPLE(value)->size;
     } else if (IS_STRING(value)) {
+        // New strings are interned in a table shared with the workers
+        ASSERT_NOT_WORKER();
         length = (int)AS_STRING(value)->length;
     } else {
         ASSERT_THAT(false, "Object cannot be sliced");
@@ -386,28 +664,28 @@ static InterpretResult sliceObj() {
     endIndex = IS_NULL(end) ? length - 1 : (signed int)AS_NUMBER(end);
     ASSERT_THAT(startIndex >= -length && endIndex >= -length, "Slice index out of range");
 
-    push(
+    push(vm, 
         IS_TUPLE(value) ?
-        OBJ_VAL(sliceTuple(&vm.gc, AS_TUPLE(value), startIndex, endIndex)) :
-        OBJ_VAL(sliceString(&vm.gc, AS_STRING(value), startIndex, endIndex))
+        OBJ_VAL(sliceTuple(&vm->gc, AS_TUPLE(value), startIndex, endIndex)) :
+        OBJ_VAL(sliceString(&vm->gc, AS_STRING(value), startIndex, endIndex))
     );
 
     return INTERPRET_OK;
 }
 
-static Value importModule(ObjString* path) {
-    pushTemp(&vm.gc, OBJ_VAL(path));
+static Value importModule(VM* vm, ObjString* path) {
+    pushTemp(&vm->gc, OBJ_VAL(path));
 
     // Resolve path name
     unsigned char absolutePath[MAX_PATH_SIZE];
     if (!getAbsolutePath(path->utf8, absolutePath)) {
         // Check if its a built in module
         if (strcmp(path->utf8, "math") == 0) {
-            return OBJ_VAL(defineMathLibrary());
+            return OBJ_VAL(defineMathLibrary(vm));
         } else if (strcmp(path->utf8, "random") == 0) {
-            return OBJ_VAL(defineRandomLibrary());
+            return OBJ_VAL(defineRandomLibrary(vm));
         } else {
-            runtimeError("Could not resolve module at '%s'", absolutePath);
+            runtimeError(vm, "Could not resolve module at '%s'", absolutePath);
             return NULL_VAL;
         }
     }
@@ -415,90 +693,349 @@ static Value importModule(ObjString* path) {
     // Get the module name (file path without the extension)
     unsigned char fileName[MAX_PATH_SIZE];
     getFileName(path->utf8, fileName, MAX_PATH_SIZE);
-    ObjString* moduleName = copyString(&vm.gc, fileName, strlen(fileName));
+    ObjString* moduleName = copyString(&vm->gc, fileName, strlen(fileName));
 
     // Check if module is already loaded
     Value cached;
-    if (tableGet(&vm.modules, moduleName, &cached)) {
+    if (tableGet(&vm->modules, moduleName, &cached)) {
         return cached;
     }
 
     // Create new module
-    pushTemp(&vm.gc, OBJ_VAL(moduleName));
-    ObjModule* module = newModule(&vm.gc, moduleName);
-    tableSet(&vm.gc, &vm.modules, moduleName, OBJ_VAL(module));
-    popTemp(&vm.gc);
+    pushTemp(&vm->gc, OBJ_VAL(moduleName));
+    ObjModule* module = newModule(&vm->gc, moduleName);
+    tableSet(&vm->gc, &vm->modules, moduleName, OBJ_VAL(module));
+    popTemp(&vm->gc);
 
     // Read library source and compile
     unsigned char* moduleSource = readFile(path->utf8);
-    ObjFunction* function = compile(&vm.gc, moduleSource);
+    ObjFunction* function = compile(vm, moduleSource);
     if (function == NULL) {
-        runtimeError("Could not compile module");
+        runtimeError(vm, "Could not compile module");
         return NULL_VAL;
     }
 
     function->name = moduleName;
     free(moduleSource);
 
-    push(OBJ_VAL(function));
-    ObjClosure* closure = newClosure(&vm.gc, function);
-    pop();
+    push(vm, OBJ_VAL(function));
+    ObjClosure* closure = newClosure(&vm->gc, function);
+    pop(vm);
 
-    popTemp(&vm.gc); // Path
+    popTemp(&vm->gc); // Path
 
     return OBJ_VAL(closure);
 }
 
-static InterpretResult run() {
+// --- Parallel set-builders ---
+
+#define CHUNKS_PER_WORKER 8                 // No. chunks a loop is split into per worker, so they finish together
+#define BUILDER_HEAP_MIN (64 * 1024 * 1024) // Fewest bytes a worker can allocate before giving up, as it can't collect
+
+static InterpretResult run(VM* vm);
+
+/**
+ * @brief The elements added by a chunk of a set-builder's loop, which are a run of the set of the worker that ran it.
+ */
+typedef struct {
+    int part;
+    size_t start;
+    size_t end;
+} BuilderChunk;
+
+/**
+ * @brief A set-builder whose first generator's loop is split into chunks, which worker VMs each run into their own set.
+ *
+ * Each worker has a copy of the set-builder's frame, and shares the globals, strings and code of the main VM.
+ */
+typedef struct {
+    VM main;           // The main VM as the loop starts, which the workers are copied from
+    CallFrame frame;   // The set-builder's frame, whose ip is the head of the loop
+    size_t height;     // No. values in the frame
+    uint8_t setSlot;
+    uint8_t stateSlot; // First slot of the loop's state
+    bool isRange;
+    uint8_t* end;      // The OP_BUILDER_END the loop exits to
+    size_t budget;     // Most bytes a worker can allocate
+    size_t chunkSize;
+    size_t chunkCount;
+    BuilderChunk* chunks;
+    VM workers[MAX_WORKERS];
+    ObjSet* sets[MAX_WORKERS]; // The set of each worker, or NULL if it hasn't run a chunk
+} ParallelBuilder;
+
+/**
+ * @brief Set up a worker VM with a copy of a set-builder's frame.
+ */
+static void initWorkerVM(VM* vm, ParallelBuilder* builder) {
+    *vm = builder->main;
+    vm->frames = malloc(sizeof(CallFrame) * FRAMES_INITIAL);
+    // The loop can use as much of the stack as the rest of its function
+    size_t capacity = (size_t)builder->frame.closure->function->maxStack + STACK_INITIAL;
+    vm->stack = malloc(sizeof(Value) * capacity);
+    if (vm->frames == NULL || vm->stack == NULL) exit(INTERNAL_SOFTWARE_ERROR);
+
+    vm->frameCapacity = FRAMES_INITIAL;
+    vm->stackCapacity = capacity;
+    memcpy(vm->stack, builder->frame.slots, builder->height * sizeof(Value));
+
+    resetStack(vm);
+    initGC(&vm->gc, vm);
+    vm->gc.nextGC = SIZE_MAX;
+    vm->gc.budget = builder->budget;
+    vm->gc.stepAt = builder->budget;
+
+    vm->impReturnStash = NULL_VAL;
+    vm->isWorker = true;
+    vm->builderEnd = builder->end;
+}
+
+/**
+ * @brief Get the values of a generator's target from one index up to another as a tuple.
+ */
+static ObjTuple* chunkValues(VM* vm, Obj* target, size_t start, size_t end) {
+    size_t count = 0;
+    size_t index = start;
+    Value value;
+    while (index < end && iterateObj(target, &index, &value) && index <= end) count++;
+
+    ObjTuple* tuple = newTuple(&vm->gc, count);
+    index = start;
+    for (size_t i = 0; i < count; i++) {
+        iterateObj(target, &index, &tuple->elements[i]);
+    }
+
+    return tuple;
+}
+
+/**
+ * @brief Run the indices of a set-builder's loop from start up to end in the worker VM of a part.
+ */
+static bool buildChunk(void* context, int part, size_t start, size_t end) {
+    ParallelBuilder* builder = (ParallelBuilder*)context;
+    VM* vm = &builder->workers[part];
+
+    if (builder->sets[part] == NULL) {
+        initWorkerVM(vm, builder);
+        builder->sets[part] = newTableSet(&vm->gc, 0);
+        vm->stack[builder->setSlot] = OBJ_VAL(builder->sets[part]);
+    }
+
+    // Allocating past the budget jumps back here, so a chunk can't grow the worker's heap without limit
+    jmp_buf overBudget;
+    vm->overBudget = &overBudget;
+    if (setjmp(overBudget) != 0) return false;
+
+    // Start the loop's state at the chunk
+    Value* first = &builder->frame.slots[builder->stateSlot];
+    Value* state = &vm->stack[builder->stateSlot];
+    if (builder->isRange) {
+        int offset = (int)start * (int)AS_NUMBER(first[1]);
+        state[0] = IS_CHAR(first[0]) ? CHAR_VAL(AS_CHAR(first[0]) + offset) : NUMBER_VAL(AS_NUMBER(first[0]) + offset);
+        state[2] = NUMBER_VAL(end - start);
+    } else {
+        state[0] = OBJ_VAL(chunkValues(vm, AS_OBJ(first[0]), start, end));
+        state[1] = NUMBER_VAL(0);
+    }
+
+    vm->frameCount = 1;
+    vm->frames[0] = builder->frame;
+    vm->frames[0].slots = vm->stack;
+    vm->stackTop = vm->stack + builder->height;
+
+    ObjSet* set = builder->sets[part];
+    size_t setStart = set->count;
+    bool isDone = run(vm) == INTERPRET_OK && vm->gc.bytesAllocated <= builder->budget;
+    builder->chunks[start / builder->chunkSize] = (BuilderChunk){.part = part, .start = setStart, .end = set->count};
+
+    return isDone;
+}
+
+/**
+ * @brief Add the elements of the workers' sets to a set-builder's set, in the order the chunks that added them run in.
+ *
+ * Each element is added by the first chunk to generate it, as a worker runs its chunks in order, so the set is the
+ * same as if the loop had been run by one VM.
+ */
+static void mergeBuilder(VM* vm, ParallelBuilder* builder, ObjSet* set) {
+    for (int i = 0; i < MAX_WORKERS; i++) {
+        if (builder->sets[i] == NULL) continue;
+
+        moveObjects(&vm->gc, &builder->workers[i].gc);
+        pushTemp(&vm->gc, OBJ_VAL(builder->sets[i]));
+    }
+
+    for (size_t i = 0; i < builder->chunkCount; i++) {
+        BuilderChunk* chunk = &builder->chunks[i];
+        setInsertEntries(&vm->gc, set, builder->sets[chunk->part], chunk->start, chunk->end);
+    }
+
+    for (int i = 0; i < MAX_WORKERS; i++) {
+        if (builder->sets[i] != NULL) popTemp(&vm->gc);
+    }
+}
+
+/**
+ * @brief Split the first generator's loop of a pure set-builder across the workers, if it is long enough.
+ *
+ * If every chunk is run, the frame jumps to the end of the loop. Otherwise, e.g. if a worker called an impure
+ * function or ran out of memory it can't collect, what the workers made is thrown away and the loop runs as usual.
+ *
+ * @param frame   The set-builder's frame, whose ip is the head of the loop
+ * @param setSlot The slot of the set being built
+ */
+static void runParallelBuilder(VM* vm, CallFrame* frame, uint8_t setSlot) {
+    uint8_t* loop = frame->ip;
+    Value* state = &frame->slots[loop[1]];
+    bool isRange = loop[0] == OP_FOR_RANGE;
+
+    size_t count = isRange ? (size_t)AS_NUMBER(state[2]) : (size_t)getSize(state[0]);
+    if (!isParallelBuilder(count)) return;
+
+    // The workers share the sets in the frame, so none can be changed in place from now on
+    for (Value* slot = frame->slots; slot < vm->stackTop; slot++) {
+        if (IS_SET(*slot)) AS_SET(*slot)->isOwned = false;
+    }
+
+    ParallelBuilder* builder = calloc(1, sizeof(ParallelBuilder));
+    if (builder == NULL) exit(INTERNAL_SOFTWARE_ERROR);
+
+    builder->main = *vm;
+    builder->frame = *frame;
+    builder->height = vm->stackTop - frame->slots;
+    builder->setSlot = setSlot;
+    builder->stateSlot = loop[1];
+    builder->isRange = isRange;
+    builder->end = loop + 5 + (uint16_t)((loop[3] << 8) | loop[4]);
+    builder->budget = vm->gc.nextGC > BUILDER_HEAP_MIN ? vm->gc.nextGC : BUILDER_HEAP_MIN;
+
+    // Indices of an iterated target are positions in it, which may be more than its values
+    size_t indices = isRange ? count : iterationEnd(AS_OBJ(state[0]));
+    size_t chunks = (size_t)workerCount() * CHUNKS_PER_WORKER;
+    builder->chunkSize = indices > chunks ? indices / chunks : 1;
+    builder->chunkCount = (indices + builder->chunkSize - 1) / builder->chunkSize;
+    builder->chunks = malloc(sizeof(BuilderChunk) * builder->chunkCount);
+    if (builder->chunks == NULL) exit(INTERNAL_SOFTWARE_ERROR);
+
+    if (runChunks(buildChunk, builder, indices, builder->chunkSize)) {
+        mergeBuilder(vm, builder, AS_SET(frame->slots[setSlot]));
+        frame->ip = builder->end;
+    }
+
+    for (int i = 0; i < MAX_WORKERS; i++) {
+        if (builder->sets[i] == NULL) continue;
+
+        VM* worker = &builder->workers[i];
+        freeGC(&worker->gc);
+        free(worker->frames);
+        free(worker->stack);
+    }
+
+    free(builder->chunks);
+    free(builder);
+}
+
+static InterpretResult run(VM* vm) {
     register CallFrame* frame;
 
 #define READ_BYTE()     (*frame->ip++)
 #define READ_SHORT()    (frame->ip += 2, (uint16_t)((frame->ip[-2] << 8) | frame->ip[-1]))
 #define READ_CONSTANT() (frame->closure->function->chunk.constants.values[READ_SHORT()])
 #define READ_STRING()   AS_STRING(READ_CONSTANT())
-#define LOAD_FRAME()    (frame = &vm.frames[vm.frameCount - 1])
+#define LOAD_FRAME()    (frame = &vm->frames[vm->frameCount - 1])
 // --- Ugly ---
 #define BINARY_OP(op) \
     do { \
-        double b = AS_NUMBER(pop()); \
-        double a = AS_NUMBER(pop()); \
-        push(NUMBER_VAL(a op b)); \
+        double b = AS_NUMBER(pop(vm)); \
+        double a = AS_NUMBER(pop(vm)); \
+        push(vm, NUMBER_VAL(a op b)); \
     } while (false)
-#define ORDER_OP(op) \
+#define ORDER_OP(op, quickened) \
     do { \
         ASSERT_THAT((T_NUM(0) || T_CHAR(0)) && (T_NUM(1) || T_CHAR(1)), "Operands must be numbers or characters"); \
-        Value vb = pop(); \
-        Value va = pop(); \
-        double b = IS_CHAR(vb) ? AS_NUMBER(NUMBER_VAL(AS_CHAR(vb))) : AS_NUMBER(vb); \
-        double a = IS_CHAR(va) ? AS_NUMBER(NUMBER_VAL(AS_CHAR(va))) : AS_NUMBER(va); \
-        push(BOOL_VAL(a op b)); \
+        Value vb = pop(vm); \
+        Value va = pop(vm); \
+        if (IS_NUMBER(va) && IS_NUMBER(vb)) QUICKEN(quickened); \
+        double b = IS_CHAR(vb) ? (double)AS_CHAR(vb) : AS_NUMBER(vb); \
+        double a = IS_CHAR(va) ? (double)AS_CHAR(va) : AS_NUMBER(va); \
+        push(vm, BOOL_VAL(a op b)); \
+    } while (false)
+
+// --- Quickening ---
+// Rewrite the current instruction in place, e.g. to a version specialised for the operands it has seen. Workers
+// leave the code they share as it is
+#define QUICKEN(name) (vm->isWorker ? (void)0 : (void)(frame->ip[-1] = OP_##name))
+
+#ifdef DEBUG_QUICKEN_STATS
+    #define COUNT_QUICKEN(counter) (vm->counter[instruction]++)
+#else
+    #define COUNT_QUICKEN(counter) do {} while (false)
+#endif
+
+// Revert to the generic instruction and run it instead
+#define QUICKEN_MISS(generic) \
+    do { \
+        COUNT_QUICKEN(quickenMisses); \
+        QUICKEN(generic); \
+        REDISPATCH(OP_##generic); \
     } while (false)
 
+// Binary op on two numbers, which are replaced in place by the result
+#define QUICK_BINARY_OP(generic, valueType, op) \
+    do { \
+        Value vb = peek(vm, 0); \
+        Value va = peek(vm, 1); \
+        if (!IS_NUMBER(va) || !IS_NUMBER(vb)) QUICKEN_MISS(generic); \
+        COUNT_QUICKEN(quickenHits); \
+        vm->stackTop[-2] = valueType(AS_NUMBER(va) op AS_NUMBER(vb)); \
+        vm->stackTop--; \
+    } while (false)
+// ---
+
 #define SET_OP_GC(valueType, setFunction) \
     do { \
-        ASSERT_THAT(T_SET(0) && T_SET(1), "Operands must be sets"); \
-        ObjSet* setB = AS_SET(pop()); \
-        ObjSet* setA = AS_SET(pop()); \
-        pushTemp(&vm.gc, OBJ_VAL(setA)); \
-        pushTemp(&vm.gc, OBJ_VAL(setB)); \
-        push(valueType(setFunction(&vm.gc, setA, setB))); \
-        popTemp(&vm.gc); \
-        popTemp(&vm.gc); \
+        ASSERT_THAT(T_SET_LIKE(0) && T_SET_LIKE(1), "Operands must be sets"); \
+        ObjSet* setB = toSet(vm, peek(vm, 0)); \
+        pushTemp(&vm->gc, OBJ_VAL(setB)); \
+        ObjSet* setA = toSet(vm, peek(vm, 1)); \
+        pushTemp(&vm->gc, OBJ_VAL(setA)); \
+        Value result = valueType(setFunction(&vm->gc, setA, setB)); \
+        popTemp(&vm->gc); \
+        popTemp(&vm->gc); \
+        vm->stackTop -= 2; \
+        push(vm, result); \
+    } while (false)
+
+// The left operand is only changed if it is owned by the local the result is assigned to. Otherwise a new
+// set is made, which the local then owns. A worker always makes a new set, as the sets it reads may be shared with
+// other threads and the ones it makes are handed back to the main VM.
+#define SET_OP_IN_PLACE(setFunction, inPlaceFunction) \
+    do { \
+        if (!vm->isWorker && IS_SET(peek(vm, 1)) && AS_SET(peek(vm, 1))->isOwned && T_SET_LIKE(0)) { \
+            ObjSet* setB = toSet(vm, peek(vm, 0)); \
+            pushTemp(&vm->gc, OBJ_VAL(setB)); \
+            inPlaceFunction(&vm->gc, AS_SET(peek(vm, 1)), setB); \
+            popTemp(&vm->gc); \
+            vm->stackTop--; \
+        } else { \
+            SET_OP_GC(OBJ_VAL, setFunction); \
+            if (!vm->isWorker) AS_SET(peek(vm, 0))->isOwned = true; \
+        } \
     } while (false)
 
-#define SET_OP(valueType, setFunction) \
+#define SUBSET_OP(isProper) \
     do { \
-        ASSERT_THAT(T_SET(0) && T_SET(1), "Operands must be sets"); \
-        ObjSet* setB = AS_SET(pop()); \
-        ObjSet* setA = AS_SET(pop()); \
-        push(valueType(setFunction(setA, setB))); \
+        ASSERT_THAT(T_SET_LIKE(0) && T_SET_LIKE(1), "Operands must be sets"); \
+        Value b = pop(vm); \
+        Value a = pop(vm); \
+        push(vm, BOOL_VAL(setLikeSubset(a, b, isProper))); \
     } while (false)
 // ---
 
 #ifdef DEBUG_TRACE_EXECUTION
     #define TRACE_EXECUTION() \
-        printStack(vm.stack, vm.stackTop); \
-        disassembleInstruction(&frame->closure->function->chunk, (int)(frame->ip - frame->closure->function->chunk.code));
+        printStack(vm->stack, vm->stackTop); \
+        disassembleInstruction(vm, &frame->closure->function->chunk, (int)(frame->ip - frame->closure->function->chunk.code));
 #else 
     #define TRACE_EXECUTION() do {} while (false)
 #endif
@@ -518,109 +1055,141 @@ static InterpretResult run() {
             TRACE_EXECUTION(); \
             goto *dispatchTable[instruction = (OpCode)READ_BYTE()]; \
         } while (false)
+
+    // Run the current instruction as another opcode
+    #define REDISPATCH(opcode) goto *dispatchTable[instruction = (opcode)]
 #else
     #define INTERPRET_LOOP() \
         loop: \
             TRACE_EXECUTION(); \
-            switch (instruction = (OpCode)READ_BYTE())
+            instruction = (OpCode)READ_BYTE(); \
+        redispatch: \
+            switch (instruction)
 
     #define CASE_CODE(name) case OP_##name
     #define DISPATCH()      goto loop
+
+    #define REDISPATCH(opcode) \
+        do { \
+            instruction = (opcode); \
+            goto redispatch; \
+        } while (false)
 #endif
 
     LOAD_FRAME();
 
     OpCode instruction;
     INTERPRET_LOOP() {
-        CASE_CODE(POP): pop(); DISPATCH();
+        CASE_CODE(POP): pop(vm); DISPATCH();
         CASE_CODE(CONSTANT): {
             Value constant = READ_CONSTANT();
-            push(constant);
+            push(vm, constant);
             DISPATCH();
         }
-        CASE_CODE(NULL): push(NULL_VAL); DISPATCH();
-        CASE_CODE(TRUE): push(BOOL_VAL(true)); DISPATCH();
-        CASE_CODE(FALSE): push(BOOL_VAL(false)); DISPATCH();
+        CASE_CODE(NULL): push(vm, NULL_VAL); DISPATCH();
+        CASE_CODE(TRUE): push(vm, BOOL_VAL(true)); DISPATCH();
+        CASE_CODE(FALSE): push(vm, BOOL_VAL(false)); DISPATCH();
         CASE_CODE(GET_LOCAL): {
             uint8_t slot = READ_BYTE();
-            push(frame->slots[slot]);
+            push(vm, frame->slots[slot]);
+            DISPATCH();
+        }
+        CASE_CODE(SHARE_LOCAL): {
+            // The value may be kept elsewhere, so the local can no longer change its set in place. Workers never
+            // change sets in place, and leave the flag alone as other threads may be reading the set
+            Value value = frame->slots[READ_BYTE()];
+            if (!vm->isWorker && IS_SET(value) && AS_SET(value)->isOwned) AS_SET(value)->isOwned = false;
+            push(vm, value);
             DISPATCH();
         }
         CASE_CODE(SET_LOCAL): {
             uint8_t slot = READ_BYTE();
-            frame->slots[slot] = peek(0);
+            frame->slots[slot] = peek(vm, 0);
             DISPATCH();
         }
         CASE_CODE(GET_GLOBAL): {
-            ObjString* name = READ_STRING();
-            Value value;
-            if (!tableGet(&vm.globals, name, &value)) {
-                runtimeError("Undefined variable '%s'", name->utf8);
+            Global* global = &vm->globals[READ_SHORT()];
+            if (!global->isDefined) {
+                runtimeError(vm, "Undefined variable '%s'", global->name->utf8);
                 return INTERPRET_RUNTIME_ERROR;
             }
-            push(value);
+#ifdef DEBUG_GLOBAL_STATS
+            global->reads++;
+#endif
+            push(vm, global->value);
             DISPATCH();
         }
         CASE_CODE(DEFINE_GLOBAL): {
-            ObjString* name = READ_STRING();
-            tableSet(&vm.gc, &vm.globals, name, peek(0));
-            pop();
+            Global* global = &vm->globals[READ_SHORT()];
+            global->value = pop(vm);
+            global->isDefined = true;
+#ifdef DEBUG_GLOBAL_STATS
+            global->writes++;
+#endif
             DISPATCH();
         }
         CASE_CODE(SET_GLOBAL): {
-            ObjString* name = READ_STRING();
-            if (tableSet(&vm.gc, &vm.globals, name, peek(0))) {
-                tableDelete(&vm.globals, name);
-                runtimeError("Undefined variable '%s'", name->utf8);
+            Global* global = &vm->globals[READ_SHORT()];
+            if (!global->isDefined) {
+                runtimeError(vm, "Undefined variable '%s'", global->name->utf8);
                 return INTERPRET_RUNTIME_ERROR;
             }
+#ifdef DEBUG_GLOBAL_STATS
+            global->writes++;
+#endif
+            global->value = peek(vm, 0);
             DISPATCH();
         }
         CASE_CODE(GET_UPVALUE): {
             uint8_t slot = READ_BYTE();
-            push(*frame->closure->upvalues[slot]->location);
+            push(vm, *frame->closure->upvalues[slot]->location);
             DISPATCH();
         }
         CASE_CODE(SET_UPVALUE): {
-            uint8_t slot = READ_BYTE();
-            *frame->closure->upvalues[slot]->location = peek(0);
+            ObjUpvalue* upvalue = frame->closure->upvalues[READ_BYTE()];
+            *upvalue->location = peek(vm, 0);
+            writeBarrier(&vm->gc, (Obj*)upvalue);
             DISPATCH();
         }
         CASE_CODE(EQUAL): {
-            Value b = pop();
-            Value a = pop();
+            Value b = pop(vm);
+            Value a = pop(vm);
             
             if (IS_BOOL(b) || IS_BOOL(a)) {
                 // Use truth values
-                push(BOOL_VAL(isFalse(b) == isFalse(a)));
+                push(vm, BOOL_VAL(isFalse(b) == isFalse(a)));
             } else {
-                push(BOOL_VAL(valuesEqual(a, b)));
+                if (IS_NUMBER(a) && IS_NUMBER(b)) QUICKEN(EQUAL_NUM);
+                push(vm, BOOL_VAL(valuesEqual(a, b)));
             }
 
             DISPATCH();
         }
         CASE_CODE(NOT_EQUAL): {
-            Value b = pop();
-            Value a = pop();
-            push(BOOL_VAL(!valuesEqual(a, b)));
+            Value b = pop(vm);
+            Value a = pop(vm);
+            if (IS_NUMBER(a) && IS_NUMBER(b)) QUICKEN(NOT_EQUAL_NUM);
+            push(vm, BOOL_VAL(!valuesEqual(a, b)));
             DISPATCH();
         }
-        CASE_CODE(GREATER): ORDER_OP(>); DISPATCH();
-        CASE_CODE(GREATER_EQUAL): ORDER_OP(>=); DISPATCH();
-        CASE_CODE(LESS): ORDER_OP(<); DISPATCH();
-        CASE_CODE(LESS_EQUAL): ORDER_OP(<=); DISPATCH();
+        CASE_CODE(GREATER): ORDER_OP(>, GREATER_NUM); DISPATCH();
+        CASE_CODE(GREATER_EQUAL): ORDER_OP(>=, GREATER_EQUAL_NUM); DISPATCH();
+        CASE_CODE(LESS): ORDER_OP(<, LESS_NUM); DISPATCH();
+        CASE_CODE(LESS_EQUAL): ORDER_OP(<=, LESS_EQUAL_NUM); DISPATCH();
         CASE_CODE(ADD): {
             if (T_STRING(0) || T_STRING(1)) {
                 // Concatenate if at least one operand is a string
-                Value b = pop();
-                Value a = pop();
-                push(OBJ_VAL(concatenateStringsHelper(&vm.gc, a, b)));
+                ASSERT_NOT_WORKER();
+                Value b = pop(vm);
+                Value a = pop(vm);
+                push(vm, OBJ_VAL(concatenateStringsHelper(&vm->gc, a, b)));
             } else if (T_TUPLE(0) && T_TUPLE(1)) {
-                ObjTuple* b = AS_TUPLE(pop());
-                ObjTuple* a = AS_TUPLE(pop());
-                push(OBJ_VAL(concatenateTuple(&vm.gc, a, b)));
+                ObjTuple* b = AS_TUPLE(pop(vm));
+                ObjTuple* a = AS_TUPLE(pop(vm));
+                push(vm, OBJ_VAL(concatenateTuple(&vm->gc, a, b)));
             } else if (T_NUM(0) && T_NUM(1)) {
                 // Else, numerically add
+                QUICKEN(ADD_NUM);
                 BINARY_OP(+);
             } else {
                 ASSERT_THAT(false, "Invalid operand type(s)");
@@ -631,47 +1200,50 @@ static InterpretResult run() {
         CASE_CODE(SUBTRACT): {
             ASSERT_THAT(T_NUM(0) && T_NUM(1), "Operands must be numbers");
 
+            QUICKEN(SUBTRACT_NUM);
             BINARY_OP(-);
             DISPATCH();
         }
         CASE_CODE(MULTIPLY): {
             ASSERT_THAT(T_NUM(0) && T_NUM(1), "Operands must be numbers");
 
+            QUICKEN(MULTIPLY_NUM);
             BINARY_OP(*);
             DISPATCH();
         }
         CASE_CODE(MOD): {
             ASSERT_THAT(T_INT(0) && T_INT(0), "Operands must be integers");
-            ASSERT_THAT(AS_NUMBER(peek(0)) != 0, "Division by 0");
+            ASSERT_THAT(AS_NUMBER(peek(vm, 0)) != 0, "Division by 0");
 
-            int b = (int)AS_NUMBER(pop());
-            int a = (int)AS_NUMBER(pop());
-            push(NUMBER_VAL(a % b));
+            int b = (int)AS_NUMBER(pop(vm));
+            int a = (int)AS_NUMBER(pop(vm));
+            push(vm, NUMBER_VAL(a % b));
             DISPATCH();
         }
         CASE_CODE(DIVIDE): {
             ASSERT_THAT(T_NUM(0) && T_NUM(0), "Operands must be numbers");
-            ASSERT_THAT(AS_NUMBER(peek(0)) != 0, "Division by 0");
+            ASSERT_THAT(AS_NUMBER(peek(vm, 0)) != 0, "Division by 0");
 
+            QUICKEN(DIVIDE_NUM);
             BINARY_OP(/);
             DISPATCH();
         }
         CASE_CODE(EXPONENT): {
             ASSERT_THAT(T_NUM(0) && T_NUM(1), "Operands must be numbers");
 
-            double b = AS_NUMBER(pop());
-            double a = AS_NUMBER(pop());
-            push(NUMBER_VAL(pow(a, b)));
+            double b = AS_NUMBER(pop(vm));
+            double a = AS_NUMBER(pop(vm));
+            push(vm, NUMBER_VAL(pow(a, b)));
             DISPATCH();
         }
         CASE_CODE(NOT): {   
-            push(BOOL_VAL(isFalse(pop()))); 
+            push(vm, BOOL_VAL(isFalse(pop(vm)))); 
             DISPATCH();
         }
         CASE_CODE(NEGATE): {
             ASSERT_THAT(T_NUM(0), "Operand must be a number");
 
-            push(NUMBER_VAL(-AS_NUMBER(pop())));
+            push(vm, NUMBER_VAL(-AS_NUMBER(pop(vm))));
             DISPATCH();
         }
         CASE_CODE(JUMP): {
@@ -681,14 +1253,14 @@ static InterpretResult run() {
         }
         CASE_CODE(JUMP_IF_FALSE): {
             uint16_t offset = READ_SHORT();
-            if (isFalse(peek(0))) frame->ip += offset;
+            if (isFalse(peek(vm, 0))) frame->ip += offset;
             DISPATCH();
         }
         CASE_CODE(JUMP_IF_FALSE_2): { // Pops the condition always. Couldn't think of anything better
             uint16_t offset = READ_SHORT();
-            if (isFalse(peek(0))) {
+            if (isFalse(peek(vm, 0))) {
                 frame->ip += offset;
-                pop();
+                pop(vm);
             }
             DISPATCH();
         }
@@ -699,107 +1271,124 @@ static InterpretResult run() {
         }
         CASE_CODE(CALL): {
             int argCount = READ_BYTE();
-            if (!callValue(peek(argCount), argCount)) {
+            if (!callValue(vm, peek(vm, argCount), argCount)) {
                 return INTERPRET_RUNTIME_ERROR;
             }
             LOAD_FRAME();
             DISPATCH();
         }
+        CASE_CODE(TAIL_CALL): {
+            int argCount = READ_BYTE();
+            Value callee = peek(vm, argCount);
+
+            // Other callables return straight away, so they fall through to the return after the call
+            bool success = IS_CLOSURE(callee) ? tailCall(vm, AS_CLOSURE(callee), argCount) : callValue(vm, callee, argCount);
+            if (!success) return INTERPRET_RUNTIME_ERROR;
+
+            LOAD_FRAME();
+            DISPATCH();
+        }
         CASE_CODE(CLOSURE): {
             ObjFunction* function = AS_FUNCTION(READ_CONSTANT());
-            ObjClosure* closure = newClosure(&vm.gc, function);
-            push(OBJ_VAL(closure));
+            ObjClosure* closure = newClosure(&vm->gc, function);
+            push(vm, OBJ_VAL(closure));
             for (int i = 0; i < closure->upvalueCount; i++) {
                 uint8_t isLocal = READ_BYTE();
                 uint8_t index = READ_BYTE();
                 if (isLocal) {
-                    closure->upvalues[i] = captureUpvalue(frame->slots + index);
+                    closure->upvalues[i] = captureUpvalue(vm, frame->slots + index);
                 } else {
                     closure->upvalues[i] = frame->closure->upvalues[index];
                 }
+                // Capturing may collect, promoting the closure
+                writeBarrier(&vm->gc, (Obj*)closure);
             }
             DISPATCH();
         }
         CASE_CODE(CLOSE_UPVALUE): {
-            closeUpvalues(vm.stackTop - 1);
-            pop();
+            closeUpvalues(vm, vm->stackTop - 1);
+            pop(vm);
             DISPATCH();
         }
         CASE_CODE(RETURN): {
             bool implicitReturn = READ_BYTE();
             Value result;
             if (implicitReturn) {
-                result = vm.impReturnStash;
-                vm.impReturnStash = NULL_VAL;
+                result = vm->impReturnStash;
+                vm->impReturnStash = NULL_VAL;
+
+                // The last statement may have changed a local's set in place, which is no longer the local's alone
+                if (IS_SET(result) && AS_SET(result)->isOwned) AS_SET(result)->isOwned = false;
             } else {
-                result = pop();
+                result = pop(vm);
             }
 
-            closeUpvalues(frame->slots);
-            vm.frameCount--;
-            if (vm.frameCount == 0) {
-                pop();
-                return INTERPRET_OK;
-            }
+            closeUpvalues(vm, frame->slots);
+            vm->frameCount--;
+            vm->stackTop = frame->slots;
+            push(vm, result);
+
+            // The result of the outermost call is left on the stack for its caller in C
+            if (vm->frameCount == 0) return INTERPRET_OK;
 
-            vm.stackTop = frame->slots;
-            push(result);
             LOAD_FRAME();
             DISPATCH();
         }
         CASE_CODE(STASH): {
-            vm.impReturnStash = pop();
+            vm->impReturnStash = pop(vm);
             DISPATCH();
         }
         CASE_CODE(SET_CREATE): {
-            ObjSet* set = newSet(&vm.gc);
-            push(OBJ_VAL(set));
+            ObjSet* set = newSet(&vm->gc);
+            push(vm, OBJ_VAL(set));
             DISPATCH();
         }
         CASE_CODE(SET_INSERT): {
             uint8_t count = READ_BYTE();
             assert(count > 0);
-            setInsertN(count);
+            setInsertN(vm, count);
             DISPATCH();
         }
         CASE_CODE(SET_OMISSION): {
             bool omissionParameter = READ_BYTE();
-            InterpretResult status = omission(true, omissionParameter);
+            InterpretResult status = omission(vm, true, omissionParameter);
             if (status != INTERPRET_OK) return status;
             DISPATCH();
         }
         CASE_CODE(SET_IN): {
-            ASSERT_THAT(T_SET(0), "Right hand operand must be a set");
+            ASSERT_THAT(T_SET_LIKE(0), "Right hand operand must be a set");
 
-            ObjSet* set = AS_SET(pop());
-            Value value = pop();
-            push(BOOL_VAL(setContains(set, value)));
+            Value set = pop(vm);
+            Value value = pop(vm);
+            push(vm, BOOL_VAL(setLikeContains(set, value)));
             DISPATCH();
         }
         CASE_CODE(SET_INTERSECT): SET_OP_GC(OBJ_VAL, setIntersect); DISPATCH();
         CASE_CODE(SET_UNION): SET_OP_GC(OBJ_VAL, setUnion); DISPATCH();
         CASE_CODE(SET_DIFFERENCE): SET_OP_GC(OBJ_VAL, setDifference); DISPATCH();
-        CASE_CODE(SUBSET): SET_OP(BOOL_VAL, isProperSubset); DISPATCH();
-        CASE_CODE(SUBSETEQ): SET_OP(BOOL_VAL, isSubset); DISPATCH();
+        CASE_CODE(SET_UNION_IN_PLACE): SET_OP_IN_PLACE(setUnion, setUnionInPlace); DISPATCH();
+        CASE_CODE(SET_DIFFERENCE_IN_PLACE): SET_OP_IN_PLACE(setDifference, setDifferenceInPlace); DISPATCH();
+        CASE_CODE(SUBSET): SUBSET_OP(true); DISPATCH();
+        CASE_CODE(SUBSETEQ): SUBSET_OP(false); DISPATCH();
         CASE_CODE(SIZE): {
-            int size = getSize(pop());
+            int size = getSize(pop(vm));
             ASSERT_THAT(size != -1, "Invalid operand type");
 
-            push(NUMBER_VAL(size));
+            push(vm, NUMBER_VAL(size));
             DISPATCH();
         }
         CASE_CODE(CREATE_TUPLE): {
             int arity = READ_BYTE();
-            ObjTuple* tuple = newTuple(&vm.gc, arity);
+            ObjTuple* tuple = newTuple(&vm->gc, arity);
             for (int i = arity - 1; i >= 0; i--) {
-                tuple->elements[i] = pop();
+                tuple->elements[i] = pop(vm);
             }
-            push(OBJ_VAL(tuple));
+            push(vm, OBJ_VAL(tuple));
             DISPATCH();
         }
         CASE_CODE(TUPLE_OMISSION): {
             bool omissionParameter = READ_BYTE();
-            InterpretResult status = omission(false, omissionParameter);
+            InterpretResult status = omission(vm, false, omissionParameter);
             if (status != INTERPRET_OK) return status;
             DISPATCH();
         }
@@ -807,57 +1396,126 @@ static InterpretResult run() {
             bool isSlice = READ_BYTE();
             InterpretResult status;
             if (isSlice) {
-                status = sliceObj();
+                status = sliceObj(vm);
             } else {
-                status = indexObj();
+                status = indexObj(vm);
             }
             if (status != INTERPRET_OK) return status;
             DISPATCH();
         }
-        CASE_CODE(CREATE_ITERATOR): {
-            ASSERT_THAT(T_OBJ(0) && AS_OBJ(peek(0))->isIterable, "Generator must iterate over a set, tuple, or a string");
+        CASE_CODE(RANGE_INIT): {
+            // Push the state of a counting loop: the current value, the step, and the no. values left
+            bool hasNext = READ_BYTE();
+            uint8_t stateSlot = READ_BYTE();
+            Omission terms;
+            InterpretResult status = popOmission(vm, hasNext, &terms);
+            if (status != INTERPRET_OK) return status;
+
+            push(vm, terms.isChar ? CHAR_VAL(terms.first) : NUMBER_VAL(terms.first));
+            push(vm, NUMBER_VAL(terms.step));
+            push(vm, NUMBER_VAL(terms.size));
 
-            Obj* target = AS_OBJ(pop());
-            ObjIterator* iterator = newIterator(&vm.gc, target);
-            push(OBJ_VAL(iterator));
+            // Also store it in the state's locals, in case the loop is re-entered with a higher stack
+            memmove(&frame->slots[stateSlot], vm->stackTop - 3, 3 * sizeof(Value));
             DISPATCH();
         }
-        CASE_CODE(ITERATE): {
-            ASSERT_THAT(T_ITER(0), "(Internal) Missing iterator");
+        CASE_CODE(FOR_RANGE): {
+            Value* range = &frame->slots[READ_BYTE()];
+            uint8_t varSlot = READ_BYTE();
+            uint16_t offset = READ_SHORT();
+
+            double remaining = AS_NUMBER(range[2]);
+            if (remaining <= 0) {
+                frame->ip += offset;
+                DISPATCH();
+            }
 
-            ObjIterator* iterator = AS_ITERATOR(pop());
+            frame->slots[varSlot] = range[0];
+            range[2] = NUMBER_VAL(remaining - 1);
+
+            int step = (int)AS_NUMBER(range[1]);
+            range[0] = IS_CHAR(range[0]) ? CHAR_VAL(AS_CHAR(range[0]) + step) : NUMBER_VAL(AS_NUMBER(range[0]) + step);
+            DISPATCH();
+        }
+        CASE_CODE(ITER_INIT): {
+            // Push the index of a generator loop, which goes above its target
+            ASSERT_THAT(T_OBJ(0) && AS_OBJ(peek(vm, 0))->isIterable, "Generator must iterate over a set, tuple, or a string");
+
+            push(vm, NUMBER_VAL(0));
+            DISPATCH();
+        }
+        CASE_CODE(FOR_ITER): {
+            Value* state = &frame->slots[READ_BYTE()];
+            uint8_t varSlot = READ_BYTE();
+            uint16_t offset = READ_SHORT();
+
+            ASSERT_THAT(IS_OBJ(state[0]) && IS_NUMBER(state[1]), "(Internal) Missing generator state");
+
+            // Set the loop variable to the next value, or exit the loop
+            size_t index = (size_t)AS_NUMBER(state[1]);
             Value value;
-            bool hasCurrentVal = iterateObj(iterator, &value);
-            if (hasCurrentVal) push(value);
-            push(BOOL_VAL(hasCurrentVal));
+            if (iterateObj(AS_OBJ(state[0]), &index, &value)) {
+                frame->slots[varSlot] = value;
+                state[1] = NUMBER_VAL(index);
+            } else {
+                frame->ip += offset;
+            }
             DISPATCH();
         }
         CASE_CODE(ARB): {
-            ASSERT_THAT(T_SET(0), "Expected set after arb keyword");
+            ASSERT_THAT(T_SET_LIKE(0), "Expected set after arb keyword");
 
-            ObjSet* set = AS_SET(pop());
-            push(getArb(set));
+            Value set = pop(vm);
+            push(vm, IS_RANGE(set) ? getRangeArb(AS_RANGE(set), &vm->rng) : getArb(AS_SET(set), &vm->rng));
             DISPATCH();
         }
         CASE_CODE(IMPORT_LIB): {
             ObjString* path = READ_STRING();
-            push(importModule(path));
+            push(vm, importModule(vm, path));
 
             if (T_CLOSURE(0)) {
-                ObjClosure* closure = AS_CLOSURE(pop());
-                call(closure, 0);
+                ObjClosure* closure = AS_CLOSURE(pop(vm));
+                if (!call(vm, closure, 0)) return INTERPRET_RUNTIME_ERROR;
                 LOAD_FRAME();
             } else if (T_MODULE(0)) {
                 // Built-in or cached
-                ObjModule* module = AS_MODULE(pop());
-                loadModule(module);
+                ObjModule* module = AS_MODULE(pop(vm));
+                loadModule(vm, module);
             } else {
                 // Resolve error
-                pop();
+                pop(vm);
                 return INTERPRET_RUNTIME_ERROR;
             }
             DISPATCH();
         }
+        CASE_CODE(ADD_NUM): QUICK_BINARY_OP(ADD, NUMBER_VAL, +); DISPATCH();
+        CASE_CODE(SUBTRACT_NUM): QUICK_BINARY_OP(SUBTRACT, NUMBER_VAL, -); DISPATCH();
+        CASE_CODE(MULTIPLY_NUM): QUICK_BINARY_OP(MULTIPLY, NUMBER_VAL, *); DISPATCH();
+        CASE_CODE(DIVIDE_NUM): {
+            // Division by 0 is reported by the generic instruction
+            if (IS_NUMBER(peek(vm, 0)) && AS_NUMBER(peek(vm, 0)) == 0) QUICKEN_MISS(DIVIDE);
+
+            QUICK_BINARY_OP(DIVIDE, NUMBER_VAL, /);
+            DISPATCH();
+        }
+        CASE_CODE(EQUAL_NUM): QUICK_BINARY_OP(EQUAL, BOOL_VAL, ==); DISPATCH();
+        CASE_CODE(NOT_EQUAL_NUM): QUICK_BINARY_OP(NOT_EQUAL, BOOL_VAL, !=); DISPATCH();
+        CASE_CODE(GREATER_NUM): QUICK_BINARY_OP(GREATER, BOOL_VAL, >); DISPATCH();
+        CASE_CODE(GREATER_EQUAL_NUM): QUICK_BINARY_OP(GREATER_EQUAL, BOOL_VAL, >=); DISPATCH();
+        CASE_CODE(LESS_NUM): QUICK_BINARY_OP(LESS, BOOL_VAL, <); DISPATCH();
+        CASE_CODE(LESS_EQUAL_NUM): QUICK_BINARY_OP(LESS_EQUAL, BOOL_VAL, <=); DISPATCH();
+        CASE_CODE(PARALLEL_BUILDER): {
+            uint8_t setSlot = READ_BYTE();
+            bool isPure = READ_BYTE();
+
+            // Otherwise the loop runs here as usual
+            if (isPure && !vm->isWorker) runParallelBuilder(vm, frame, setSlot);
+            DISPATCH();
+        }
+        CASE_CODE(BUILDER_END): {
+            if (vm->frameCount == 1 && frame->ip - 1 == vm->builderEnd) return INTERPRET_OK;
+            DISPATCH();
+        }
     }
 
     ASSERT_THAT(false, "(Internal) Invalid Opcode");
@@ -868,21 +1526,64 @@ static InterpretResult run() {
 #undef READ_STRING
 #undef LOAD_FRAME
 #undef SET_OP_GC
-#undef SET_OP
+#undef SET_OP_IN_PLACE
+#undef SUBSET_OP
+#undef QUICKEN
+#undef COUNT_QUICKEN
+#undef QUICKEN_MISS
+#undef QUICK_BINARY_OP
+#undef REDISPATCH
 }
 
-InterpretResult interpret(const unsigned char* source) {
-    ObjFunction* function = compile(&vm.gc, source);
+/**
+ * @brief Call a function or native from C and run it to completion.
+ *
+ * @param callee   The function to call, which isn't collected during the call
+ * @param args     The arguments, which are copied onto the stack first
+ * @param argCount The no. arguments, at most UINT8_MAX
+ * @param result   The value it returns, or null if there was an error
+ *
+ * Must not be called while the VM is running code, e.g. from a native.
+ */
+InterpretResult callFunction(VM* vm, Value callee, Value* args, int argCount, Value* result) {
+    if (argCount > UINT8_MAX) {
+        *result = NULL_VAL;
+        return INTERPRET_RUNTIME_ERROR;
+    }
+
+    push(vm, callee);
+    for (int i = 0; i < argCount; i++) {
+        push(vm, args[i]);
+    }
+
+    InterpretResult status = INTERPRET_OK;
+    if (!callValue(vm, callee, argCount)) {
+        status = INTERPRET_RUNTIME_ERROR;
+    } else if (IS_CLOSURE(callee)) {
+        status = run(vm);
+    }
+
+    // Errors may leave frames and values behind, which the next call must not see
+    if (status != INTERPRET_OK) {
+        resetStack(vm);
+        *result = NULL_VAL;
+        return status;
+    }
+
+    *result = pop(vm);
+    return INTERPRET_OK;
+}
+
+InterpretResult interpret(VM* vm, const unsigned char* source) {
+    ObjFunction* function = compile(vm, source);
     if (function == NULL) {
         return INTERPRET_COMPILE_ERROR;
     }
 
-    push(OBJ_VAL(function));
-    
-    ObjClosure* closure = newClosure(&vm.gc, function);
-    pop();
-    push(OBJ_VAL(closure));
-    call(closure, 0);
+    push(vm, OBJ_VAL(function));
+    ObjClosure* closure = newClosure(&vm->gc, function);
+    pop(vm);
 
-    return run();
+    Value result;
+    return callFunction(vm, OBJ_VAL(closure), NULL, 0, &result);
 }
\ No newline at end of file
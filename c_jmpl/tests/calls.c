@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "jmpl.h"
+
+/**
+ * @brief Regression tests of calls, whose frames must have room for every value they keep on the stack at once,
+ * and which reuse the caller's frame when they end its body.
+ */
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (false)
+
+#define TUPLE_SIZE 200
+
+/**
+ * @brief Append a tuple literal of the numbers 0 to TUPLE_SIZE - 1, with a nested copy as its last element.
+ *
+ * All of its elements are on the stack before the tuple is made, which is more than a frame used to get.
+ */
+static void appendWideTuple(char* source, size_t size) {
+    strncat(source, "(", size - strlen(source) - 1);
+    for (int nested = 0; nested < 2; nested++) {
+        if (nested) strncat(source, ", (", size - strlen(source) - 1);
+
+        for (int i = 0; i < TUPLE_SIZE; i++) {
+            char number[16];
+            snprintf(number, sizeof(number), i == 0 ? "%d" : ", %d", i);
+            strncat(source, number, size - strlen(source) - 1);
+        }
+    }
+    strncat(source, "))", size - strlen(source) - 1);
+}
+
+static double globalNumber(JmplVM* vm, const char* name) {
+    if (!jmplGetGlobal(vm, name, 0)) return -1;
+    return jmplGetNumber(vm, 0);
+}
+
+int main(void) {
+    static char source[16384];
+    // Each frame of the recursion is deep in the stack when its wide tuple is made
+    strncat(source, "func deep(n) =\n    if n == 0 then return #", sizeof(source) - 1);
+    appendWideTuple(source, sizeof(source));
+    strncat(source, "\n    return 0 + deep(n - 1)\n", sizeof(source) - strlen(source) - 1);
+
+    // A tail call replaces a narrow frame with a wide one
+    strncat(source, "func wide() = #", sizeof(source) - strlen(source) - 1);
+    appendWideTuple(source, sizeof(source));
+    strncat(source, "\nfunc narrow(n) =\n    if n == 0 then return wide()\n    return 0 + narrow(n - 1)\n",
+            sizeof(source) - strlen(source) - 1);
+
+    strncat(source,
+            "let deepTotal = 0\n"
+            "for n ∈ {5000 ... 5499} do\n"
+            "    deepTotal := deepTotal + deep(n)\n"
+            "let narrowTotal = 0\n"
+            "for n ∈ {5000 ... 5099} do\n"
+            "    narrowTotal := narrowTotal + narrow(n)\n"
+            // A call ending a body is still a tail call once the body's locals are popped after it
+            "func count(n, acc) =\n"
+            "    let m = n - 1\n"
+            "    if n == 0 then acc else count(m, acc + 1)\n"
+            "let counted = count(100000, 0)\n"
+            "func countCaptured(n, acc) =\n"
+            "    let m = n - 1\n"
+            "    let get = func() -> m\n"
+            "    if n == 0 then acc else countCaptured(get(), acc + 1)\n"
+            "let countedCaptured = countCaptured(100000, 0)\n",
+            sizeof(source) - strlen(source) - 1);
+
+    JmplVM* vm = jmplNewVM();
+    jmplEnsureSlots(vm, 1);
+
+    CHECK(jmplInterpret(vm, source) == JMPL_OK);
+    CHECK(globalNumber(vm, "deepTotal") == 500 * (TUPLE_SIZE + 1));
+    CHECK(globalNumber(vm, "narrowTotal") == 100 * (TUPLE_SIZE + 1));
+    CHECK(globalNumber(vm, "counted") == 100000);
+    CHECK(globalNumber(vm, "countedCaptured") == 100000);
+
+    jmplFreeVM(vm);
+
+    if (failures > 0) fprintf(stderr, "%d checks failed\n", failures);
+    return failures > 0 ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "jmpl.h"
+
+#ifndef _WIN32
+    #include <pthread.h>
+#endif
+
+/**
+ * @brief A smoke test of the C API in jmpl.h, built against libjmpl like a program that embeds JMPL.
+ */
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (false)
+
+static const char* source =
+    "func square(x) = x * x\n"
+    "func evens(S) = {x ∈ S | x mod 2 == 0}\n"
+    "func greet(s) = \"hi \" + s\n"
+    "let P = {n * n | n ∈ {1 ... 300}}\n";
+
+static JmplHandle* getFunction(JmplVM* vm, const char* name) {
+    if (!jmplGetGlobal(vm, name, 0)) return NULL;
+    return jmplGetHandle(vm, 0);
+}
+
+/**
+ * @brief Interpret the script and call its functions, checking the values that come back.
+ */
+static void runVM(JmplVM* vm) {
+    CHECK(jmplInterpret(vm, source) == JMPL_OK);
+    jmplEnsureSlots(vm, 4);
+
+    JmplHandle* square = getFunction(vm, "square");
+    JmplHandle* evens = getFunction(vm, "evens");
+    JmplHandle* greet = getFunction(vm, "greet");
+    CHECK(square != NULL && evens != NULL && greet != NULL);
+    if (square == NULL || evens == NULL || greet == NULL) return;
+
+    double total = 0;
+    for (int i = 0; i < 1000; i++) {
+        jmplSetNumber(vm, 0, i);
+        CHECK(jmplCall(vm, square, 1) == JMPL_OK);
+        total += jmplGetNumber(vm, 0);
+    }
+    CHECK(total == 332833500);
+
+    double numbers[] = {1, 2, 3, 4, 5, 6, 7, 8, 10};
+    jmplSetNumberSet(vm, 0, numbers, 9);
+    CHECK(jmplCall(vm, evens, 1) == JMPL_OK);
+    CHECK(jmplGetType(vm, 0) == JMPL_TYPE_SET);
+    CHECK(jmplGetSize(vm, 0) == 5);
+
+    jmplSetString(vm, 0, "bob", 3);
+    CHECK(jmplCall(vm, greet, 1) == JMPL_OK);
+    size_t length;
+    const char* greeting = jmplGetString(vm, 0, &length);
+    CHECK(greeting != NULL && length == 6 && strcmp(greeting, "hi bob") == 0);
+
+    jmplSetNumber(vm, 1, 7);
+    jmplSetChar(vm, 2, 'z');
+    jmplSetString(vm, 3, "str", 3);
+    jmplSetTuple(vm, 0, 1, 3);
+    CHECK(jmplGetType(vm, 0) == JMPL_TYPE_TUPLE);
+    CHECK(jmplGetSize(vm, 0) == 3);
+
+    CHECK(jmplGetGlobal(vm, "P", 0));
+    CHECK(jmplGetSize(vm, 0) == 300);
+
+    // A runtime error leaves null in slot 0, and the VM can still be called
+    jmplSetNumber(vm, 0, 1);
+    CHECK(jmplCall(vm, evens, 1) == JMPL_RUNTIME_ERROR);
+    CHECK(jmplGetType(vm, 0) == JMPL_TYPE_NULL);
+    jmplSetNumber(vm, 0, 12);
+    CHECK(jmplCall(vm, square, 1) == JMPL_OK && jmplGetNumber(vm, 0) == 144);
+
+    CHECK(jmplCompile(vm, "let = = =") == NULL);
+
+    JmplHandle* script = jmplCompile(vm, "let T = {n ∈ {1 ... 300} | n mod 3 == 0}\n#T");
+    CHECK(script != NULL);
+    for (int i = 0; i < 3 && script != NULL; i++) {
+        CHECK(jmplCall(vm, script, 0) == JMPL_OK);
+    }
+    CHECK(jmplGetGlobal(vm, "T", 0) && jmplGetSize(vm, 0) == 100);
+
+    jmplReleaseHandle(vm, square);
+    jmplReleaseHandle(vm, evens);
+    jmplReleaseHandle(vm, greet);
+    if (script != NULL) jmplReleaseHandle(vm, script);
+}
+
+#ifndef _WIN32
+static void* runThread(void* arg) {
+    (void)arg;
+    JmplVM* vm = jmplNewVM();
+    runVM(vm);
+    jmplFreeVM(vm);
+    return NULL;
+}
+#endif
+
+int main(void) {
+    jmplInitThreads(2);
+
+    // Two VMs used in turn keep their globals apart
+    JmplVM* first = jmplNewVM();
+    JmplVM* second = jmplNewVM();
+    runVM(first);
+    CHECK(jmplInterpret(second, "let only = 1") == JMPL_OK);
+    jmplEnsureSlots(first, 1);
+    CHECK(!jmplGetGlobal(first, "only", 0));
+    runVM(second);
+    jmplFreeVM(first);
+    jmplFreeVM(second);
+
+#ifndef _WIN32
+    // VMs on different threads run at the same time
+    pthread_t threads[2];
+    for (int i = 0; i < 2; i++) pthread_create(&threads[i], NULL, runThread, NULL);
+    for (int i = 0; i < 2; i++) pthread_join(threads[i], NULL);
+#endif
+
+    jmplFreeThreads();
+
+    if (failures > 0) fprintf(stderr, "%d checks failed\n", failures);
+    return failures > 0 ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include <stdio.h>
+
+#include "jmpl.h"
+
+/**
+ * @brief Regression tests of set assignments that change a local's set in place, where the set must not be shared.
+ */
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (false)
+
+static const char* source =
+    "func make() =\n"
+    "    let S = {\"a\"}\n"
+    "    S := S ∪ {\"b\", \"c\"}\n"
+    // The set make returns is shared by X and Y, so changing Y must copy it
+    "func alias() =\n"
+    "    let X = make()\n"
+    "    let Y = X\n"
+    "    Y := Y ∪ {\"z\"}\n"
+    "    X\n"
+    "let aliased = alias()\n"
+    // Nor may a local change a set a global holds
+    "let G = make()\n"
+    "func grow() =\n"
+    "    let Y = G\n"
+    "    Y := Y ∪ {\"y\"}\n"
+    "    Y\n"
+    "let grown = grow()\n"
+    // Removing a persistent set from itself empties it
+    "func empty() =\n"
+    "    let T = {i | i ∈ {1 ... 1000}} ∪ {\"s\"}\n"
+    "    T := T \\ {\"s\"}\n"
+    "    T := T \\ T\n"
+    "    T := T ∪ {\"t\"}\n"
+    "    T\n"
+    "let emptied = empty()\n";
+
+static size_t globalSize(JmplVM* vm, const char* name) {
+    if (!jmplGetGlobal(vm, name, 0)) return (size_t)-1;
+    return jmplGetSize(vm, 0);
+}
+
+int main(void) {
+    JmplVM* vm = jmplNewVM();
+    jmplEnsureSlots(vm, 1);
+
+    CHECK(jmplInterpret(vm, source) == JMPL_OK);
+    CHECK(globalSize(vm, "aliased") == 3);
+    CHECK(globalSize(vm, "G") == 3);
+    CHECK(globalSize(vm, "grown") == 4);
+    CHECK(globalSize(vm, "emptied") == 1);
+
+    jmplFreeVM(vm);
+
+    if (failures > 0) fprintf(stderr, "%d checks failed\n", failures);
+    return failures > 0 ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+# Builds the VM with switch dispatch and with computed goto dispatch, checks that the examples
+# behave the same under both, then times the benchmarks under both
+set -e -o pipefail
+
+cmake -DCMAKE_BUILD_TYPE=Release -DJMPL_COMPUTED_GOTOS=OFF -S . -B ./build-switch > /dev/null
+cmake --build ./build-switch > /dev/null
+cmake -DCMAKE_BUILD_TYPE=Release -DJMPL_COMPUTED_GOTOS=ON -S . -B ./build-goto > /dev/null
+cmake --build ./build-goto > /dev/null
+
+if ! grep -q "JMPL_HAS_COMPUTED_GOTOS:INTERNAL=1" ./build-goto/CMakeCache.txt; then
+    echo "Compiler does not support computed gotos, both builds use switch dispatch"
+fi
+
+# Both builds come from the same tree and seed arb the same way, so only the timings differ between their outputs
+output() {
+    "$1" "$2" 2>&1 | sed '/^Time: /d'
+}
+
+failed=0
+for example in ./examples/*.jmpl; do
+    if ! switchOut=$(output ./build-switch/jmpl0-2-2 "$example"); then
+        echo "FAIL $example (switch dispatch)"
+        failed=1
+    elif ! gotoOut=$(output ./build-goto/jmpl0-2-2 "$example"); then
+        echo "FAIL $example (computed goto dispatch)"
+        failed=1
+    elif [ "$switchOut" != "$gotoOut" ]; then
+        echo "FAIL $example (output differs)"
+        failed=1
+    else
+        echo "ok   $example"
+    fi
+done
+
+# Every benchmark ends by printing its total time on a "Time: " line
+for benchmark in ./benchmarks/*.jmpl; do
+    echo "--- $benchmark"
+    echo "switch: $(./build-switch/jmpl0-2-2 "$benchmark" | grep "^Time: ")"
+    echo "goto:   $(./build-goto/jmpl0-2-2 "$benchmark" | grep "^Time: ")"
+done
+
+exit $failed
\ No newline at end of file